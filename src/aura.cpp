@@ -22,12 +22,26 @@ CODE PORTED FROM THE ORIGINAL GHOST PROJECT: http://ghost.pwner.org/
 #include "config.h"
 #include "socket.h"
 #include "map.h"
+#include "mappedfile.h"
 #include "game.h"
+#include "gameprotocol.h"
+#include "gameplayer.h"
+#include "gpsprotocol.h"
+#include "spectator.h"
+#include "maplibrary.h"
+#include "downloadscheduler.h"
+#include "util.h"
 
 #include <csignal>
+#include <cctype>
 #include <cstdlib>
+#include <algorithm>
 #include <ctime>
 #include <iostream>
+#include <sstream>
+#include <chrono>
+#include <mutex>
+#include <thread>
 
 #ifdef WIN32
 #include <ws2tcpip.h>
@@ -81,10 +95,55 @@ uint32_t GetTicks()
 #include "logging.h"
 void Print(const std::string &message)
 {
+	// maps are loaded on a background thread when they're swapped, see CAura::UpdateMapSwap
+	// the lock is recursive because SignalCatcher may interrupt a Print to print on the same thread
+
+	static std::recursive_mutex PrintMutex;
+	std::lock_guard<std::recursive_mutex> Lock(PrintMutex);
 	std::cout << message << std::endl;
 	logging::logger() << message;
 }
 
+// the console is read on its own thread so waiting for input never blocks the loop, the lines are handled in CAura::UpdateConsole
+// the lines are kept outside of CAura because the thread can't be stopped and may outlive it
+
+static std::mutex gConsoleMutex;
+static std::vector<std::string> gConsoleLines;
+
+static void ReadConsole()
+{
+	std::string Line;
+
+	while (std::getline(std::cin, Line))
+	{
+		std::lock_guard<std::mutex> Lock(gConsoleMutex);
+		gConsoleLines.push_back(Line);
+	}
+}
+
+// reads the next argument of a console command, the rest of the line unless it's in double quotes
+// Warcraft III map paths often have spaces in them (Maps\Download\DotA v6.83d.w3x) and back slashes aren't escapes
+
+static std::string ReadConsoleArgument(std::istream &SS)
+{
+	std::string Argument;
+	SS >> std::ws;
+
+	if (SS.peek() == '"')
+	{
+		SS.get();
+		std::getline(SS, Argument, '"');
+		return Argument;
+	}
+
+	std::getline(SS, Argument);
+
+	while (!Argument.empty() && isspace((unsigned char)Argument.back()))
+		Argument.pop_back();
+
+	return Argument;
+}
+
 static void SignalCatcher(int32_t)
 {
 	Print("[!!!] caught signal SIGINT, exiting NOW");
@@ -214,8 +273,16 @@ int main(int, char *argv[])
 
 CAura::CAura(CConfig *CFG)
 	: m_UDPSocket(new CUDPSocket()),
-	m_Map(nullptr),
+	m_UDPServer(nullptr),
+	m_GameProtocol(new CGameProtocol()),
+	m_GPSProtocol(new CGPSProtocol()),
+	m_ReconnectServer(nullptr),
+	m_SpectatorServer(nullptr),
+	m_MapLibrary(nullptr),
+	m_GameConfig(nullptr),
+	m_DownloadScheduler(nullptr),
 	m_HostCounter(1),
+	m_SendQueueWatermark(0),
 	m_Exiting(false)
 {
 	Print("[AURA] Aura++ version 1.24");
@@ -223,10 +290,38 @@ CAura::CAura(CConfig *CFG)
 	m_UDPSocket->SetBroadcastTarget(std::string());
 	m_UDPSocket->SetDontRoute(false);
 
+	// answer LAN game searches ourselves so clients see new lobbies immediately
+	// this fails if a Warcraft III client on this machine already owns the port without SO_REUSEADDR, in which case we only broadcast
+
+	if (CFG->GetInt("lan_responder", 1) != 0)
+	{
+		m_UDPServer = new CUDPSocket();
+
+		if (m_UDPServer->Bind(std::string(), 6112))
+			Print("[AURA] answering LAN game searches on UDP port 6112");
+		else
+		{
+			Print("[AURA] error binding UDP port 6112, LAN games will only be broadcast");
+			delete m_UDPServer;
+			m_UDPServer = nullptr;
+		}
+	}
+
+	// maps are loaded from bot_mapdir when a game needs them, without a map config one is generated from the map file itself
+
+	m_MapLibrary = new CMapLibrary(CFG->GetString("bot_mapdir", std::string()), CFG->GetString("bot_mapcatalog", std::string()), CFG->GetString("bot_mapcachepath", "mapcache"), CFG->GetString("bot_jasspath", "jass"), (uint64_t)CFG->GetInt("bot_mapmemory", 256) * 1048576, CFG->GetInt("bot_maphugepages", 0) != 0);
+
+	// map downloads share one upload budget, bot_maxdownloadspeed is in KB/s and 0 means unlimited like bot_maxdownloaders
+
+	const uint32_t MaxDownloadSpeed = CFG->GetInt("bot_maxdownloadspeed", 0);
+	const uint32_t MaxDownloaders = CFG->GetInt("bot_maxdownloaders", 0);
+	m_DownloadScheduler = new CDownloadScheduler(MaxDownloadSpeed * 1024, MaxDownloaders);
+
+	if (MaxDownloadSpeed > 0 || MaxDownloaders > 0)
+		Print("[AURA] map downloads are limited to " + (MaxDownloadSpeed > 0 ? std::to_string(MaxDownloadSpeed) + " KB/s" : std::string("unlimited speed")) + " and " + (MaxDownloaders > 0 ? std::to_string(MaxDownloaders) : std::string("any number of")) + " players at once");
+
 	std::string MapPath = CFG->GetString("bot_mappath", std::string());
-	std::string MapCFGPath = CFG->GetString("bot_mapcfgpath", std::string());
-	CConfig MAP(MapCFGPath);
-	m_Map = new CMap(MapPath, &MAP);
+	std::shared_ptr<CMap> Map = m_MapLibrary->Get(MapPath, CFG->GetString("bot_mapcfgpath", std::string()));
 
 	std::string GameName = CFG->GetString("bot_defaultgamename", "");
 	std::string VirtualHostName = CFG->GetString("bot_virtualhostname", "|cFF4080C0YDWE");
@@ -240,7 +335,7 @@ CAura::CAura(CConfig *CFG)
 		VirtualHostName = VirtualHostName.substr(0, 15);
 	}
 
-	if (!m_Map->GetValid())
+	if (!Map)
 	{
 		return;
 	}
@@ -252,19 +347,121 @@ CAura::CAura(CConfig *CFG)
 	config->VirtualHostName = VirtualHostName;
 	config->War3Version = CFG->GetInt("lan_war3version", 26);
 	config->Latency = CFG->GetInt("bot_latency", 100);
+	config->DynamicLatency = CFG->GetInt("bot_dynamiclatency", 0) != 0;
+	config->MinLatency = CFG->GetInt("bot_minlatency", 30);
+	config->MaxLatency = CFG->GetInt("bot_maxlatency", 250);
+	config->NetStatsInterval = CFG->GetInt("bot_netstatsinterval", 0);
+	config->LobbyTimeout = CFG->GetInt("bot_lobbytimeout", 30000);
+	config->LoadingTimeout = CFG->GetInt("bot_loadingtimeout", 30000);
+	config->GameTimeout = CFG->GetInt("bot_gametimeout", 8000);
+	config->LagScreenGrace = CFG->GetInt("bot_lagscreengrace", 10000);
+	config->GamePingInterval = CFG->GetInt("bot_gamepinginterval", 1000);
+	config->HandshakeTimeout = CFG->GetInt("bot_handshaketimeout", 5000);
+	config->MaxPotentials = CFG->GetInt("bot_maxpotentials", 32);
+	config->MaxPotentialsPerIP = CFG->GetInt("bot_maxpotentialsperip", 4);
+	config->AcceptRate = CFG->GetInt("bot_acceptrate", 2);
+	config->AcceptBurst = CFG->GetInt("bot_acceptburst", 8);
+	config->SendQueueLimit = CFG->GetInt("bot_sendqueuelimit", 262144);
+	config->SendQueueStall = CFG->GetInt("bot_sendqueuestall", 10000);
+	config->SendQueuePolicy = CFG->GetString("bot_sendqueuepolicy", "lag") == "drop" ? SENDQUEUE_POLICY_DROP : SENDQUEUE_POLICY_LAG;
+	config->LoadInGame = CFG->GetInt("bot_loadingame", 0) != 0;
+	config->ReconnectPort = 0;
+	config->ReconnectWaitTime = CFG->GetInt("bot_reconnectwaittime", 180000);
+	config->ReconnectHistory = CFG->GetInt("bot_reconnecthistory", 4194304);
+
+	// GProxy++ players reconnect to a separate port and are matched to their game by PID and reconnect key
+
+	if (CFG->GetInt("bot_reconnect", 0) != 0)
+	{
+		uint16_t ReconnectPort = CFG->GetInt("bot_reconnectport", 6114);
+		m_ReconnectServer = new CTCPServer();
+
+		if (m_ReconnectServer->Listen(std::string(), ReconnectPort))
+		{
+			Print("[AURA] listening for GProxy++ reconnects on port " + std::to_string(ReconnectPort));
+			config->ReconnectPort = ReconnectPort;
+		}
+		else
+		{
+			Print("[AURA] error listening for GProxy++ reconnects on port " + std::to_string(ReconnectPort) + ", reconnecting is disabled");
+			delete m_ReconnectServer;
+			m_ReconnectServer = nullptr;
+		}
+	}
+
+	// spectators connect to a separate port and only ever receive data, they don't take a slot and can't affect the game
+
+	config->SpectatorPort = 0;
+	config->SpectatorDelay = CFG->GetInt("bot_spectatordelay", 30000);
+	config->SpectatorHistory = CFG->GetInt("bot_spectatorhistory", 16777216);
+	config->SpectatorMaxViewers = CFG->GetInt("bot_spectatormaxviewers", 500);
+
+	// the action budget has to fit the largest action a client can send in one W3GS_OUTGOING_ACTION
+
+	config->ActionRate = CFG->GetInt("bot_actionrate", 16384);
+	config->ActionBurst = std::max<uint32_t>(CFG->GetInt("bot_actionburst", 32768), 1460);
+	config->MaxIntervalActions = CFG->GetInt("bot_maxintervalactions", 64);
+	config->ActionBacklog = CFG->GetInt("bot_actionbacklog", 65536);
+	config->ActionPolicy = CFG->GetString("bot_actionpolicy", "defer") == "drop" ? ACTION_POLICY_DROP : ACTION_POLICY_DEFER;
+
+	if (uint16_t SpectatorPort = CFG->GetInt("bot_spectatorport", 0))
+	{
+		m_SpectatorServer = new CTCPServer();
+
+		if (m_SpectatorServer->Listen(std::string(), SpectatorPort))
+		{
+			Print("[AURA] listening for spectators on port " + std::to_string(SpectatorPort) + " with a delay of " + std::to_string(config->SpectatorDelay) + " ms");
+			config->SpectatorPort = SpectatorPort;
+		}
+		else
+		{
+			Print("[AURA] error listening for spectators on port " + std::to_string(SpectatorPort) + ", spectating is disabled");
+			delete m_SpectatorServer;
+			m_SpectatorServer = nullptr;
+		}
+	}
+
+	m_SendQueueWatermark = CFG->GetInt("bot_sendqueuewatermark", 67108864);
 	config->AutoStart = CFG->GetInt("bot_autostart", 1);
-	m_Games.push_back(new CGame(m_Map, config, m_UDPSocket, m_HostCounter++));
+	config->LANBroadcastInterval = CFG->GetInt("lan_broadcastinterval", m_UDPServer ? 30000 : 5000);
+	m_GameConfig = config;
+	m_HostedMap = Map;
+	m_HostedMapPath = MapPath;
+	m_Games.push_back(new CGame(Map, config, m_UDPSocket, m_DownloadScheduler, m_HostCounter++));
+
+	std::thread(ReadConsole).detach();
 }
 
 CAura::~CAura()
 {
-	delete m_UDPSocket;
+	// a map being loaded in the background uses the map library
 
-	if (m_Map)
-		delete m_Map;
+	if (m_PendingMap.valid())
+		m_PendingMap.wait();
+
+	// games broadcast W3GS_DECREATEGAME when they're deleted so they must go before the UDP socket
 
 	for (auto & game : m_Games)
 		delete game;
+
+	for (auto & socket : m_ReconnectSockets)
+		delete socket;
+
+	for (auto & socket : m_SpectatorSockets)
+		delete socket;
+
+	for (auto & feed : m_SpectatorFeeds)
+		delete feed;
+
+	delete m_ReconnectServer;
+	delete m_SpectatorServer;
+	delete m_GPSProtocol;
+	delete m_UDPServer;
+	delete m_UDPSocket;
+	delete m_GameProtocol;
+	delete m_MapLibrary;
+	delete m_GameConfig;
+	delete m_DownloadScheduler;
 }
 
 bool CAura::Update()
@@ -283,11 +480,61 @@ bool CAura::Update()
 	for (auto & game : m_Games)
 		NumFDs += game->SetFD(&fd, &send_fd, &nfds);
 
+	// 3. the LAN responder
+
+	if (m_UDPServer)
+	{
+		m_UDPServer->SetFD(&fd, &send_fd, &nfds);
+		++NumFDs;
+	}
+
+	// 4. the GProxy++ reconnect listener and its pending connections
+
+	if (m_ReconnectServer)
+	{
+		m_ReconnectServer->SetFD(&fd, &send_fd, &nfds);
+		++NumFDs;
+	}
+
+	for (auto & socket : m_ReconnectSockets)
+	{
+		socket->SetFD(&fd, &send_fd, &nfds);
+		++NumFDs;
+	}
+
+	// 5. the spectator listener, its pending connections and every feed's viewers
+
+	if (m_SpectatorServer)
+	{
+		m_SpectatorServer->SetFD(&fd, &send_fd, &nfds);
+		++NumFDs;
+	}
+
+	for (auto & socket : m_SpectatorSockets)
+	{
+		socket->SetFD(&fd, &send_fd, &nfds);
+		++NumFDs;
+	}
+
+	for (auto & game : m_Games)
+	{
+		if (game->GetSpectatorFeed())
+			NumFDs += game->GetSpectatorFeed()->SetFD(&fd, &send_fd, &nfds);
+	}
+
+	for (auto & feed : m_SpectatorFeeds)
+		NumFDs += feed->SetFD(&fd, &send_fd, &nfds);
+
 	// before we call select we need to determine how long to block for
-	// 50 ms is the hard maximum
+	// 50 ms is the hard maximum, we wake up earlier when a map download is due to send its next part
+	uint32_t Wait = 50;
+	const uint32_t Ticks = GetTicks();
+
+	Wait = std::min(Wait, m_DownloadScheduler->GetWait(Ticks));
+
 	static struct timeval tv;
 	tv.tv_sec = 0;
-	tv.tv_usec = 50000;
+	tv.tv_usec = Wait * 1000;
 
 	static struct timeval send_tv;
 	send_tv.tv_sec = 0;
@@ -309,6 +556,37 @@ bool CAura::Update()
 		MILLISLEEP(200);
 	}
 
+	// answer W3GS_SEARCHGAME with every open lobby that matches the client's version
+
+	if (m_UDPServer)
+	{
+		struct sockaddr_in From;
+		BYTEARRAY Packet;
+
+		while (m_UDPServer->RecvFrom(&fd, &From, Packet))
+		{
+			const uint32_t War3Version = m_GameProtocol->RECEIVE_W3GS_SEARCHGAME(Packet);
+
+			if (War3Version == 0)
+				continue;
+
+			for (auto & game : m_Games)
+			{
+				if (game->GetLobbyOpen() && game->GetWar3Version() == War3Version)
+					m_UDPServer->SendTo(From, game->GetGameInfo());
+			}
+		}
+	}
+
+	// hand reconnecting GProxy++ players back to their games
+
+	UpdateReconnects(&fd, &send_fd);
+
+	// console commands and a map that finished loading in the background
+
+	UpdateConsole();
+	UpdateMapSwap();
+
 	// update running games
 
 	for (auto i = begin(m_Games); i != end(m_Games);)
@@ -316,8 +594,25 @@ bool CAura::Update()
 		if ((*i)->Update(&fd, &send_fd))
 		{
 			Print("[AURA] deleting game [" + (*i)->GetGameName() + "]");
+
+			// let the spectators watch the rest of the game, they're bot_spectatordelay behind
+
+			CSpectatorFeed *Feed = (*i)->ReleaseSpectatorFeed();
+
+			if (Feed && Feed->GetNumViewers() > 0)
+			{
+				Feed->SetFinished();
+				m_SpectatorFeeds.push_back(Feed);
+			}
+			else
+				delete Feed;
+
 			delete *i;
 			i = m_Games.erase(i);
+
+			// the game's map may not be used by any other game now
+
+			m_MapLibrary->Trim();
 		}
 		else
 		{
@@ -326,5 +621,350 @@ bool CAura::Update()
 		}
 	}
 
-	return m_Exiting || m_Games.size() == 0;
+	ShedSendQueues();
+
+	// map downloads go after every game has sent its own data and mostly wait while some of it couldn't be sent, see CDownloadScheduler
+
+	bool GameDataQueued = false;
+
+	for (auto & game : m_Games)
+	{
+		if (game->GetGameDataQueued())
+			GameDataQueued = true;
+	}
+
+	m_DownloadScheduler->Update(GetTicks(), &send_fd, GameDataQueued);
+
+	// spectators are served after the players so they never delay the game
+
+	UpdateSpectators(&fd);
+
+	return m_Exiting || (m_Games.size() == 0 && m_SpectatorFeeds.empty());
+}
+
+void CAura::UpdateReconnects(void *fd, void *send_fd)
+{
+	if (m_ReconnectServer)
+	{
+		CTCPSocket *NewSocket = m_ReconnectServer->Accept((fd_set *)fd);
+
+		// only a handful of reconnects should ever be pending at once
+
+		if (NewSocket)
+		{
+			if (m_ReconnectSockets.size() < 16)
+				m_ReconnectSockets.push_back(NewSocket);
+			else
+				delete NewSocket;
+		}
+	}
+
+	const uint32_t Ticks = GetTicks();
+
+	for (auto i = begin(m_ReconnectSockets); i != end(m_ReconnectSockets);)
+	{
+		CTCPSocket *Socket = *i;
+		Socket->DoRecv((fd_set *)fd);
+
+		std::string *RecvBuffer = Socket->GetBytes();
+		const BYTEARRAY Bytes = CreateByteArray((uint8_t *)RecvBuffer->c_str(), RecvBuffer->size());
+		bool Done = Socket->HasError() || !Socket->GetConnected() || Ticks - Socket->GetLastRecv() >= 10000;
+
+		// GPS_RECONNECT is the only packet we expect here
+
+		if (!Done && Bytes.size() >= 4)
+		{
+			const uint16_t Length = ByteArrayToUInt16(Bytes, 2);
+
+			if (Bytes[0] != GPS_HEADER_CONSTANT || Bytes[1] != CGPSProtocol::GPS_RECONNECT || Length < 4)
+				Done = true;
+			else if (Bytes.size() >= Length)
+			{
+				uint8_t PID;
+				uint32_t ReconnectKey;
+				uint32_t LastPacket;
+				uint32_t Reason = REJECTGPS_INVALID;
+
+				if (m_GPSProtocol->RECEIVE_GPSC_RECONNECT(BYTEARRAY(begin(Bytes), begin(Bytes) + Length), PID, ReconnectKey, LastPacket))
+				{
+					Reason = REJECTGPS_NOTFOUND;
+
+					for (auto & game : m_Games)
+					{
+						CGamePlayer *Player = game->GetPlayerFromPID(PID);
+
+						if (Player && Player->GetGProxy() && Player->GetReconnectKey() == ReconnectKey)
+						{
+							// GProxy++ usually notices the lost connection before we do and the player's old socket still looks alive
+							// it won't try again after a reject so the player is treated as disconnected right now
+
+							if (!Player->GetDisconnected() && !game->EventPlayerGProxyDisconnect(Player))
+								break;
+
+							Socket->ClearRecvBuffer();
+
+							if (game->EventPlayerReconnected(Player, Socket, LastPacket))
+							{
+								Socket = nullptr;
+								Reason = 0;
+							}
+
+							break;
+						}
+					}
+				}
+
+				if (Socket)
+				{
+					Socket->PutBytes(m_GPSProtocol->SEND_GPSS_REJECT(Reason));
+					Socket->DoSend((fd_set *)send_fd);
+				}
+
+				Done = true;
+			}
+		}
+
+		if (Done)
+		{
+			delete Socket;
+			i = m_ReconnectSockets.erase(i);
+		}
+		else
+			++i;
+	}
+}
+
+void CAura::UpdateSpectators(void *fd)
+{
+	if (m_SpectatorServer)
+	{
+		CTCPSocket *NewSocket = m_SpectatorServer->Accept((fd_set *)fd);
+
+		if (NewSocket)
+		{
+			if (m_SpectatorSockets.size() < 64)
+				m_SpectatorSockets.push_back(NewSocket);
+			else
+				delete NewSocket;
+		}
+	}
+
+	const uint32_t Ticks = GetTicks();
+
+	for (auto i = begin(m_SpectatorSockets); i != end(m_SpectatorSockets);)
+	{
+		CTCPSocket *Socket = *i;
+		Socket->DoRecv((fd_set *)fd);
+
+		std::string *RecvBuffer = Socket->GetBytes();
+		const BYTEARRAY Bytes = CreateByteArray((uint8_t *)RecvBuffer->c_str(), RecvBuffer->size());
+		bool Done = Socket->HasError() || !Socket->GetConnected() || Ticks - Socket->GetLastRecv() >= 10000;
+
+		// SPECTATOR_REQUEST is the only packet we expect here
+		// a host counter of 0 means any game that's already running
+
+		if (!Done && Bytes.size() >= 4)
+		{
+			const uint16_t Length = ByteArrayToUInt16(Bytes, 2);
+
+			if (Bytes[0] != SPECTATOR_HEADER_CONSTANT || Bytes[1] != CSpectatorFeed::SPECTATOR_REQUEST || Length < 4)
+				Done = true;
+			else if (Bytes.size() >= Length)
+			{
+				uint32_t HostCounter;
+
+				if (CSpectatorFeed::RECEIVE_SPECTATOR_REQUEST(BYTEARRAY(begin(Bytes), begin(Bytes) + Length), HostCounter))
+				{
+					for (auto & game : m_Games)
+					{
+						CSpectatorFeed *Feed = game->GetSpectatorFeed();
+
+						if (Feed && Feed->GetStarted() && (HostCounter == 0 || HostCounter == game->GetLANHostCounter()))
+						{
+							Socket->ClearRecvBuffer();
+
+							if (Feed->AddViewer(Socket))
+							{
+								Print("[GAME: " + game->GetGameName() + "] spectator [" + Socket->GetIPString() + "] is watching, " + std::to_string(Feed->GetNumViewers()) + " viewers");
+								Socket = nullptr;
+							}
+
+							break;
+						}
+					}
+				}
+
+				Done = true;
+			}
+		}
+
+		if (Done)
+		{
+			delete Socket;
+			i = m_SpectatorSockets.erase(i);
+		}
+		else
+			++i;
+	}
+
+	for (auto & game : m_Games)
+	{
+		if (game->GetSpectatorFeed())
+			game->GetSpectatorFeed()->Update(Ticks, fd);
+	}
+
+	for (auto i = begin(m_SpectatorFeeds); i != end(m_SpectatorFeeds);)
+	{
+		(*i)->Update(Ticks, fd);
+
+		if ((*i)->GetDone())
+		{
+			delete *i;
+			i = m_SpectatorFeeds.erase(i);
+		}
+		else
+			++i;
+	}
+}
+
+void CAura::ShedSendQueues()
+{
+	if (m_SendQueueWatermark == 0)
+		return;
+
+	// every game limits its players' send queues on its own but many games with many slow players can still add up
+	// if they do, drop the player with the biggest queue, one per update until we're below the watermark again
+
+	uint64_t Total = 0;
+	CGame *LargestGame = nullptr;
+	CGamePlayer *Largest = nullptr;
+
+	for (auto & game : m_Games)
+	{
+		for (auto & player : game->GetPlayers())
+		{
+			if (player->GetDeleteMe())
+				continue;
+
+			const uint32_t Queued = player->GetSocket()->GetSendBufferSize();
+			Total += Queued;
+
+			if (!Largest || Queued > Largest->GetSocket()->GetSendBufferSize())
+			{
+				LargestGame = game;
+				Largest = player;
+			}
+		}
+	}
+
+	if (Total <= m_SendQueueWatermark || !Largest)
+		return;
+
+	Print("[AURA] " + std::to_string(Total) + " bytes queued for sending, over the " + std::to_string(m_SendQueueWatermark) + " byte watermark, dropping player [" + Largest->GetName() + "] from game [" + LargestGame->GetGameName() + "] (" + std::to_string(Largest->GetSocket()->GetSendBufferSize()) + " bytes queued)");
+	LargestGame->DeletePlayer(Largest, PLAYERLEAVE_DISCONNECT);
+	Largest->GetSocket()->ClearSendBuffer();
+}
+
+void CAura::UpdateConsole()
+{
+	std::vector<std::string> Lines;
+
+	{
+		std::lock_guard<std::mutex> Lock(gConsoleMutex);
+		Lines.swap(gConsoleLines);
+	}
+
+	for (auto & line : Lines)
+	{
+		std::istringstream SS(line);
+		std::string Command;
+		SS >> Command;
+
+		if (Command.empty())
+			continue;
+
+		if (Command == "map")
+		{
+			// map <map path> or map "<map path>" "<map config path>": host new lobbies with this map (e.g. a new version of the hosted map) once it's loaded
+			// the map path is the rest of the line, to give a map config path as well the map path is quoted (the config path may be too)
+			// the map is loaded and checked on another thread, nothing changes until it's ready and nothing changes if it isn't valid
+			// a new version of the hosted map has to be renamed over the old file (or given a new name), a file rewritten in place is refused
+
+			const bool Quoted = (SS >> std::ws).peek() == '"';
+			const std::string MapPath = ReadConsoleArgument(SS);
+			const std::string CFGPath = Quoted ? ReadConsoleArgument(SS) : std::string();
+
+			if (MapPath.empty())
+				Print("[AURA] usage: map <map path> or map \"<map path>\" \"<map config path>\"");
+			else if (m_PendingMap.valid())
+				Print("[AURA] still loading [" + m_PendingMapPath + "], try again when it's done");
+			else
+			{
+				Print("[AURA] loading [" + MapPath + "] in the background");
+				CMapLibrary *Library = m_MapLibrary;
+				m_PendingMapPath = MapPath;
+				m_PendingMap = std::async(std::launch::async, [Library, MapPath, CFGPath]()
+				{
+					return Library->Load(MapPath, CFGPath);
+				});
+			}
+		}
+		else
+			Print("[AURA] unknown command [" + Command + "], the only command is: map <map path> or map \"<map path>\" \"<map config path>\"");
+	}
+}
+
+void CAura::UpdateMapSwap()
+{
+	if (!m_PendingMap.valid() || m_PendingMap.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		return;
+
+	std::shared_ptr<CMap> Map = m_PendingMap.get();
+
+	if (!Map)
+	{
+		Print("[AURA] unable to load [" + m_PendingMapPath + "], still hosting [" + m_HostedMapPath + "]");
+		return;
+	}
+
+	// a map players can't download isn't worth swapping to, some of them would be kicked from every new lobby
+
+	if (!Map->GetMapDataLoaded())
+	{
+		Print("[AURA] the map file of [" + m_PendingMapPath + "] can't be sent to players, still hosting [" + m_HostedMapPath + "]");
+		return;
+	}
+
+	// a new version has to be a new file, the games in progress are still sending the file the hosted map is mapped from
+	// if that's the same file it's either unchanged or it was rewritten under them, either way there's nothing to swap to
+
+	if (m_HostedMap && m_HostedMap->GetMapFile() && Map->GetMapFile()->IsSameFile(*m_HostedMap->GetMapFile()))
+	{
+		Print("[AURA] [" + m_PendingMapPath + "] is the file [" + m_HostedMapPath + "] is hosted from, install a new version by renaming it over the old file or under a new name");
+		return;
+	}
+
+	m_MapLibrary->Replace(m_PendingMapPath, Map);
+	m_HostedMap = Map;
+	m_HostedMapPath = m_PendingMapPath;
+	Print("[AURA] new lobbies are hosted with [" + m_HostedMapPath + "]");
+
+	// a lobby nobody joined yet is hosted again with the new map right away, the new lobby is announced before the old one is removed
+	// lobbies with players and games in progress keep the map they were hosted with until they end
+
+	if (!m_GameConfig)
+		return;
+
+	for (auto & game : m_Games)
+	{
+		if (game->GetLobbyOpen() && game->GetNumPlayers() == 0)
+		{
+			Print("[AURA] hosting the empty lobby [" + game->GetGameName() + "] again with the new map");
+			CGame *Old = game;
+			game = new CGame(m_HostedMap, m_GameConfig, m_UDPSocket, m_DownloadScheduler, m_HostCounter++);
+			delete Old;
+		}
+	}
+
+	m_MapLibrary->Trim();
 }
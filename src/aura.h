@@ -22,6 +22,9 @@ CODE PORTED FROM THE ORIGINAL GHOST PROJECT: http://ghost.pwner.org/
 #define AURA_AURA_H_
 
 #include <vector>
+#include <string>
+#include <memory>
+#include <future>
 #include <stdint.h>
 
 //
@@ -32,23 +35,49 @@ class CUDPSocket;
 class CTCPSocket;
 class CTCPServer;
 class CGPSProtocol;
+class CSpectatorFeed;
+class CGameProtocol;
 class CGame;
+class CGamePlayer;
 class CMap;
+class CMapLibrary;
+class CDownloadScheduler;
 class CConfig;
+struct CGameConfig;
 
 class CAura
 {
 public:
 	CUDPSocket *m_UDPSocket;                      // a UDP socket for sending broadcasts and other junk (used with !sendlan)
+	CUDPSocket *m_UDPServer;                      // listens on UDP 6112 and answers W3GS_SEARCHGAME with the cached W3GS_GAMEINFO of every open lobby
+	CGameProtocol *m_GameProtocol;
+	CGPSProtocol *m_GPSProtocol;
+	CTCPServer *m_ReconnectServer;                // listens for reconnecting GProxy++ players (nullptr if bot_reconnect is off)
+	std::vector<CTCPSocket *> m_ReconnectSockets; // connections to m_ReconnectServer that haven't sent GPS_RECONNECT yet
+	CTCPServer *m_SpectatorServer;                // listens for spectators (nullptr if bot_spectatorport is 0)
+	std::vector<CTCPSocket *> m_SpectatorSockets; // connections to m_SpectatorServer that haven't sent SPECTATOR_REQUEST yet
+	std::vector<CSpectatorFeed *> m_SpectatorFeeds; // feeds of deleted games that still have viewers watching the delayed end of the game
 	std::vector<CGame *> m_Games;                 // these games are in progress
-	CMap *m_Map;                                  // the currently loaded map
+	CMapLibrary *m_MapLibrary;                    // every loaded map, shared between the games hosting them
+	CGameConfig *m_GameConfig;                    // the settings of every lobby we host
+	CDownloadScheduler *m_DownloadScheduler;      // shares bot_maxdownloadspeed between every player downloading the map in every game
+	std::shared_ptr<CMap> m_HostedMap;            // the map new lobbies are hosted with
+	std::string m_HostedMapPath;
+	std::future<std::shared_ptr<CMap>> m_PendingMap; // the map the "map" command is loading in the background (not valid if there's none)
+	std::string m_PendingMapPath;
 	uint32_t m_HostCounter;                       // the current host counter (a unique number to identify a game, incremented each time a game is created)
+	uint32_t m_SendQueueWatermark;                // the most bytes we keep queued for all players of all games together before shedding the biggest queue (0 = unlimited)
 	bool m_Exiting;                               // set to true to force aura to shutdown next update (used by SignalCatcher)
 
 	explicit CAura(CConfig *CFG);
 	~CAura();
 	CAura(CAura &) = delete;
 	bool Update();
+	void UpdateReconnects(void *fd, void *send_fd);
+	void UpdateSpectators(void *fd);
+	void ShedSendQueues();
+	void UpdateConsole();
+	void UpdateMapSwap();
 };
 
 #endif  // AURA_AURA_H_
@@ -0,0 +1,288 @@
+/*
+
+Copyright [2010] [Josko Nikolic]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include "download.h"
+
+#include <algorithm>
+
+// the gains are in thousandths, startup uses 2/ln(2) which doubles the sending rate every round trip like TCP slow start
+
+static const uint32_t StartupGain = 2885;
+static const uint32_t DrainGain = 1000 * 1000 / 2885;
+static const uint32_t WindowGain = 2000;
+static const uint32_t ProbeGains[8] = { 1250, 750, 1000, 1000, 1000, 1000, 1000, 1000 };
+
+//
+// CDownloadPacer
+//
+
+CDownloadPacer::CDownloadPacer(uint32_t nTicks, uint32_t nInitialRTT)
+	: m_Mode(Mode::Startup),
+	m_StartTicks(nTicks),
+	m_Sent(0),
+	m_Acked(0),
+	m_NextSend((uint64_t)nTicks * 1000),
+	m_InitialRTT(nInitialRTT > 0 ? nInitialRTT : 100),
+	m_MinRTT(0),
+	m_WindowMinRTT(0),
+	m_RTTWindowTicks(nTicks),
+	m_Bandwidth(0),
+	m_Round(0),
+	m_RoundEnd(0),
+	m_FullBandwidth(0),
+	m_FullBandwidthRounds(0),
+	m_Cycle(0),
+	m_CycleTicks(nTicks)
+{
+	for (auto & bandwidth : m_RoundBandwidth)
+		bandwidth = 0;
+
+	m_Acks.push_back(std::make_pair(nTicks, 0));
+}
+
+CDownloadPacer::~CDownloadPacer()
+{
+
+}
+
+uint32_t CDownloadPacer::GetRTT() const
+{
+	return m_MinRTT > 0 ? m_MinRTT : m_InitialRTT;
+}
+
+uint32_t CDownloadPacer::GetBDP() const
+{
+	if (m_Bandwidth == 0)
+		return DOWNLOAD_INITIAL_WINDOW;
+
+	return (uint32_t)std::min<uint64_t>((uint64_t)m_Bandwidth * GetRTT() / 1000, DOWNLOAD_MAX_WINDOW);
+}
+
+uint32_t CDownloadPacer::GetPacingGain() const
+{
+	switch (m_Mode)
+	{
+	case Mode::Startup:
+		return StartupGain;
+	case Mode::Drain:
+		return DrainGain;
+	default:
+		return ProbeGains[m_Cycle];
+	}
+}
+
+uint32_t CDownloadPacer::GetWindow() const
+{
+	// until the first measurement the window is fixed, after that it's a multiple of the bandwidth delay product
+
+	if (m_Bandwidth == 0)
+		return DOWNLOAD_INITIAL_WINDOW;
+
+	const uint64_t Window = (uint64_t)GetBDP() * (m_Mode == Mode::Startup ? StartupGain : WindowGain) / 1000;
+	return (uint32_t)std::min<uint64_t>(std::max<uint64_t>(Window, DOWNLOAD_MIN_WINDOW), DOWNLOAD_MAX_WINDOW);
+}
+
+uint32_t CDownloadPacer::GetPacingRate() const
+{
+	// before the first measurement the initial window is spread over the initial round trip time
+
+	const uint64_t Bandwidth = m_Bandwidth > 0 ? m_Bandwidth : (uint64_t)DOWNLOAD_INITIAL_WINDOW * 1000 / GetRTT();
+	return (uint32_t)std::max<uint64_t>(Bandwidth * GetPacingGain() / 1000, 1442);
+}
+
+uint32_t CDownloadPacer::GetThroughput(uint32_t Ticks) const
+{
+	const uint32_t Elapsed = Ticks - m_StartTicks;
+
+	if (Elapsed == 0)
+		return 0;
+
+	return (uint32_t)((uint64_t)m_Acked * 1000 / Elapsed);
+}
+
+bool CDownloadPacer::CanSend(uint32_t Ticks) const
+{
+	if (m_Sent == m_Acked)
+		return true;
+
+	return GetInFlight() < GetWindow() && m_NextSend <= (uint64_t)Ticks * 1000;
+}
+
+uint32_t CDownloadPacer::GetWait(uint32_t Ticks) const
+{
+	if (m_Sent != m_Acked && GetInFlight() >= GetWindow())
+		return 0xFFFFFFFF;
+
+	const uint64_t Now = (uint64_t)Ticks * 1000;
+
+	if (m_NextSend <= Now)
+		return 0;
+
+	return (uint32_t)((m_NextSend - Now + 999) / 1000);
+}
+
+void CDownloadPacer::OnSend(uint32_t Ticks, uint32_t length)
+{
+	// the loop doesn't run every millisecond, a part that's a little late doesn't delay the next one
+	// but we never make up for more than 10 ms at once or an idle link would get one big burst
+
+	const uint64_t Now = (uint64_t)Ticks * 1000;
+	m_NextSend = std::max(m_NextSend, Now > 10000 ? Now - 10000 : 0) + (uint64_t)length * 1000000 / GetPacingRate();
+	m_Sent += length;
+	m_InFlight.push_back(std::make_pair(m_Sent, Ticks));
+}
+
+void CDownloadPacer::OnAck(uint32_t Ticks, uint32_t acked)
+{
+	acked = std::min(acked, m_Sent);
+
+	if (acked <= m_Acked)
+		return;
+
+	m_Acked = acked;
+
+	// round trip time: how long ago the newest part this ack covers was sent
+
+	uint32_t SentTicks = 0;
+	bool Sample = false;
+
+	while (!m_InFlight.empty() && m_InFlight.front().first <= acked)
+	{
+		SentTicks = m_InFlight.front().second;
+		Sample = true;
+		m_InFlight.pop_front();
+	}
+
+	if (Sample)
+	{
+		const uint32_t RTT = std::max<uint32_t>(Ticks - SentTicks, 1);
+
+		if (Ticks - m_RTTWindowTicks >= DOWNLOAD_RTT_WINDOW)
+		{
+			m_MinRTT = m_WindowMinRTT;
+			m_WindowMinRTT = 0;
+			m_RTTWindowTicks = Ticks;
+		}
+
+		if (m_WindowMinRTT == 0 || RTT < m_WindowMinRTT)
+			m_WindowMinRTT = RTT;
+
+		if (m_MinRTT == 0 || RTT < m_MinRTT)
+			m_MinRTT = RTT;
+	}
+
+	// a round trip ends when everything that was in flight when it started is acknowledged
+
+	const bool NewRound = acked >= m_RoundEnd;
+
+	if (NewRound)
+	{
+		++m_Round;
+		m_RoundEnd = m_Sent;
+		m_RoundBandwidth[m_Round % DOWNLOAD_BANDWIDTH_ROUNDS] = 0;
+	}
+
+	// delivery rate: the bytes acknowledged since the latest ack at least one round trip (or 10 ms) ago
+	// measuring over a shorter interval would be mostly noise with millisecond ticks
+
+	m_Acks.push_back(std::make_pair(Ticks, acked));
+	const uint32_t Interval = std::max<uint32_t>(GetRTT(), 10);
+
+	while (m_Acks.size() >= 2 && Ticks - m_Acks[1].first >= Interval)
+		m_Acks.pop_front();
+
+	if (Ticks - m_Acks.front().first >= Interval)
+		UpdateBandwidth((uint32_t)std::min<uint64_t>((uint64_t)(acked - m_Acks.front().second) * 1000 / (Ticks - m_Acks.front().first), 0xFFFFFFFF));
+
+	UpdateMode(Ticks, NewRound);
+}
+
+void CDownloadPacer::UpdateBandwidth(uint32_t rate)
+{
+	uint32_t &Round = m_RoundBandwidth[m_Round % DOWNLOAD_BANDWIDTH_ROUNDS];
+	Round = std::max(Round, rate);
+	m_Bandwidth = 0;
+
+	for (auto & bandwidth : m_RoundBandwidth)
+		m_Bandwidth = std::max(m_Bandwidth, bandwidth);
+}
+
+void CDownloadPacer::UpdateMode(uint32_t Ticks, bool NewRound)
+{
+	switch (m_Mode)
+	{
+	case Mode::Startup:
+		// the link is full once three round trips in a row didn't raise the bandwidth by a quarter
+
+		if (NewRound && m_Bandwidth > 0)
+		{
+			if ((uint64_t)m_Bandwidth * 4 >= (uint64_t)m_FullBandwidth * 5)
+			{
+				m_FullBandwidth = m_Bandwidth;
+				m_FullBandwidthRounds = 0;
+			}
+			else if (++m_FullBandwidthRounds >= 3)
+				m_Mode = Mode::Drain;
+		}
+
+		break;
+
+	case Mode::Drain:
+		// startup left up to a round trip worth of parts queued somewhere, wait until it's gone
+
+		if (GetInFlight() <= GetBDP())
+		{
+			m_Mode = Mode::ProbeBandwidth;
+
+			// start somewhere in the cycle (but not draining) so players who started together don't probe together
+
+			m_Cycle = m_StartTicks % 7;
+
+			if (m_Cycle >= 1)
+				++m_Cycle;
+
+			m_CycleTicks = Ticks;
+		}
+
+		break;
+
+	case Mode::ProbeBandwidth:
+		// every phase lasts a round trip, the draining phase ends early once the queue from probing is gone
+
+		if (Ticks - m_CycleTicks >= std::max<uint32_t>(GetRTT(), 10) || (ProbeGains[m_Cycle] < 1000 && GetInFlight() <= GetBDP()))
+		{
+			m_Cycle = (m_Cycle + 1) % 8;
+			m_CycleTicks = Ticks;
+		}
+
+		break;
+	}
+}
+
+std::string CDownloadPacer::GetModeName() const
+{
+	switch (m_Mode)
+	{
+	case Mode::Startup:
+		return "startup";
+	case Mode::Drain:
+		return "drain";
+	default:
+		return "probe bandwidth";
+	}
+}
@@ -0,0 +1,119 @@
+/*
+
+Copyright [2010] [Josko Nikolic]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#ifndef AURA_DOWNLOAD_H_
+#define AURA_DOWNLOAD_H_
+
+#include <deque>
+#include <string>
+#include <utility>
+#include <stdint.h>
+
+//
+// CDownloadPacer
+//
+
+// decides when the next map part can be sent to a player downloading the map, modelled on TCP BBR
+// the client acknowledges every part with W3GS_MAPSIZE, from those acks we measure the delivery rate (the bottleneck bandwidth)
+// and the round trip time, the parts in flight are kept at a small multiple of bandwidth * round trip time
+// and the parts are spread out at about the bandwidth instead of being sent in bursts
+// this way a fast link gets up to speed within a few round trips and a slow link never has more than a few round trips of map queued
+// so lobby updates (slots, chat, players joining) still reach the player on time
+//
+// the pacer starts in startup, sending at almost three times the measured rate to find the bandwidth quickly
+// once the rate stops growing it drains the queue it built up and then settles on the measured rate,
+// probing for more bandwidth every eight round trips
+
+#define DOWNLOAD_INITIAL_WINDOW    (1442 * 10) // bytes in flight before the first measurement, like TCP's initial window of 10 segments
+#define DOWNLOAD_MIN_WINDOW        (1442 * 4)  // the window never gets smaller than this
+#define DOWNLOAD_MAX_WINDOW        (1442 * 1024)
+#define DOWNLOAD_RTT_WINDOW        10000       // the minimum round trip time is the lowest seen in this many milliseconds
+#define DOWNLOAD_BANDWIDTH_ROUNDS  10          // the bandwidth is the highest delivery rate seen in this many round trips
+
+class CDownloadPacer
+{
+private:
+	enum class Mode
+	{
+		Startup,
+		Drain,
+		ProbeBandwidth
+	};
+
+	Mode m_Mode;
+	uint32_t m_StartTicks;                    // GetTicks when the download started
+	uint32_t m_Sent;                          // the bytes sent so far
+	uint32_t m_Acked;                         // the bytes the player acknowledged so far
+	uint64_t m_NextSend;                      // the time in microseconds (GetTicks * 1000) the next part may be sent at
+	uint32_t m_InitialRTT;                    // the round trip time to assume before the first ack (the player's ping if we have one)
+	uint32_t m_MinRTT;                        // the lowest round trip time of the current and the previous DOWNLOAD_RTT_WINDOW
+	uint32_t m_WindowMinRTT;                  // the lowest round trip time of the current DOWNLOAD_RTT_WINDOW
+	uint32_t m_RTTWindowTicks;                // GetTicks when the current DOWNLOAD_RTT_WINDOW started
+	uint32_t m_Bandwidth;                     // the bottleneck bandwidth in bytes per second (0 until the first measurement)
+	uint32_t m_RoundBandwidth[DOWNLOAD_BANDWIDTH_ROUNDS]; // the highest delivery rate of each of the last round trips
+	uint32_t m_Round;                         // the number of round trips so far
+	uint32_t m_RoundEnd;                      // the round trip ends when this many bytes are acknowledged
+	uint32_t m_FullBandwidth;                 // the bandwidth the last time it grew by at least a quarter
+	uint32_t m_FullBandwidthRounds;           // the number of round trips since then
+	uint32_t m_Cycle;                         // the phase of the probing cycle
+	uint32_t m_CycleTicks;                    // GetTicks when the phase started
+	std::deque<std::pair<uint32_t, uint32_t>> m_InFlight; // (end offset, GetTicks when it was sent) of every part not acknowledged yet
+	std::deque<std::pair<uint32_t, uint32_t>> m_Acks; // (GetTicks, bytes acknowledged) of the recent acks, for measuring the delivery rate
+
+public:
+	CDownloadPacer(uint32_t nTicks, uint32_t nInitialRTT);
+	~CDownloadPacer();
+
+	inline uint32_t GetSent() const                     { return m_Sent; }
+	inline uint32_t GetAcked() const                    { return m_Acked; }
+	inline uint32_t GetInFlight() const                 { return m_Sent - m_Acked; }
+	inline uint32_t GetBandwidth() const                { return m_Bandwidth; }
+	inline uint32_t GetMinRTT() const                   { return m_MinRTT; }
+	inline uint32_t GetStartTicks() const               { return m_StartTicks; }
+
+	// the most bytes that may be in flight and the rate the parts are sent at in bytes per second
+
+	uint32_t GetWindow() const;
+	uint32_t GetPacingRate() const;
+
+	// the average rate the player actually received the map at so far in bytes per second
+
+	uint32_t GetThroughput(uint32_t Ticks) const;
+
+	// returns true if a part can be sent now, a part is always allowed when nothing is in flight
+
+	bool CanSend(uint32_t Ticks) const;
+
+	// the milliseconds until CanSend could become true without an ack arriving, 0xFFFFFFFF if it has to wait for an ack
+
+	uint32_t GetWait(uint32_t Ticks) const;
+
+	void OnSend(uint32_t Ticks, uint32_t length);
+	void OnAck(uint32_t Ticks, uint32_t acked);
+
+	std::string GetModeName() const;
+
+private:
+	uint32_t GetPacingGain() const;
+	uint32_t GetRTT() const;
+	uint32_t GetBDP() const;
+	void UpdateBandwidth(uint32_t rate);
+	void UpdateMode(uint32_t Ticks, bool NewRound);
+};
+
+#endif  // AURA_DOWNLOAD_H_
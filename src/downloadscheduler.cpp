@@ -0,0 +1,255 @@
+/*
+
+Copyright [2010] [Josko Nikolic]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include "downloadscheduler.h"
+#include "download.h"
+#include "game.h"
+#include "gameplayer.h"
+
+#include <algorithm>
+
+void Print(const std::string &message);
+
+//
+// CDownloadScheduler
+//
+
+CDownloadScheduler::CDownloadScheduler(uint32_t nRate, uint32_t nMaxDownloaders)
+	: m_Next(0),
+	m_InTurn(false),
+	m_Rate(nRate),
+	m_MaxDownloaders(nMaxDownloaders),
+	m_Budget(0),
+	m_BudgetTicks(0),
+	m_Yielding(false),
+	m_YieldTicks(0),
+	m_TotalBytes(0)
+{
+	m_Budget = GetBurst();
+}
+
+CDownloadScheduler::~CDownloadScheduler()
+{
+
+}
+
+uint64_t CDownloadScheduler::GetBurst() const
+{
+	// up to 50 ms worth of map data can go out at once, the loop runs at least that often
+
+	return (uint64_t)std::max<uint32_t>(m_Rate / 20, DOWNLOAD_QUANTUM) * 1000;
+}
+
+uint32_t CDownloadScheduler::GetYieldWait(uint32_t Ticks) const
+{
+	// the milliseconds until map data may be sent again while game data is waiting, 0 if it may be sent now
+
+	if (!m_Yielding)
+		return 0;
+
+	const uint32_t Elapsed = Ticks - m_YieldTicks;
+
+	if (Elapsed < DOWNLOAD_MAX_YIELD)
+		return DOWNLOAD_MAX_YIELD - Elapsed;
+
+	const uint32_t Phase = (Elapsed - DOWNLOAD_MAX_YIELD) % DOWNLOAD_YIELD_PERIOD;
+
+	if (Phase < DOWNLOAD_YIELD_PERIOD / 4)
+		return 0;
+
+	return DOWNLOAD_YIELD_PERIOD - Phase;
+}
+
+void CDownloadScheduler::Refill(uint32_t Ticks)
+{
+	if (m_Rate == 0)
+		return;
+
+	m_Budget = std::min<uint64_t>(m_Budget + (uint64_t)(Ticks - m_BudgetTicks) * m_Rate, GetBurst());
+	m_BudgetTicks = Ticks;
+}
+
+void CDownloadScheduler::Admit(const CDownloader &downloader, uint32_t Ticks)
+{
+	CGamePlayer *Player = downloader.Player;
+	Player->SetDownloadPacer(new CDownloadPacer(Ticks, Player->GetNumPings() > 0 ? Player->GetMinPing() : 0));
+	m_Active.push_back(CDownloader{ downloader.Game, Player, 0 });
+}
+
+void CDownloadScheduler::Add(CGame *game, CGamePlayer *player, uint32_t Ticks)
+{
+	if (m_MaxDownloaders == 0 || m_Active.size() < m_MaxDownloaders)
+	{
+		Admit(CDownloader{ game, player, 0 }, Ticks);
+		return;
+	}
+
+	m_Waiting.push_back(CDownloader{ game, player, 0 });
+	Print("[GAME: " + game->GetGameName() + "] player [" + player->GetName() + "] is waiting to download the map, " + std::to_string(m_Active.size()) + " players are downloading it");
+}
+
+void CDownloadScheduler::Remove(CGamePlayer *player, uint32_t Ticks)
+{
+	for (uint32_t i = 0; i < m_Active.size(); ++i)
+	{
+		if (m_Active[i].Player != player)
+			continue;
+
+		// keep m_Next pointing at the same downloader, a downloader removed during its turn simply ends it
+
+		if (i < m_Next)
+			--m_Next;
+		else if (i == m_Next)
+			m_InTurn = false;
+
+		m_Active.erase(begin(m_Active) + i);
+
+		if (m_Next >= m_Active.size())
+			m_Next = 0;
+
+		player->SetDownloadPacer(nullptr);
+		break;
+	}
+
+	for (auto i = begin(m_Waiting); i != end(m_Waiting); ++i)
+	{
+		if (i->Player == player)
+		{
+			m_Waiting.erase(i);
+			break;
+		}
+	}
+
+	while (!m_Waiting.empty() && (m_MaxDownloaders == 0 || m_Active.size() < m_MaxDownloaders))
+	{
+		const CDownloader Next = m_Waiting.front();
+		m_Waiting.pop_front();
+		Print("[GAME: " + Next.Game->GetGameName() + "] player [" + Next.Player->GetName() + "] can download the map now");
+		Admit(Next, Ticks);
+	}
+}
+
+void CDownloadScheduler::RemoveGame(CGame *game, uint32_t Ticks)
+{
+	// the game's waiting players go first so none of them is admitted when its downloaders are removed
+
+	for (auto i = begin(m_Waiting); i != end(m_Waiting);)
+	{
+		if (i->Game == game)
+			i = m_Waiting.erase(i);
+		else
+			++i;
+	}
+
+	std::vector<CGamePlayer *> Players;
+
+	for (auto & downloader : m_Active)
+	{
+		if (downloader.Game == game)
+			Players.push_back(downloader.Player);
+	}
+
+	for (auto & player : Players)
+		Remove(player, Ticks);
+}
+
+void CDownloadScheduler::Update(uint32_t Ticks, void *send_fd, bool gameDataQueued)
+{
+	Refill(Ticks);
+
+	if (gameDataQueued && !m_Yielding)
+		m_YieldTicks = Ticks;
+
+	m_Yielding = gameDataQueued;
+
+	if (m_Active.empty() || GetYieldWait(Ticks) > 0)
+		return;
+
+	// every round each downloader's deficit grows by a quantum and they send parts as long as the next one fits in it
+	// a downloader with nothing to send (their pacer is waiting for acks) loses what's left, like an empty queue in deficit round robin
+	// rounds continue until nobody sends anything or the budget runs out, then the next update starts where this one stopped
+
+	uint64_t Budget = m_Rate == 0 ? 0xFFFFFFFFFFFFFFFFULL : m_Budget / 1000;
+	bool Progress = true;
+
+	while (Progress && Budget >= DOWNLOAD_QUANTUM)
+	{
+		Progress = false;
+
+		for (uint32_t n = 0; n < m_Active.size(); ++n)
+		{
+			CDownloader &Downloader = m_Active[m_Next];
+
+			if (!m_InTurn)
+				Downloader.Deficit += DOWNLOAD_QUANTUM;
+
+			const uint32_t Allowance = (uint32_t)std::min<uint64_t>(Downloader.Deficit, Budget);
+			const uint32_t Sent = Downloader.Game->SendMapParts(Downloader.Player, Ticks, Allowance, send_fd);
+			Downloader.Deficit -= Sent;
+			Budget -= Sent;
+			m_TotalBytes += Sent;
+
+			if (m_Rate != 0)
+				m_Budget -= (uint64_t)Sent * 1000;
+
+			if (Sent > 0)
+				Progress = true;
+
+			if (Allowance < Downloader.Deficit + Sent && Budget < DOWNLOAD_QUANTUM)
+			{
+				m_InTurn = true;
+				return;
+			}
+
+			m_InTurn = false;
+
+			if (Downloader.Deficit >= DOWNLOAD_QUANTUM)
+				Downloader.Deficit = 0;
+
+			m_Next = (m_Next + 1) % m_Active.size();
+		}
+	}
+}
+
+uint32_t CDownloadScheduler::GetWait(uint32_t Ticks) const
+{
+	if (m_Active.empty())
+		return 0xFFFFFFFF;
+
+	uint32_t Wait = 0xFFFFFFFF;
+
+	for (auto & downloader : m_Active)
+		Wait = std::min(Wait, downloader.Game->GetMapPartWait(downloader.Player, Ticks));
+
+	// while game data is waiting a part is due only once the map gets its share again
+
+	if (Wait != 0xFFFFFFFF)
+		Wait = std::max(Wait, GetYieldWait(Ticks));
+
+	if (Wait == 0xFFFFFFFF || m_Rate == 0)
+		return Wait;
+
+	// a part is also due only once the budget has room for it again
+
+	const uint64_t Budget = std::min<uint64_t>(m_Budget + (uint64_t)(Ticks - m_BudgetTicks) * m_Rate, GetBurst());
+
+	if (Budget >= (uint64_t)DOWNLOAD_QUANTUM * 1000)
+		return Wait;
+
+	return std::max<uint32_t>(Wait, (uint32_t)(((uint64_t)DOWNLOAD_QUANTUM * 1000 - Budget + m_Rate - 1) / m_Rate));
+}
@@ -0,0 +1,100 @@
+/*
+
+Copyright [2010] [Josko Nikolic]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#ifndef AURA_DOWNLOADSCHEDULER_H_
+#define AURA_DOWNLOADSCHEDULER_H_
+
+#include <deque>
+#include <vector>
+#include <stdint.h>
+
+class CGame;
+class CGamePlayer;
+
+//
+// CDownloadScheduler
+//
+
+// shares the upload between every player downloading the map in every game, there's one for the whole process
+// each loop iteration the map parts the pacers allow are sent in deficit round robin order, every downloader gets DOWNLOAD_QUANTUM bytes
+// per round so a player in a busy lobby gets the same share as one who is the only downloader in theirs
+// the total is limited to bot_maxdownloadspeed and at most bot_maxdownloaders players download at once, the rest wait their turn
+// map data has lower priority than game data, nothing is sent while a game in progress has data waiting in a send queue
+// but only for DOWNLOAD_MAX_YIELD, a player whose connection never keeps up would otherwise stop every download for the whole game
+// after that the map is sent during the first quarter of every DOWNLOAD_YIELD_PERIOD for as long as game data keeps waiting
+
+#define DOWNLOAD_QUANTUM           (1442 + 18) // one full W3GS_MAPPART
+#define DOWNLOAD_MAX_YIELD         200         // milliseconds
+#define DOWNLOAD_YIELD_PERIOD      200         // milliseconds
+
+class CDownloadScheduler
+{
+private:
+	struct CDownloader
+	{
+		CGame *Game;
+		CGamePlayer *Player;
+		uint32_t Deficit;                         // the bytes the downloader may still send this round
+	};
+
+	std::vector<CDownloader> m_Active;            // the players downloading the map
+	std::deque<CDownloader> m_Waiting;            // the players waiting for one of the bot_maxdownloaders slots, first come first served
+	uint32_t m_Next;                              // the index in m_Active of the downloader whose turn it is
+	bool m_InTurn;                                // if the budget ran out during m_Next's turn, it continues without a new quantum
+	uint32_t m_Rate;                              // config value: the most bytes of map data sent per second (0 = unlimited)
+	uint32_t m_MaxDownloaders;                    // config value: the most players downloading at once (0 = unlimited)
+	uint64_t m_Budget;                            // the bytes that may be sent right now, in thousandths, refilled at m_Rate
+	uint32_t m_BudgetTicks;                       // GetTicks when m_Budget was last refilled
+	bool m_Yielding;                              // if game data was waiting at the last update
+	uint32_t m_YieldTicks;                        // GetTicks when game data started waiting
+	uint64_t m_TotalBytes;                        // the bytes of map data sent so far
+
+public:
+	CDownloadScheduler(uint32_t nRate, uint32_t nMaxDownloaders);
+	~CDownloadScheduler();
+	CDownloadScheduler(CDownloadScheduler &) = delete;
+
+	inline uint32_t GetNumDownloaders() const           { return m_Active.size(); }
+	inline uint32_t GetNumWaiting() const               { return m_Waiting.size(); }
+	inline uint64_t GetTotalBytes() const               { return m_TotalBytes; }
+
+	// a player started downloading the map, they get a pacer as soon as there's a free slot
+
+	void Add(CGame *game, CGamePlayer *player, uint32_t Ticks);
+
+	// a player finished or stopped downloading the map (or is about to be deleted), every player of a game that's going away
+
+	void Remove(CGamePlayer *player, uint32_t Ticks);
+	void RemoveGame(CGame *game, uint32_t Ticks);
+
+	// sends the map parts that are due, gameDataQueued is true if a game in progress has data waiting to be sent
+
+	void Update(uint32_t Ticks, void *send_fd, bool gameDataQueued);
+
+	// the milliseconds until the next map part is due, 0xFFFFFFFF if nothing is due before an ack arrives
+
+	uint32_t GetWait(uint32_t Ticks) const;
+
+private:
+	void Admit(const CDownloader &downloader, uint32_t Ticks);
+	void Refill(uint32_t Ticks);
+	uint64_t GetBurst() const;
+	uint32_t GetYieldWait(uint32_t Ticks) const;
+};
+
+#endif  // AURA_DOWNLOADSCHEDULER_H_
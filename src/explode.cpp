@@ -0,0 +1,234 @@
+/*
+
+Copyright [2010] [Josko Nikolic]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+CODE PORTED FROM THE ORIGINAL GHOST PROJECT: http://ghost.pwner.org/
+
+*/
+
+#include "explode.h"
+
+#define EXPLODE_MAXBITS 13
+
+namespace
+{
+	// the fixed huffman codes of the format, in blast.c's compact form
+	// every byte is (number of symbols - 1) << 4 | code length, for consecutive symbols
+
+	const uint8_t LiteralLengths[] = {
+		11, 124, 8, 7, 28, 7, 188, 13, 76, 4, 10, 8, 12, 10, 12, 10, 8, 23, 8,
+		9, 7, 6, 7, 8, 7, 6, 55, 8, 23, 24, 12, 11, 7, 9, 11, 12, 6, 7, 22, 5,
+		7, 24, 6, 11, 9, 6, 7, 22, 7, 11, 38, 7, 9, 8, 25, 11, 8, 11, 9, 12,
+		8, 12, 5, 38, 5, 38, 5, 11, 7, 5, 6, 21, 6, 10, 53, 8, 7, 24, 10, 27,
+		44, 253, 253, 253, 252, 252, 252, 13, 12, 45, 12, 45, 12, 61, 12, 45,
+		44, 173
+	};
+
+	const uint8_t LengthLengths[] = { 2, 35, 36, 53, 38, 23 };
+	const uint8_t DistanceLengths[] = { 2, 20, 53, 230, 247, 151, 248 };
+
+	const uint16_t LengthBase[16] = { 3, 2, 4, 5, 6, 7, 8, 9, 10, 12, 16, 24, 40, 72, 136, 264 };
+	const uint8_t LengthExtra[16] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8 };
+
+	// canonical huffman code, the number of codes of each length and the symbols ordered by code
+
+	struct CHuffman
+	{
+		uint16_t Count[EXPLODE_MAXBITS + 1];
+		uint16_t Symbol[256];
+
+		CHuffman(const uint8_t *rep, uint32_t n)
+		{
+			uint8_t Length[256];
+			uint32_t NumSymbols = 0;
+
+			for (uint32_t i = 0; i < n; ++i)
+			{
+				for (uint32_t j = 0; j <= (uint32_t)(rep[i] >> 4); ++j)
+					Length[NumSymbols++] = rep[i] & 15;
+			}
+
+			for (uint32_t len = 0; len <= EXPLODE_MAXBITS; ++len)
+				Count[len] = 0;
+
+			for (uint32_t i = 0; i < NumSymbols; ++i)
+				++Count[Length[i]];
+
+			uint16_t Offsets[EXPLODE_MAXBITS + 1];
+			Offsets[1] = 0;
+
+			for (uint32_t len = 1; len < EXPLODE_MAXBITS; ++len)
+				Offsets[len + 1] = Offsets[len] + Count[len];
+
+			for (uint32_t i = 0; i < NumSymbols; ++i)
+			{
+				if (Length[i] != 0)
+					Symbol[Offsets[Length[i]]++] = i;
+			}
+		}
+	};
+
+	// the tables are only built once, function local statics are safe with several threads decompressing
+
+	struct CTables
+	{
+		CHuffman Literal;
+		CHuffman Length;
+		CHuffman Distance;
+
+		CTables()
+			: Literal(LiteralLengths, sizeof(LiteralLengths)),
+			Length(LengthLengths, sizeof(LengthLengths)),
+			Distance(DistanceLengths, sizeof(DistanceLengths))
+		{ }
+	};
+
+	const CTables &GetTables()
+	{
+		static const CTables Tables;
+		return Tables;
+	}
+
+	// bits are read starting with the least significant bit of each byte
+
+	class CBitReader
+	{
+	private:
+		const uint8_t *m_In;
+		const uint8_t *m_End;
+		uint32_t m_Buffer;
+		uint32_t m_Count;
+
+	public:
+		CBitReader(const uint8_t *nIn, uint32_t nLength)
+			: m_In(nIn),
+			m_End(nIn + nLength),
+			m_Buffer(0),
+			m_Count(0)
+		{ }
+
+		bool Bits(uint32_t need, uint32_t &value)
+		{
+			while (m_Count < need)
+			{
+				if (m_In == m_End)
+					return false;
+
+				m_Buffer |= (uint32_t)*m_In++ << m_Count;
+				m_Count += 8;
+			}
+
+			value = m_Buffer & ((1 << need) - 1);
+			m_Buffer >>= need;
+			m_Count -= need;
+			return true;
+		}
+
+		// the codes are stored bit reversed and inverted compared to the usual canonical huffman codes
+
+		bool Decode(const CHuffman &h, uint32_t &symbol)
+		{
+			int32_t Code = 0;
+			int32_t First = 0;
+			int32_t Index = 0;
+
+			for (uint32_t len = 1; len <= EXPLODE_MAXBITS; ++len)
+			{
+				uint32_t Bit;
+
+				if (!Bits(1, Bit))
+					return false;
+
+				Code |= Bit ^ 1;
+				const int32_t Count = h.Count[len];
+
+				if (Code < First + Count)
+				{
+					symbol = h.Symbol[Index + (Code - First)];
+					return true;
+				}
+
+				Index += Count;
+				First += Count;
+				First <<= 1;
+				Code <<= 1;
+			}
+
+			return false;
+		}
+	};
+}
+
+bool Explode(const uint8_t *in, uint32_t inLength, uint8_t *out, uint32_t outLength)
+{
+	const CTables &Tables = GetTables();
+	CBitReader Reader(in, inLength);
+	uint32_t Literals, Dictionary;
+
+	// the header says whether literals are huffman coded and how many low bits of a distance are stored directly
+
+	if (!Reader.Bits(8, Literals) || !Reader.Bits(8, Dictionary) || Literals > 1 || Dictionary < 4 || Dictionary > 6)
+		return false;
+
+	uint32_t Written = 0;
+
+	while (true)
+	{
+		uint32_t Flag, Symbol;
+
+		if (!Reader.Bits(1, Flag))
+			return false;
+
+		if (Flag)
+		{
+			uint32_t Extra, Low;
+
+			if (!Reader.Decode(Tables.Length, Symbol) || !Reader.Bits(LengthExtra[Symbol], Extra))
+				return false;
+
+			const uint32_t Length = LengthBase[Symbol] + Extra;
+
+			if (Length == 519)
+				break;
+
+			const uint32_t Shift = Length == 2 ? 2 : Dictionary;
+
+			if (!Reader.Decode(Tables.Distance, Symbol) || !Reader.Bits(Shift, Low))
+				return false;
+
+			const uint32_t Distance = (Symbol << Shift) + Low + 1;
+
+			if (Distance > Written || Length > outLength - Written)
+				return false;
+
+			// the copy may overlap the bytes it's writing, so it has to go byte by byte
+
+			for (uint32_t i = 0; i < Length; ++i, ++Written)
+				out[Written] = out[Written - Distance];
+		}
+		else
+		{
+			if (Literals ? !Reader.Decode(Tables.Literal, Symbol) : !Reader.Bits(8, Symbol))
+				return false;
+
+			if (Written == outLength)
+				return false;
+
+			out[Written++] = (uint8_t)Symbol;
+		}
+	}
+
+	return Written == outLength;
+}
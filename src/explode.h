@@ -0,0 +1,33 @@
+/*
+
+Copyright [2010] [Josko Nikolic]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+CODE PORTED FROM THE ORIGINAL GHOST PROJECT: http://ghost.pwner.org/
+
+*/
+
+#ifndef AURA_EXPLODE_H_
+#define AURA_EXPLODE_H_
+
+#include <stdint.h>
+
+// decompresses PKWARE Data Compression Library ("implode") data, the way Mark Adler's blast.c does
+// old maps and the MPQ_FILE_IMPLODE / MPQ_COMPRESSION_PKWARE sectors use it
+// a sector always decompresses to a known size so the output is one flat buffer and the dictionary is whatever was written before
+// returns false if the data is invalid or doesn't decompress to exactly outLength bytes
+
+bool Explode(const uint8_t *in, uint32_t inLength, uint8_t *out, uint32_t outLength);
+
+#endif  // AURA_EXPLODE_H_
@@ -24,9 +24,17 @@ CODE PORTED FROM THE ORIGINAL GHOST PROJECT: http://ghost.pwner.org/
 #include "map.h"
 #include "gameplayer.h"
 #include "gameprotocol.h"
+#include "util.h"
+#include "gpsprotocol.h"
+#include "latency.h"
+#include "download.h"
+#include "downloadscheduler.h"
+#include "spectator.h"
 
 #include <ctime>
 #include <cmath>
+#include <cstring>
+#include <algorithm>
 
 uint32_t GetTicks();
 void Print(const std::string &message);
@@ -35,49 +43,136 @@ void Print(const std::string &message);
 // CGame
 //
 
-CGame::CGame(const CMap* Map, const CGameConfig* Config, CUDPSocket* UDPSocket, uint32_t HostCounter)
+CGame::CGame(std::shared_ptr<const CMap> Map, const CGameConfig* Config, CUDPSocket* UDPSocket, CDownloadScheduler* DownloadScheduler, uint32_t HostCounter)
 	: m_UDPSocket(UDPSocket),
+	m_DownloadScheduler(DownloadScheduler),
 	m_Socket(new CTCPServer()),
 	m_Protocol(new CGameProtocol()),
+	m_GPSProtocol(new CGPSProtocol()),
 	m_Slots(Map->GetSlots()),
 	m_Map(Map),
 	m_Config(Config),
+	m_LatencyController(nullptr),
+	m_SpectatorFeed(nullptr),
 	m_RandomSeed(GetTicks()),
 	m_HostCounter(HostCounter),
 	m_EntryKey(rand()),
+	m_Latency(Config->Latency),
 	m_SyncLimit(50),
 	m_SyncCounter(0),
-	m_PingTimer(),
-	m_DownloadTimer(),
-	m_SyncSlotInfoTimer(),
-	m_CountDownTimer(),
 	m_CountDownCounter(0),
-	m_LagScreenResetTimer(),
-	m_ActionSentTimer(),
 	m_StartedLaggingTicks(0),
 	m_LastLagScreenTicks(0),
+	m_StartedLoadingTicks(0),
+	m_LoadingWaitTicks(0),
 	m_EmptyWaitingTicks(0),
+	m_LANPlayers(1),
+	m_GameDataBase(0),
+	m_GameDataBytes(0),
+	m_GameDataPeakBytes(0),
+	m_DroppedHandshakes(0),
+	m_DroppedFull(0),
+	m_DroppedRate(0),
+	m_ActionKicks(0),
+	m_ActionSentTimer(),
+	m_PingTimer(),
+	m_BroadcastTimer(),
+	m_SyncSlotInfoTimer(),
+	m_CountDownTimer(),
+	m_LagScreenResetTimer(),
+	m_LatencyTimer(),
+	m_NetStatsTimer(),
 	m_HostPort(0),
 	m_VirtualHostPID(255),
 	m_Exiting(false),
 	m_SlotInfoChanged(false),
+	m_SlotInfoDirty(true),
+	m_SlotIndexDirty(true),
+	m_SlotInfoQueued(false),
 	m_Lagging(false),
 	m_Desynced(false),
+	m_OpenSlots(0),
+	m_UsedColours(0),
+	m_UsedPIDs(0),
+	m_CheckSumFrame(0),
+	m_DesyncFrame(0),
+	m_DesyncCheckSum(0),
+	m_DesyncPIDs(0),
 	m_State(State::Waiting)
 {
+	memset(m_CheckSumMasks, 0, sizeof(m_CheckSumMasks));
+	memset(m_PlayerFromPID, 0, sizeof(m_PlayerFromPID));
+	memset(m_SIDFromPID, 255, sizeof(m_SIDFromPID));
+
+	if (m_Config->DynamicLatency)
+	{
+		// a player more than CHECKSUM_RING_FRAMES behind would overwrite checksums that haven't been compared yet
+
+		m_LatencyController = new CLatencyController(m_Config->Latency, m_Config->MinLatency, m_Config->MaxLatency, CHECKSUM_RING_FRAMES - 1);
+		m_Latency = m_LatencyController->GetLatency();
+		m_SyncLimit = m_LatencyController->GetSyncLimit();
+		Print("[GAME: " + GetGameName() + "] using dynamic latency between " + std::to_string(m_Config->MinLatency) + " and " + std::to_string(m_Config->MaxLatency) + " ms, starting at " + std::to_string(m_Latency) + " ms");
+	}
+
+	if (m_Config->SpectatorPort != 0)
+		m_SpectatorFeed = new CSpectatorFeed(m_Config->SpectatorDelay, m_Config->SpectatorHistory, m_Config->SpectatorMaxViewers);
+
 	if (m_Socket->Listen(std::string(), m_HostPort))
 		Print("[GAME: " + GetGameName() + "] listening on port " + std::to_string(m_HostPort));
 	else
 	{
 		Print("[GAME: " + GetGameName() + "] error listening on port " + std::to_string(m_HostPort));
 		m_Exiting = true;
+		return;
 	}
+
+	// construct a fixed host counter which will be used to identify players from this "realm" (i.e. LAN)
+	// the fixed host counter's 4 most significant bits will contain a 4 bit ID (0-15)
+	// the rest of the fixed host counter will contain the 28 least significant bits of the actual host counter
+	// since we're destroying 4 bits of information here the actual host counter should not be greater than 2^28 which is a reasonable assumption
+	// when a player joins a game we can obtain the ID from the received host counter
+	// note: LAN broadcasts use an ID of 0, battle.net refreshes use an ID of 1-10, the rest are unused
+
+	// we send 12 for SlotsTotal because this determines how many PID's Warcraft 3 allocates
+	// we need to make sure Warcraft 3 allocates at least SlotsTotal + 1 but at most 12 PID's
+	// this is because we need an extra PID for the virtual host player (but we always delete the virtual host player when the 12th person joins)
+	// however, we can't send 13 for SlotsTotal because this causes Warcraft 3 to crash when sharing control of units
+	// nor can we send SlotsTotal because then Warcraft 3 crashes when playing maps with less than 12 PID's (because of the virtual host player taking an extra PID)
+	// we also send 12 for SlotsOpen because Warcraft 3 assumes there's always at least one player in the game (the host)
+	// so if we try to send accurate numbers it'll always be off by one and results in Warcraft 3 assuming the game is full when it still needs one more player
+	// the easiest solution is to simply send 12 for both so the game will always show up as (1/12) players
+
+	// note: the PrivateGame flag is not set when broadcasting to LAN (as you might expect)
+	// note: we do not use m_Map->GetMapGameType because none of the filters are set when broadcasting to LAN (also as you might expect)
+
+	// nothing in the W3GS_GAMEINFO packet changes while the lobby is open so it's built once and reused for every broadcast and W3GS_SEARCHGAME reply
+
+	m_GameInfo = m_Protocol->SEND_W3GS_GAMEINFO(m_Config->War3Version, 1, m_Map->GetMapGameFlags(), m_Map->GetMapWidth(), m_Map->GetMapHeight(), GetGameName(), "Clan 007", 0, m_Map->GetMapPath(), m_Map->GetMapCRC(), 12, 12, m_HostPort, GetLANHostCounter(), m_EntryKey);
+
+	// announce the new lobby to the local network
+
+	m_UDPSocket->Broadcast(6112, m_Protocol->SEND_W3GS_CREATEGAME(m_Config->War3Version, GetLANHostCounter()));
+	m_UDPSocket->Broadcast(6112, m_GameInfo);
+	m_BroadcastTimer.reset(GetTicks());
 }
 
 CGame::~CGame()
 {
+	// the lobby is going away without the game starting, tell LAN clients to remove it from their list
+
+	if (GetLobbyOpen() || (m_State == State::CountDown && !m_GameInfo.empty()))
+		m_UDPSocket->Broadcast(6112, m_Protocol->SEND_W3GS_DECREATEGAME(GetLANHostCounter()));
+
+	if (m_GameDataPeakBytes > 0)
+		Print("[GAME: " + GetGameName() + "] reconnect history peaked at " + std::to_string(m_GameDataPeakBytes) + " bytes (limit " + std::to_string(m_Config->ReconnectHistory) + ")");
+
+	m_DownloadScheduler->RemoveGame(this, GetTicks());
+
 	delete m_Socket;
 	delete m_Protocol;
+	delete m_GPSProtocol;
+	delete m_LatencyController;
+	delete m_SpectatorFeed;
 
 	for (auto & potential : m_Potentials)
 		delete potential;
@@ -91,14 +186,40 @@ CGame::~CGame()
 
 uint32_t CGame::GetNumPlayers() const
 {
-	uint32_t NumPlayers = 0;
+	return m_Players.size();
+}
+
+bool CGame::GetGameDataQueued() const
+{
+	// map downloads wait while a player in the game has data we couldn't send yet, the game goes first (for a while, see CDownloadScheduler)
+	// a GProxy++ player who lost their connection doesn't count, their data waits for them to reconnect
+
+	if (m_State != State::Loading && m_State != State::Loaded)
+		return false;
 
-	for (const auto & player : m_Players)
+	for (auto & player : m_Players)
 	{
-		++NumPlayers;
+		if (!player->GetDisconnected() && player->GetSocket()->GetSendBufferSize() > 0)
+			return true;
 	}
 
-	return NumPlayers;
+	return false;
+}
+
+uint32_t CGame::GetPlayerTimeout() const
+{
+	// the lobby and loading screen are generous because a player downloading a big map or loading on a slow machine can go quiet for a while
+	// in the game a live client answers a ping every second and sends a keepalive for every action packet so we can be much stricter
+
+	switch (m_State)
+	{
+	case State::Loading:
+		return m_Config->LoadingTimeout;
+	case State::Loaded:
+		return m_Config->GameTimeout;
+	default:
+		return m_Config->LobbyTimeout;
+	}
 }
 
 uint32_t CGame::SetFD(void *fd, void *send_fd, int32_t *nfds)
@@ -113,6 +234,9 @@ uint32_t CGame::SetFD(void *fd, void *send_fd, int32_t *nfds)
 
 	for (auto & player : m_Players)
 	{
+		if (player->GetDisconnected())
+			continue;
+
 		player->GetSocket()->SetFD((fd_set *)fd, (fd_set *)send_fd, nfds);
 		++NumFDs;
 	}
@@ -135,49 +259,42 @@ bool CGame::Update(void *fd, void *send_fd)
 
 	// ping every 5 seconds
 	// changed this to ping during game loading as well to hopefully fix some problems with people disconnecting during loading
-	// changed this to ping during the game as well
-	if (m_PingTimer.update(Ticks, 5000))
+	// changed this to ping during the game as well, more often (every second by default) so a dead connection is noticed quickly
+	if (m_PingTimer.update(Ticks, m_State == State::Loaded ? m_Config->GamePingInterval : 5000))
 	{
 		// note: we must send pings to players who are downloading the map because Warcraft III disconnects from the lobby if it doesn't receive a ping every ~90 seconds
 		// so if the player takes longer than 90 seconds to download the map they would be disconnected unless we keep sending pings
 
 		SendAll(m_Protocol->SEND_W3GS_PING_FROM_HOST(Ticks));
 
-		// we also broadcast the game to the local network every 5 seconds so we hijack this timer for our nefarious purposes
-		// however we only want to broadcast if the countdown hasn't started
-		// see the !sendlan code later in this file for some more information about how this works
+		// the kernel's view of each connection complements the application level round trip time measured from the pongs
 
-		if (m_State == State::Waiting)
-		{
-			// construct a fixed host counter which will be used to identify players from this "realm" (i.e. LAN)
-			// the fixed host counter's 4 most significant bits will contain a 4 bit ID (0-15)
-			// the rest of the fixed host counter will contain the 28 least significant bits of the actual host counter
-			// since we're destroying 4 bits of information here the actual host counter should not be greater than 2^28 which is a reasonable assumption
-			// when a player joins a game we can obtain the ID from the received host counter
-			// note: LAN broadcasts use an ID of 0, battle.net refreshes use an ID of 1-10, the rest are unused
-
-			// we send 12 for SlotsTotal because this determines how many PID's Warcraft 3 allocates
-			// we need to make sure Warcraft 3 allocates at least SlotsTotal + 1 but at most 12 PID's
-			// this is because we need an extra PID for the virtual host player (but we always delete the virtual host player when the 12th person joins)
-			// however, we can't send 13 for SlotsTotal because this causes Warcraft 3 to crash when sharing control of units
-			// nor can we send SlotsTotal because then Warcraft 3 crashes when playing maps with less than 12 PID's (because of the virtual host player taking an extra PID)
-			// we also send 12 for SlotsOpen because Warcraft 3 assumes there's always at least one player in the game (the host)
-			// so if we try to send accurate numbers it'll always be off by one and results in Warcraft 3 assuming the game is full when it still needs one more player
-			// the easiest solution is to simply send 12 for both so the game will always show up as (1/12) players
-
-			// note: the PrivateGame flag is not set when broadcasting to LAN (as you might expect)
-			// note: we do not use m_Map->GetMapGameType because none of the filters are set when broadcasting to LAN (also as you might expect)
-
-			m_UDPSocket->Broadcast(6112, m_Protocol->SEND_W3GS_GAMEINFO(m_Config->War3Version, 1, m_Map->GetMapGameFlags(), m_Map->GetMapWidth(), m_Map->GetMapHeight(), GetGameName(), "Clan 007", 0, m_Map->GetMapPath(), m_Map->GetMapCRC(), 12, 12, m_HostPort, m_HostCounter & 0x0FFFFFFF, m_EntryKey));
-		}
+		for (auto & player : m_Players)
+			player->SampleTCPInfo();
 	}
 
+	if (m_Config->NetStatsInterval > 0 && m_NetStatsTimer.update(Ticks, m_Config->NetStatsInterval))
+		LogNetStats();
+
+	// broadcast the game to the local network, but only if the countdown hasn't started
+	// when the LAN responder is running clients find the lobby through W3GS_CREATEGAME and W3GS_SEARCHGAME so this interval can be much longer
+
+	if (m_BroadcastTimer.update(Ticks, m_Config->LANBroadcastInterval) && GetLobbyOpen())
+		m_UDPSocket->Broadcast(6112, m_GameInfo);
+
 	// update players
 	for (auto i = begin(m_Players); i != end(m_Players);)
 	{
 		if ((*i)->Update(Ticks, fd))
 		{
 			EventPlayerDeleted(Ticks, *i);
+
+			if ((*i)->GetPID() < MAX_PID)
+			{
+				m_PlayerFromPID[(*i)->GetPID()] = nullptr;
+				m_UsedPIDs &= ~(1 << (*i)->GetPID());
+			}
+
 			delete *i;
 			i = m_Players.erase(i);
 		}
@@ -187,7 +304,7 @@ bool CGame::Update(void *fd, void *send_fd)
 
 	for (auto i = begin(m_Potentials); i != end(m_Potentials);)
 	{
-		if ((*i)->Update(fd))
+		if ((*i)->Update(Ticks, fd))
 		{
 			// flush the socket (e.g. in case a rejection message is queued)
 			if ((*i)->GetSocket())
@@ -199,24 +316,27 @@ bool CGame::Update(void *fd, void *send_fd)
 			++i;
 	}
 
+	CheckSendQueues(Ticks);
+
 	// keep track of the largest sync counter (the number of keepalive packets received by each player)
 	// if anyone falls behind by more than m_SyncLimit keepalives we start the lag screen
 	if (m_State == State::Loaded)
 	{
 		// check if anyone has started lagging
 		// we consider a player to have started lagging if they're more than m_SyncLimit keepalives behind
+		// or, with bot_sendqueuepolicy set to lag, if they stopped reading what we send them
 		if (!m_Lagging)
 		{
 			std::string LaggingString;
+			std::vector<std::pair<uint8_t, uint32_t>> Lags;
 
 			for (auto & player : m_Players)
 			{
-				if (m_SyncCounter - player->GetSyncCounter() > m_SyncLimit)
+				if (m_SyncCounter - player->GetSyncCounter() > m_SyncLimit || (m_Config->SendQueuePolicy == SENDQUEUE_POLICY_LAG && GetSlowConsumer(Ticks, player)))
 				{
 					player->SetLagging(true);
 					player->SetStartedLaggingTicks(Ticks);
-					m_Lagging = true;
-					m_StartedLaggingTicks = Ticks;
+					Lags.push_back(std::make_pair(player->GetPID(), 0));
 
 					if (LaggingString.empty())
 						LaggingString = player->GetName();
@@ -225,20 +345,13 @@ bool CGame::Update(void *fd, void *send_fd)
 				}
 			}
 
-			if (m_Lagging)
+			if (!Lags.empty())
 			{
 				// start the lag screen
 				Print("[GAME: " + GetGameName() + "] started lagging on [" + LaggingString + "]");
-
-				std::vector<std::pair<uint8_t, uint32_t>> lags;
-				for (auto& ply : m_Players)
-				{
-					if (ply->GetLagging())
-					{
-						lags.push_back(std::make_pair(ply->GetPID(), Ticks - ply->GetStartedLaggingTicks()));
-					}
-				}
-				SendAll(m_Protocol->SEND_W3GS_START_LAG(lags));
+				m_Lagging = true;
+				m_StartedLaggingTicks = Ticks;
+				SendAll(m_Protocol->SEND_W3GS_START_LAG(Lags));
 
 				// reset everyone's drop vote
 				for (auto & player : m_Players)
@@ -255,40 +368,44 @@ bool CGame::Update(void *fd, void *send_fd)
 			// we cannot allow the lag screen to stay up for more than ~65 seconds because Warcraft III disconnects if it doesn't receive an action packet at least this often
 			// one (easy) solution is to simply drop all the laggers if they lag for more than 60 seconds
 			// another solution is to reset the lag screen the same way we reset it when using load-in-game
+			// every player gets the same packets so build them once
 			if (m_LagScreenResetTimer.update(Ticks, 60000))
 			{
-				for (auto & _i : m_Players)
+				std::vector<BYTEARRAY> Reset;
+				std::vector<std::pair<uint8_t, uint32_t>> Lags;
+
+				for (auto & ply : m_Players)
 				{
-					// stop the lag screen
-					for (auto& ply : m_Players)
+					if (ply->GetLagging())
 					{
-						if (ply->GetLagging())
-							Send(_i, m_Protocol->SEND_W3GS_STOP_LAG(ply->GetPID(), Ticks - ply->GetStartedLaggingTicks()));
+						Reset.push_back(m_Protocol->SEND_W3GS_STOP_LAG(ply->GetPID(), Ticks - ply->GetStartedLaggingTicks()));
+						Lags.push_back(std::make_pair(ply->GetPID(), Ticks - ply->GetStartedLaggingTicks()));
 					}
+				}
 
-					Send(_i, m_Protocol->SEND_W3GS_INCOMING_ACTION(std::vector<CIncomingAction *>(), 0));
+				Reset.push_back(m_Protocol->SEND_W3GS_INCOMING_ACTION(std::vector<CIncomingAction *>(), 0));
+				Reset.push_back(m_Protocol->SEND_W3GS_START_LAG(Lags));
 
-					// start the lag screen
-					std::vector<std::pair<uint8_t, uint32_t>> lags;
-					for (auto& ply : m_Players)
-					{
-						if (ply->GetLagging())
-						{
-							lags.push_back(std::make_pair(ply->GetPID(), Ticks - ply->GetStartedLaggingTicks()));
-						}
-					}
-					Send(_i, m_Protocol->SEND_W3GS_START_LAG(lags));
+				for (auto & _i : m_Players)
+				{
+					for (auto & packet : Reset)
+						Send(_i, packet);
 				}
 
 				// Warcraft III doesn't seem to respond to empty actions
 			}
 
-			// check if anyone has stopped lagging normally
+			// check if anyone has stopped lagging normally and if anyone is still lagging in the same pass
 			// we consider a player to have stopped lagging if they're less than half m_SyncLimit keepalives behind
 
+			bool Lagging = false;
+
 			for (auto & ply : m_Players)
 			{
-				if (ply->GetLagging() && m_SyncCounter - ply->GetSyncCounter() < m_SyncLimit / 2)
+				if (!ply->GetLagging())
+					continue;
+
+				if (m_SyncCounter - ply->GetSyncCounter() < m_SyncLimit / 2 && !GetSlowConsumer(Ticks, ply))
 				{
 					// stop the lag screen for this player
 
@@ -297,19 +414,8 @@ bool CGame::Update(void *fd, void *send_fd)
 					ply->SetLagging(false);
 					ply->SetStartedLaggingTicks(0);
 				}
-			}
-
-			// check if everyone has stopped lagging
-
-			bool Lagging = false;
-
-			for (auto & player : m_Players)
-			{
-				if (player->GetLagging())
-				{
+				else
 					Lagging = true;
-					break;
-				}
 			}
 
 			m_Lagging = Lagging;
@@ -329,6 +435,11 @@ bool CGame::Update(void *fd, void *send_fd)
 		SendAllActions();
 	}
 
+	// re-evaluate the latency about once a second, not while the lag screen is up because the round trip times and keepalive counts are meaningless then
+	if (m_State == State::Loaded && !m_Lagging && m_LatencyController && m_LatencyTimer.update(Ticks, 1000)) {
+		UpdateLatency();
+	}
+
 	// end the game if there aren't any players left
 	if (m_Players.empty())
 	{
@@ -363,8 +474,42 @@ bool CGame::Update(void *fd, void *send_fd)
 
 		if (FinishedLoading)
 		{
+			// add up how long everyone waited for the slowest player to load
+
+			for (auto & player : m_Players)
+				m_LoadingWaitTicks += Ticks - player->GetFinishedLoadingTicks();
+
+			Print("[GAME: " + GetGameName() + "] finished loading after " + std::to_string(Ticks - m_StartedLoadingTicks) + " ms, players waited " + std::to_string(m_LoadingWaitTicks) + " ms in total for slower players" + (m_Config->LoadInGame ? " (in the game with load-in-game)" : ""));
+
 			m_ActionSentTimer.reset(Ticks);
+			m_LatencyTimer.reset(Ticks);
 			m_State = State::Loaded;
+			SetPlayerTimeouts();
+		}
+		else if (m_Config->LoadInGame && m_LagScreenResetTimer.update(Ticks, 60000))
+		{
+			// the players that finished loading are already in the game behind a lag screen showing the players that are still loading
+			// Warcraft III disconnects if it doesn't receive an action packet at least every ~65 seconds so reset the lag screen with an empty action like we do in the game
+			// every player has to receive exactly the same action packets in the same order or the game desyncs so the empty action is buffered for the players still loading
+
+			for (auto & player : m_Players)
+			{
+				if (player->GetFinishedLoading())
+				{
+					for (auto & ply : m_Players)
+					{
+						if (!ply->GetFinishedLoading())
+							Send(player, m_Protocol->SEND_W3GS_STOP_LAG(ply->GetPID(), Ticks - m_StartedLoadingTicks));
+					}
+
+					Send(player, m_Protocol->SEND_W3GS_INCOMING_ACTION(std::vector<CIncomingAction *>(), 0));
+					Send(player, m_Protocol->SEND_W3GS_START_LAG(GetLoadingLags(Ticks)));
+				}
+				else
+					player->AddLoadInGameData(m_Protocol->SEND_W3GS_INCOMING_ACTION(std::vector<CIncomingAction *>(), 0));
+			}
+
+			// Warcraft III doesn't seem to respond to empty actions so they don't count towards m_SyncCounter
 		}
 	}
 
@@ -377,35 +522,6 @@ bool CGame::Update(void *fd, void *send_fd)
 			SendAllSlotInfo();
 	}
 
-	if (m_DownloadTimer.update(Ticks, 100))
-	{
-		for (auto & player : m_Players)
-		{
-			if (player->GetDownloadStarted() && !player->GetDownloadFinished())
-			{
-				// send up to 100 pieces of the map at once so that the download goes faster
-				// if we wait for each MAPPART packet to be acknowledged by the client it'll take a long time to download
-				// this is because we would have to wait the round trip time (the ping time) between sending every 1442 bytes of map data
-				// doing it this way allows us to send at least 140 KB in each round trip int32_terval which is much more reasonable
-				// the theoretical throughput is [140 KB * 1000 / ping] in KB/sec so someone with 100 ping (round trip ping, not LC ping) could download at 1400 KB/sec
-				// note: this creates a queue of map data which clogs up the connection when the client is on a slower connection (e.g. dialup)
-				// in this case any changes to the lobby are delayed by the amount of time it takes to send the queued data (i.e. 140 KB, which could be 30 seconds or more)
-				// for example, players joining and leaving, slot changes, chat messages would all appear to happen much later for the low bandwidth player
-				// note: the throughput is also limited by the number of times this code is executed each second
-				// e.g. if we send the maximum amount (140 KB) 10 times per second the theoretical throughput is 1400 KB/sec
-				// therefore the maximum throughput is 1400 KB/sec regardless of ping and this value slowly diminishes as the player's ping increases
-				// in addition to this, the throughput is limited by the configuration value bot_maxdownloadspeed
-				// in summary: the actual throughput is MIN( 140 * 1000 / ping, 1400, bot_maxdownloadspeed ) in KB/sec assuming only one player is downloading the map
-
-				while (player->GetLastMapPartSent() < player->GetLastMapPartAcked() + 1442 * 100 && player->GetLastMapPartSent() < m_Map->GetMapSize())
-				{
-					Send(player, m_Protocol->SEND_W3GS_MAPPART(GetHostPID(), player->GetPID(), player->GetLastMapPartSent(), m_Map->GetMapData()));
-					player->SetLastMapPartSent(player->GetLastMapPartSent() + 1442);
-				}
-			}
-		}
-	}
-
 	if (m_State == State::CountDown && m_CountDownTimer.update(Ticks, 500))
 	{
 		if (m_CountDownCounter > 0)
@@ -432,7 +548,12 @@ bool CGame::Update(void *fd, void *send_fd)
 		CTCPSocket *NewSocket = m_Socket->Accept((fd_set *)fd);
 
 		if (NewSocket)
-			m_Potentials.push_back(new CPotentialPlayer(m_Protocol, this, NewSocket));
+		{
+			if (AdmitConnection(Ticks, NewSocket))
+				m_Potentials.push_back(new CPotentialPlayer(m_Protocol, this, NewSocket));
+			else
+				delete NewSocket;
+		}
 
 		if (m_Socket->HasError())
 			return true;
@@ -443,6 +564,14 @@ bool CGame::Update(void *fd, void *send_fd)
 
 void CGame::UpdatePost(void *send_fd)
 {
+	// every slot change made during this loop iteration is sent as a single slot info update
+
+	if (m_SlotInfoQueued)
+	{
+		SendAllSlotInfo();
+		SendLANRefresh();
+	}
+
 	// we need to manually call DoSend on each player now because CGamePlayer :: Update doesn't do it
 	// this is in case player 2 generates a packet for player 1 during the update but it doesn't get sent because player 1 already finished updating
 	// in reality since we're queueing actions it might not make a big difference but oh well
@@ -457,6 +586,53 @@ void CGame::UpdatePost(void *send_fd)
 	}
 }
 
+uint32_t CGame::GetMapPartWait(const CGamePlayer *player, uint32_t Ticks) const
+{
+	// the milliseconds until the player's pacer may send the next map part
+	// a player waiting for an ack or for their send queue to drain wakes the loop up themselves
+
+	const CDownloadPacer *Pacer = player->GetDownloadPacer();
+
+	if ((m_State != State::Waiting && m_State != State::CountDown) || !Pacer || player->GetDownloadFinished() || player->GetLastMapPartSent() >= m_Map->GetMapSize() || player->GetSocket()->GetSendBufferSize() >= m_Config->SendQueueLimit / 4)
+		return 0xFFFFFFFF;
+
+	return Pacer->GetWait(Ticks);
+}
+
+uint32_t CGame::SendMapParts(CGamePlayer *player, uint32_t Ticks, uint32_t budget, void *send_fd)
+{
+	// sends the map parts the player's pacer allows as long as they fit in budget bytes, returns the bytes sent
+	// the pacer keeps about a round trip or two of the map in flight so a slow connection isn't clogged with map data
+	// and lobby updates (players joining and leaving, slot changes, chat) still reach the player without a long delay
+
+	// we also hold back while a quarter of bot_sendqueuelimit is still waiting in the player's send queue
+	// that way a slow downloader doesn't pile up map data in memory and is never dropped for the queue size because of the download alone
+
+	CDownloadPacer *Pacer = player->GetDownloadPacer();
+	uint32_t Sent = 0;
+
+	if ((m_State != State::Waiting && m_State != State::CountDown) || !Pacer || player->GetDownloadFinished())
+		return 0;
+
+	while (player->GetLastMapPartSent() < m_Map->GetMapSize() && player->GetSocket()->GetSendBufferSize() < m_Config->SendQueueLimit / 4 && Pacer->CanSend(Ticks))
+	{
+		const uint32_t Part = player->GetLastMapPartSent() / MAPPART_SIZE;
+
+		if (Part >= m_Map->GetNumMapParts() || Sent + MAPPART_HEADER_SIZE + m_Map->GetMapPart(Part).Length > budget)
+			break;
+
+		Send(player, m_Protocol->SEND_W3GS_MAPPART(GetHostPID(), player->GetPID(), m_Map->GetMapPartHeader(Part), m_Map->GetMapPartData(Part), m_Map->GetMapPart(Part).Length));
+		Pacer->OnSend(Ticks, m_Map->GetMapPart(Part).Length);
+		player->SetLastMapPartSent(player->GetLastMapPartSent() + MAPPART_SIZE);
+		Sent += MAPPART_HEADER_SIZE + m_Map->GetMapPart(Part).Length;
+	}
+
+	if (Sent > 0)
+		player->GetSocket()->DoSend((fd_set *)send_fd);
+
+	return Sent;
+}
+
 void CGame::Send(CGamePlayer *player, const BYTEARRAY &data)
 {
 	if (player)
@@ -469,6 +645,56 @@ void CGame::SendAll(const BYTEARRAY &data)
 		player->Send(data);
 }
 
+void CGame::SendAllGameData(const BYTEARRAY &data)
+{
+	// data that changes the game state (actions and player leaves) must reach every player in the same order
+	// during the game it's numbered and kept in m_GameData so that it can be replayed to GProxy++ players who reconnect
+	// the history is trimmed from the front to stay below bot_reconnecthistory bytes, a player who missed more than that can't reconnect
+	// spectators get the same stream, delayed
+
+	if (m_SpectatorFeed && (m_State == State::Loading || m_State == State::Loaded))
+		m_SpectatorFeed->AddFrame(GetTicks(), data);
+
+	if (m_State == State::Loaded)
+	{
+		const uint32_t Seq = m_GameDataBase + m_GameData.size();
+
+		if (m_Config->ReconnectPort != 0)
+		{
+			m_GameData.push_back(data);
+			m_GameDataBytes += data.size();
+			m_GameDataPeakBytes = std::max(m_GameDataPeakBytes, m_GameDataBytes);
+
+			while (m_GameDataBytes > m_Config->ReconnectHistory && m_GameData.size() > 1)
+			{
+				m_GameDataBytes -= m_GameData.front().size();
+				m_GameData.pop_front();
+				++m_GameDataBase;
+			}
+		}
+		else
+			++m_GameDataBase;
+
+		for (auto & player : m_Players)
+		{
+			player->PruneGameData(m_GameDataBase);
+			player->SendGameData(data, Seq);
+		}
+
+		return;
+	}
+
+	// players still loading with bot_loadingame can't take it yet so it's buffered and sent when they finish
+
+	for (auto & player : m_Players)
+	{
+		if (m_State == State::Loading && m_Config->LoadInGame && !player->GetFinishedLoading())
+			player->AddLoadInGameData(data);
+		else
+			player->Send(data);
+	}
+}
+
 void CGame::SendAllChat(const std::string &message)
 {
 	uint8_t fromPID = GetHostPID();
@@ -499,9 +725,43 @@ void CGame::SendAllSlotInfo()
 {
 	if (m_State == State::Waiting || m_State == State::CountDown)
 	{
-		SendAll(m_Protocol->SEND_W3GS_SLOTINFO(m_Slots, m_RandomSeed, m_Map->GetMapLayoutStyle(), m_Map->GetMapNumPlayers()));
+		const BYTEARRAY Packet = m_Protocol->SEND_W3GS_SLOTINFO(GetSlotInfo());
+
+		// players who joined since the last broadcast already got this exact slot info in their SLOTINFOJOIN
+
+		for (auto & player : m_Players)
+		{
+			if (std::find(begin(m_SlotInfoJoinPIDs), end(m_SlotInfoJoinPIDs), player->GetPID()) == end(m_SlotInfoJoinPIDs))
+				player->Send(Packet);
+		}
+
+		m_SlotInfoJoinPIDs.clear();
 		m_SlotInfoChanged = false;
 	}
+
+	m_SlotInfoQueued = false;
+}
+
+void CGame::QueueSlotInfo()
+{
+	m_SlotInfoDirty = true;
+	m_SlotIndexDirty = true;
+	m_SlotInfoQueued = true;
+}
+
+const BYTEARRAY &CGame::GetSlotInfo()
+{
+	if (m_SlotInfoDirty)
+	{
+		m_SlotInfo = m_Protocol->EncodeSlotInfo(m_Slots, m_RandomSeed, m_Map->GetMapLayoutStyle(), m_Map->GetMapNumPlayers());
+		m_SlotInfoDirty = false;
+
+		// the joining players' copy is out of date now
+
+		m_SlotInfoJoinPIDs.clear();
+	}
+
+	return m_SlotInfo;
 }
 
 void CGame::SendVirtualHostPlayerInfo(CGamePlayer *player)
@@ -511,6 +771,27 @@ void CGame::SendVirtualHostPlayerInfo(CGamePlayer *player)
 	Send(player, m_Protocol->SEND_W3GS_PLAYERINFO(m_VirtualHostPID, GetVirtualHostName(), 0, 0));
 }
 
+void CGame::SendLANRefresh()
+{
+	// keep the player count in the LAN game list up to date without waiting for the next W3GS_GAMEINFO broadcast
+	// like W3GS_GAMEINFO this always counts the host, but the lobby is never reported as full while a slot is still open
+
+	if (!GetLobbyOpen())
+		return;
+
+	uint32_t Players = GetNumPlayers() + 1;
+	const uint32_t MaxPlayers = GetEmptySlot() < m_Slots.size() ? 11 : 12;
+
+	if (Players > MaxPlayers)
+		Players = MaxPlayers;
+
+	if (Players != m_LANPlayers)
+	{
+		m_LANPlayers = Players;
+		m_UDPSocket->Broadcast(6112, m_Protocol->SEND_W3GS_REFRESHGAME(GetLANHostCounter(), Players, 12));
+	}
+}
+
 void CGame::SendAllActions()
 {
 	++m_SyncCounter;
@@ -523,7 +804,7 @@ void CGame::SendAllActions()
 	{
 		if (SubActionsLength + act->GetLength() > 1452)
 		{
-			SendAll(m_Protocol->SEND_W3GS_INCOMING_ACTION2(SubActions));
+			SendAllGameData(m_Protocol->SEND_W3GS_INCOMING_ACTION2(SubActions));
 			SubActions.clear();
 			SubActionsLength = 0;
 		}
@@ -531,25 +812,49 @@ void CGame::SendAllActions()
 		SubActionsLength += act->GetLength();
 	}
 
-	SendAll(m_Protocol->SEND_W3GS_INCOMING_ACTION(SubActions, GetLatency()));
+	SendAllGameData(m_Protocol->SEND_W3GS_INCOMING_ACTION(SubActions, GetLatency()));
 
 	for (auto& act : m_Actions)
 	{
 		delete act;
 	}
 	m_Actions.clear();
+
+	// the next action packet starts with a fresh allowance, the actions that had to wait go first
+
+	const uint32_t Ticks = GetTicks();
+
+	for (auto & player : m_Players)
+	{
+		player->SetIntervalActions(0);
+
+		while (!player->GetDeferredActions()->empty() && AdmitAction(Ticks, player, player->GetDeferredActions()->front()))
+			m_Actions.push_back(player->UndeferAction());
+	}
 }
 
 void CGame::EventPlayerDeleted(uint32_t Ticks, CGamePlayer *player)
 {
 	Print("[GAME: " + GetGameName() + "] deleting player [" + player->GetName() + "]");
 
+	m_DownloadScheduler->Remove(player, Ticks);
+
+	m_ActionBuckets.erase(player->GetPID());
+
+	// frames that were only waiting on this player's checksum can be compared now
+
+	if (m_State == State::Loaded)
+	{
+		player->SetDeleteMe(true);
+		CheckSumFrames();
+	}
+
 	if (player->GetLagging())
 		SendAll(m_Protocol->SEND_W3GS_STOP_LAG(player->GetPID(), Ticks - player->GetStartedLaggingTicks()));
 
 	// tell everyone about the player leaving
 
-	SendAll(m_Protocol->SEND_W3GS_PLAYERLEAVE_OTHERS(player->GetPID(), player->GetLeftCode()));
+	SendAllGameData(m_Protocol->SEND_W3GS_PLAYERLEAVE_OTHERS(player->GetPID(), player->GetLeftCode()));
 
 	// abort the countdown if there was one in progress
 
@@ -560,21 +865,105 @@ void CGame::EventPlayerDeleted(uint32_t Ticks, CGamePlayer *player)
 	}
 }
 
+void CGame::EventPotentialTimedOut(CPotentialPlayer *potential)
+{
+	// don't log every one of these, a port scanner or a connection flood would spam the log
+	// they're counted and show up in the network statistics instead
+
+	++m_DroppedHandshakes;
+	potential->SetDeleteMe(true);
+}
+
 void CGame::EventPlayerDisconnectTimedOut(CGamePlayer *player)
 {
+	if (EventPlayerGProxyDisconnect(player))
+		return;
+
+	Print("[GAME: " + GetGameName() + "] player [" + player->GetName() + "] timed out (nothing received for " + std::to_string(GetTicks() - player->GetSocket()->GetLastRecv()) + " ms)");
 	DeletePlayer(player, PLAYERLEAVE_DISCONNECT);
 }
 
 void CGame::EventPlayerDisconnectSocketError(CGamePlayer *player)
 {
+	if (EventPlayerGProxyDisconnect(player))
+		return;
+
 	DeletePlayer(player, PLAYERLEAVE_DISCONNECT);
 }
 
 void CGame::EventPlayerDisconnectConnectionClosed(CGamePlayer *player)
 {
+	if (EventPlayerGProxyDisconnect(player))
+		return;
+
+	DeletePlayer(player, PLAYERLEAVE_DISCONNECT);
+}
+
+bool CGame::EventPlayerGProxyDisconnect(CGamePlayer *player)
+{
+	// a GProxy++ player who loses their connection during the game gets bot_reconnectwaittime to reconnect
+	// they stop sending keepalives so the other players see them on the lag screen in the meantime and can still vote to drop them
+
+	if (!player->GetGProxy() || m_State != State::Loaded || m_Config->ReconnectPort == 0)
+		return false;
+
+	if (!player->GetDisconnected())
+	{
+		Print("[GAME: " + GetGameName() + "] player [" + player->GetName() + "] lost the connection, waiting up to " + std::to_string(m_Config->ReconnectWaitTime / 1000) + " seconds for GProxy++ to reconnect");
+		SendAllChat(player->GetName() + " has lost the connection but is using GProxy++ and may reconnect");
+		player->SetDisconnected(GetTicks());
+	}
+
+	return true;
+}
+
+void CGame::EventPlayerReconnectTimedOut(CGamePlayer *player)
+{
+	Print("[GAME: " + GetGameName() + "] player [" + player->GetName() + "] didn't reconnect in time");
 	DeletePlayer(player, PLAYERLEAVE_DISCONNECT);
 }
 
+bool CGame::EventPlayerReconnected(CGamePlayer *player, CTCPSocket *socket, uint32_t lastPacket)
+{
+	const uint32_t Resume = player->GetResumeSeq(lastPacket);
+	const uint32_t Next = m_GameDataBase + m_GameData.size();
+
+	if (Resume < m_GameDataBase || Resume > Next)
+	{
+		Print("[GAME: " + GetGameName() + "] player [" + player->GetName() + "] tried to reconnect but missed more than the reconnect history holds");
+		DeletePlayer(player, PLAYERLEAVE_DISCONNECT);
+		return false;
+	}
+
+	player->Reconnect(socket, lastPacket);
+
+	// replay the game data they missed
+
+	for (uint32_t Seq = Resume; Seq < Next; ++Seq)
+		player->SendGameData(m_GameData[Seq - m_GameDataBase], Seq);
+
+	// and show them who we're still waiting for
+
+	if (m_Lagging)
+	{
+		const uint32_t Ticks = GetTicks();
+		std::vector<std::pair<uint8_t, uint32_t>> Lags;
+
+		for (auto & ply : m_Players)
+		{
+			if (ply != player && ply->GetLagging())
+				Lags.push_back(std::make_pair(ply->GetPID(), Ticks - ply->GetStartedLaggingTicks()));
+		}
+
+		if (!Lags.empty())
+			Send(player, m_Protocol->SEND_W3GS_START_LAG(Lags));
+	}
+
+	Print("[GAME: " + GetGameName() + "] player [" + player->GetName() + "] reconnected with GProxy++, replayed " + std::to_string(Next - Resume) + " packets");
+	SendAllChat(player->GetName() + " has reconnected");
+	return true;
+}
+
 void CGame::EventPlayerJoined(CPotentialPlayer *potential, CIncomingJoinPlayer *joinPlayer)
 {
 	// check the new player's name
@@ -627,8 +1016,15 @@ void CGame::EventPlayerJoined(CPotentialPlayer *potential, CIncomingJoinPlayer *
 	CGamePlayer *Player = new CGamePlayer(potential, GetNewPID(), joinPlayer->GetName(), joinPlayer->GetInternalIP());
 
 	m_Players.push_back(Player);
+
+	if (Player->GetPID() < MAX_PID)
+	{
+		m_PlayerFromPID[Player->GetPID()] = Player;
+		m_UsedPIDs |= 1 << Player->GetPID();
+	}
 	potential->SetSocket(nullptr);
 	potential->SetDeleteMe(true);
+	Player->SetTimeout(GetPlayerTimeout());
 
 	if (m_Map->GetMapOptions() & CMap::MAPOPT::CUSTOMFORCES)
 		m_Slots[SID] = CGameSlot(Player->GetPID(), 255, SLOTSTATUS_OCCUPIED, 0, m_Slots[SID].GetTeam(), m_Slots[SID].GetColour(), m_Slots[SID].GetRace());
@@ -639,6 +1035,8 @@ void CGame::EventPlayerJoined(CPotentialPlayer *potential, CIncomingJoinPlayer *
 		else
 			m_Slots[SID] = CGameSlot(Player->GetPID(), 255, SLOTSTATUS_OCCUPIED, 0, 12, 12, SLOTRACE_RANDOM | SLOTRACE_SELECTABLE);
 
+		m_SlotIndexDirty = true;
+
 		// try to pick a team and colour
 		// make sure there aren't too many other players already
 
@@ -664,7 +1062,9 @@ void CGame::EventPlayerJoined(CPotentialPlayer *potential, CIncomingJoinPlayer *
 	// send slot info to the new player
 	// the SLOTINFOJOIN packet also tells the client their assigned PID and that the join was successful
 
-	Player->Send(m_Protocol->SEND_W3GS_SLOTINFOJOIN(Player->GetPID(), Player->GetSocket()->GetPort(), Player->GetExternalIP(), m_Slots, m_RandomSeed, m_Map->GetMapLayoutStyle(), m_Map->GetMapNumPlayers()));
+	QueueSlotInfo();
+	Player->Send(m_Protocol->SEND_W3GS_SLOTINFOJOIN(Player->GetPID(), Player->GetSocket()->GetPort(), Player->GetExternalIP(), GetSlotInfo()));
+	m_SlotInfoJoinPIDs.push_back(Player->GetPID());
 
 	// send virtual host info and fake player info (if present) to the new player
 
@@ -685,11 +1085,9 @@ void CGame::EventPlayerJoined(CPotentialPlayer *potential, CIncomingJoinPlayer *
 
 	// send a map check packet to the new player
 
-	Player->Send(m_Protocol->SEND_W3GS_MAPCHECK(m_Map->GetMapPath(), m_Map->GetMapSize(), m_Map->GetMapInfo(), m_Map->GetMapCRC(), m_Map->GetMapSHA1()));
+	Player->Send(m_Map->GetMapCheck());
 
-	// send slot info to everyone, so the new player gets this info twice but everyone else still needs to know the new slot layout
-
-	SendAllSlotInfo();
+	// everyone else still needs to know the new slot layout, this was queued above and goes out with any other slot changes in UpdatePost
 
 	// abort the countdown if there was one in progress
 
@@ -724,37 +1122,115 @@ void CGame::EventPlayerLeft(CGamePlayer *player, uint32_t reason)
 
 void CGame::EventPlayerLoaded(CGamePlayer *player)
 {
-	SendAll(m_Protocol->SEND_W3GS_GAMELOADED_OTHERS(player->GetPID()));
-}
+	if (!m_Config->LoadInGame)
+	{
+		SendAll(m_Protocol->SEND_W3GS_GAMELOADED_OTHERS(player->GetPID()));
+		return;
+	}
+
+	// send everything that was buffered while the player was loading
+	// this starts with a loaded message for every other player (see EventGameStarted) so the client enters the game right away
+
+	const uint32_t Ticks = GetTicks();
+	std::queue<BYTEARRAY> *LoadInGameData = player->GetLoadInGameData();
+
+	while (!LoadInGameData->empty())
+	{
+		Send(player, LoadInGameData->front());
+		LoadInGameData->pop();
+	}
+
+	// show the players that are still loading as lagging
+
+	const std::vector<std::pair<uint8_t, uint32_t>> Lags = GetLoadingLags(Ticks);
+
+	if (!Lags.empty())
+		Send(player, m_Protocol->SEND_W3GS_START_LAG(Lags));
+
+	// and take the player off the lag screen of everyone who loaded before them
+
+	for (auto & ply : m_Players)
+	{
+		if (ply != player && ply->GetFinishedLoading())
+			Send(ply, m_Protocol->SEND_W3GS_STOP_LAG(player->GetPID(), Ticks - m_StartedLoadingTicks));
+	}
+
+	Print("[GAME: " + GetGameName() + "] player [" + player->GetName() + "] finished loading in " + std::to_string(Ticks - m_StartedLoadingTicks) + " ms, " + std::to_string(Lags.size()) + " players still loading");
+}
 
 void CGame::EventPlayerAction(CGamePlayer *player, CIncomingAction *action)
 {
+	if (player->GetDeleteMe())
+	{
+		delete action;
+		return;
+	}
+
+	// every action is relayed to every player so one player flooding actions inflates every action packet for everyone
+	// actions over the player's budget wait for a later action packet, in order, or get the player disconnected
+
+	if (!player->GetDeferredActions()->empty() || !AdmitAction(GetTicks(), player, action))
+	{
+		if (m_Config->ActionPolicy == ACTION_POLICY_DROP || player->GetDeferredActionBytes() + action->GetLength() > m_Config->ActionBacklog)
+		{
+			Print("[GAME: " + GetGameName() + "] player [" + player->GetName() + "] went over their action budget (" + std::to_string(player->GetDeferredActions()->size()) + " actions, " + std::to_string(player->GetDeferredActionBytes()) + " bytes deferred), disconnecting");
+			delete action;
+			++m_ActionKicks;
+			DeletePlayer(player, PLAYERLEAVE_DISCONNECT);
+			return;
+		}
+
+		player->DeferAction(action);
+		return;
+	}
+
 	m_Actions.push_back(action);
 }
 
-void CGame::EventPlayerKeepAlive(CGamePlayer *player)
+bool CGame::AdmitAction(uint32_t Ticks, CGamePlayer *player, CIncomingAction *action)
 {
-	// check for desyncs
+	// bot_maxintervalactions limits the actions per action packet, bot_actionrate and bot_actionburst limit the bytes over time
 
-	const uint32_t FirstCheckSum = player->GetCheckSums()->front();
+	if (m_Config->MaxIntervalActions != 0 && player->GetIntervalActions() >= m_Config->MaxIntervalActions)
+		return false;
 
-	for (auto & player : m_Players)
+	if (m_Config->ActionRate != 0)
 	{
-		if (player->GetCheckSums()->empty())
-			return;
+		auto Bucket = m_ActionBuckets.find(player->GetPID());
 
-		if (!m_Desynced && player->GetCheckSums()->front() != FirstCheckSum)
-		{
-			m_Desynced = true;
-			Print("[GAME: " + GetGameName() + "] desync detected");
-			SendAllChat("Warning! Desync detected!");
-			SendAllChat("Warning! Desync detected!");
-			SendAllChat("Warning! Desync detected!");
-		}
+		if (Bucket == end(m_ActionBuckets))
+			Bucket = m_ActionBuckets.emplace(player->GetPID(), CTokenBucket(m_Config->ActionRate, m_Config->ActionBurst, Ticks)).first;
+
+		if (!Bucket->second.take(Ticks, action->GetLength()))
+			return false;
 	}
 
-	for (auto & player : m_Players)
-		player->GetCheckSums()->pop();
+	player->SetIntervalActions(player->GetIntervalActions() + 1);
+	return true;
+}
+
+void CGame::EventPlayerKeepAlive(CGamePlayer *player, uint32_t checkSum)
+{
+	// every keepalive carries the checksum of the player's game state after one action packet
+	// store it in the player's column of the frame's row, the frame is compared once every player has sent it
+
+	const uint8_t PID = player->GetPID();
+	const uint32_t Frame = player->GetSyncCounter() - 1;
+
+	if (PID >= MAX_PID || Frame < m_CheckSumFrame)
+		return;
+
+	// the ring is much larger than the lag screen threshold so this only happens if a player stopped counting frames entirely
+	// give up on the oldest frames rather than mixing up two frames in the same row
+
+	while (Frame - m_CheckSumFrame >= CHECKSUM_RING_FRAMES)
+		m_CheckSumMasks[m_CheckSumFrame++ % CHECKSUM_RING_FRAMES] = 0;
+
+	const uint32_t Row = Frame % CHECKSUM_RING_FRAMES;
+	m_CheckSums[Row][PID] = checkSum;
+	m_CheckSumMasks[Row] |= (uint16_t)(1 << PID);
+
+	CheckSumFrames();
 }
 
 void CGame::EventPlayerChatToHost(CGamePlayer *player, CIncomingChatPlayer *chatPlayer)
@@ -830,10 +1306,11 @@ void CGame::EventPlayerChangeTeam(CGamePlayer *player, uint8_t team)
 			{
 				// if they're joining a regular team give them an unused colour
 
+				m_SlotIndexDirty = true;
 				m_Slots[SID].SetColour(GetNewColour());
 			}
 
-			SendAllSlotInfo();
+			QueueSlotInfo();
 		}
 	}
 }
@@ -879,7 +1356,7 @@ void CGame::EventPlayerChangeRace(CGamePlayer *player, uint8_t race)
 	if (SID < m_Slots.size())
 	{
 		m_Slots[SID].SetRace(race | SLOTRACE_SELECTABLE);
-		SendAllSlotInfo();
+		QueueSlotInfo();
 	}
 }
 
@@ -898,7 +1375,7 @@ void CGame::EventPlayerChangeHandicap(CGamePlayer *player, uint8_t handicap)
 	if (SID < m_Slots.size())
 	{
 		m_Slots[SID].SetHandicap(handicap);
-		SendAllSlotInfo();
+		QueueSlotInfo();
 	}
 }
 
@@ -935,9 +1412,7 @@ void CGame::EventPlayerMapSize(CGamePlayer *player, CIncomingMapSize *mapSize)
 	{
 		// the player doesn't have the map
 
-		const std::string *MapData = m_Map->GetMapData();
-
-		if (!MapData->empty())
+		if (m_Map->GetMapDataLoaded())
 		{
 			if (!player->GetDownloadStarted() && mapSize->GetSizeFlag() == 1)
 			{
@@ -946,9 +1421,15 @@ void CGame::EventPlayerMapSize(CGamePlayer *player, CIncomingMapSize *mapSize)
 				Print("[GAME: " + GetGameName() + "] map download started for player [" + player->GetName() + "]");
 				Send(player, m_Protocol->SEND_W3GS_STARTDOWNLOAD(GetHostPID()));
 				player->SetDownloadStarted(true);
+				m_DownloadScheduler->Add(this, player, GetTicks());
 			}
 			else
+			{
 				player->SetLastMapPartAcked(mapSize->GetMapSize());
+
+				if (player->GetDownloadPacer())
+					player->GetDownloadPacer()->OnAck(GetTicks(), mapSize->GetMapSize());
+			}
 		}
 		else
 		{
@@ -958,6 +1439,14 @@ void CGame::EventPlayerMapSize(CGamePlayer *player, CIncomingMapSize *mapSize)
 	else if (player->GetDownloadStarted())
 	{
 		player->SetDownloadFinished(true);
+
+		if (const CDownloadPacer *Pacer = player->GetDownloadPacer())
+		{
+			const uint32_t Ticks = GetTicks();
+			Print("[GAME: " + GetGameName() + "] map download finished for player [" + player->GetName() + "] in " + std::to_string(Ticks - Pacer->GetStartTicks()) + " ms at " + std::to_string(Pacer->GetThroughput(Ticks) / 1024) + " KB/s");
+		}
+
+		m_DownloadScheduler->Remove(player, GetTicks());
 	}
 
 	uint8_t NewDownloadStatus = (uint8_t)((float)mapSize->GetMapSize() / m_Map->GetMapSize() * 100.f);
@@ -973,6 +1462,7 @@ void CGame::EventPlayerMapSize(CGamePlayer *player, CIncomingMapSize *mapSize)
 		if (m_Slots[SID].GetDownloadStatus() != NewDownloadStatus)
 		{
 			m_Slots[SID].SetDownloadStatus(NewDownloadStatus);
+			m_SlotInfoDirty = true;
 
 			// we don't actually send the new slot info here
 			// this is an optimization because it's possible for a player to download a map very quickly
@@ -991,14 +1481,22 @@ void CGame::EventGameStarted(uint32_t Ticks)
 	// send a final slot info update if necessary
 	// this typically won't happen because we prevent the !start command from completing while someone is downloading the map
 	// however, if someone uses !start force while a player is downloading the map this could trigger
-	// this is because we only permit slot info updates to be flagged when it's just a change in download status, all others are sent immediately
+	// this is because only download status changes are throttled, all other slot changes are queued and sent at the end of the same loop iteration
 	// it might not be necessary but let's clean up the mess anyway
 
-	if (m_SlotInfoChanged)
+	if (m_SlotInfoChanged || m_SlotInfoQueued)
 		SendAllSlotInfo();
 
 	m_LagScreenResetTimer.reset(Ticks);
+	m_StartedLoadingTicks = Ticks;
 	m_State = State::Loading;
+	m_DownloadScheduler->RemoveGame(this, Ticks);
+	SetPlayerTimeouts();
+
+	// remove the lobby from every LAN client's game list right away rather than letting it time out
+
+	if (!m_GameInfo.empty())
+		m_UDPSocket->Broadcast(6112, m_Protocol->SEND_W3GS_DECREATEGAME(GetLANHostCounter()));
 
 	// since we use a fake countdown to deal with leavers during countdown the COUNTDOWN_START and COUNTDOWN_END packets are sent in quick succession
 	// send a start countdown packet
@@ -1017,6 +1515,10 @@ void CGame::EventGameStarted(uint32_t Ticks)
 
 	delete m_Socket;
 	m_Socket = nullptr;
+	m_AcceptBuckets.clear();
+
+	if (m_DroppedHandshakes > 0 || m_DroppedFull > 0 || m_DroppedRate > 0)
+		Print("[GAME: " + GetGameName() + "] dropped " + std::to_string(m_DroppedHandshakes + m_DroppedFull + m_DroppedRate) + " connections in the lobby (" + std::to_string(m_DroppedHandshakes) + " handshake timeouts, " + std::to_string(m_DroppedFull) + " over the pending limit, " + std::to_string(m_DroppedRate) + " rate limited)");
 
 	// delete any potential players that are still hanging around
 
@@ -1024,41 +1526,100 @@ void CGame::EventGameStarted(uint32_t Ticks)
 		delete potential;
 
 	m_Potentials.clear();
-}
 
-uint8_t CGame::GetSIDFromPID(uint8_t PID) const
-{
-	for (uint8_t i = 0; i < m_Slots.size(); ++i)
+	// spectators start with the same slots and players the Warcraft III clients start with
+	// the players' IP addresses are left out, spectators don't need them
+
+	if (m_SpectatorFeed)
 	{
-		if (m_Slots[i].GetPID() == PID)
-			return i;
+		BYTEARRAY Header = CSpectatorFeed::SEND_SPECTATOR_INFO(GetLANHostCounter(), m_Config->SpectatorDelay, GetGameName(), m_Map->GetMapPath());
+		AppendByteArray(Header, m_Protocol->SEND_W3GS_SLOTINFO(GetSlotInfo()));
+
+		for (auto & player : m_Players)
+			AppendByteArray(Header, m_Protocol->SEND_W3GS_PLAYERINFO(player->GetPID(), player->GetName(), 0, 0));
+
+		m_SpectatorFeed->SetHeader(Header);
 	}
-	return 255;
-}
 
-uint8_t CGame::GetNewPID()
-{
-	// find an unused PID for a new player to use
+	// with load-in-game every player is told that everyone else has loaded as soon as they finish loading themselves
+	// the players that are actually still loading are shown on a lag screen instead
 
-	for (uint8_t TestPID = 1; TestPID < 255; ++TestPID)
+	if (m_Config->LoadInGame)
 	{
-		if (TestPID == m_VirtualHostPID)
-			continue;
-
-		bool InUse = false;
 		for (auto & player : m_Players)
 		{
-			if (player->GetPID() == TestPID)
+			for (auto & ply : m_Players)
 			{
-				InUse = true;
-				break;
+				if (ply != player)
+					player->AddLoadInGameData(m_Protocol->SEND_W3GS_GAMELOADED_OTHERS(ply->GetPID()));
 			}
 		}
+	}
+}
 
-		if (!InUse)
-			return TestPID;
+CGamePlayer *CGame::GetPlayerFromPID(uint8_t PID) const
+{
+	if (PID >= MAX_PID || !m_PlayerFromPID[PID] || m_PlayerFromPID[PID]->GetDeleteMe())
+		return nullptr;
+
+	return m_PlayerFromPID[PID];
+}
+
+CSpectatorFeed *CGame::ReleaseSpectatorFeed()
+{
+	// the feed can outlive the game because the spectators are behind by bot_spectatordelay
+
+	CSpectatorFeed *Feed = m_SpectatorFeed;
+	m_SpectatorFeed = nullptr;
+	return Feed;
+}
+
+void CGame::IndexSlots() const
+{
+	// one pass over the slots answers every PID, colour and open slot question until the slots change again
+	// a PID in more than one slot maps to the first one like it always did
+
+	memset(m_SIDFromPID, 255, sizeof(m_SIDFromPID));
+	m_OpenSlots = 0;
+	m_UsedColours = 0;
+
+	for (uint8_t i = 0; i < m_Slots.size() && i < 32; ++i)
+	{
+		const CGameSlot &Slot = m_Slots[i];
+
+		if (Slot.GetSlotStatus() == SLOTSTATUS_OPEN)
+			m_OpenSlots |= 1 << i;
+
+		if (Slot.GetColour() < 12)
+			m_UsedColours |= 1 << Slot.GetColour();
+
+		if (Slot.GetPID() < MAX_PID && m_SIDFromPID[Slot.GetPID()] == 255)
+			m_SIDFromPID[Slot.GetPID()] = i;
 	}
 
+	m_SlotIndexDirty = false;
+}
+
+uint8_t CGame::GetSIDFromPID(uint8_t PID) const
+{
+	if (m_SlotIndexDirty)
+		IndexSlots();
+
+	return PID < MAX_PID ? m_SIDFromPID[PID] : 255;
+}
+
+uint8_t CGame::GetNewPID()
+{
+	// find an unused PID for a new player to use, PID 0 isn't valid
+
+	uint32_t Free = ~(uint32_t)m_UsedPIDs & ((1 << MAX_PID) - 2);
+
+	if (m_VirtualHostPID < MAX_PID)
+		Free &= ~(1 << m_VirtualHostPID);
+
+	if (Free)
+		return LowestBit(Free);
+
 	// this should never happen
 
 	return 255;
@@ -1068,22 +1629,13 @@ uint8_t CGame::GetNewColour()
 {
 	// find an unused colour for a player to use
 
-	for (uint8_t TestColour = 0; TestColour < 12; ++TestColour)
-	{
-		bool InUse = false;
+	if (m_SlotIndexDirty)
+		IndexSlots();
 
-		for (auto & slot : m_Slots)
-		{
-			if (slot.GetColour() == TestColour)
-			{
-				InUse = true;
-				break;
-			}
-		}
+	const uint32_t Free = ~(uint32_t)m_UsedColours & 0xFFF;
 
-		if (!InUse)
-			return TestColour;
-	}
+	if (Free)
+		return LowestBit(Free);
 
 	// this should never happen
 
@@ -1122,13 +1674,12 @@ uint8_t CGame::GetHostPID()
 
 uint8_t CGame::GetEmptySlot()
 {
-	if (m_Slots.size() > 255)
-		return 255;
-	for (uint8_t i = 0; i < m_Slots.size(); ++i)
-	{
-		if (m_Slots[i].GetSlotStatus() == SLOTSTATUS_OPEN)
-			return i;
-	}
+	if (m_SlotIndexDirty)
+		IndexSlots();
+
+	if (m_OpenSlots)
+		return LowestBit(m_OpenSlots);
+
 	return 255;
 }
 
@@ -1200,7 +1751,7 @@ void CGame::SwapSlots(uint8_t SID1, uint8_t SID2)
 			m_Slots[SID2] = Slot1;
 		}
 
-		SendAllSlotInfo();
+		QueueSlotInfo();
 	}
 }
 
@@ -1222,7 +1773,7 @@ void CGame::DeletePlayer(CGamePlayer* player, uint32_t nLeftCode)
 		{
 			CGameSlot Slot = m_Slots[SID];
 			m_Slots[SID] = CGameSlot(0, 255, SLOTSTATUS_OPEN, 0, Slot.GetTeam(), Slot.GetColour(), Slot.GetRace());
-			SendAllSlotInfo();
+			QueueSlotInfo();
 		}
 	}
 }
@@ -1254,14 +1805,14 @@ void CGame::ColourSlot(uint8_t SID, uint8_t colour)
 
 			m_Slots[TakenSID].SetColour(m_Slots[SID].GetColour());
 			m_Slots[SID].SetColour(colour);
-			SendAllSlotInfo();
+			QueueSlotInfo();
 		}
 		else if (!Taken)
 		{
 			// the requested colour isn't used by ANY slot
 
 			m_Slots[SID].SetColour(colour);
-			SendAllSlotInfo();
+			QueueSlotInfo();
 		}
 	}
 }
@@ -1275,6 +1826,19 @@ void CGame::StartCountDown()
 	}
 }
 
+std::vector<std::pair<uint8_t, uint32_t>> CGame::GetLoadingLags(uint32_t Ticks) const
+{
+	std::vector<std::pair<uint8_t, uint32_t>> Lags;
+
+	for (auto & player : m_Players)
+	{
+		if (!player->GetFinishedLoading())
+			Lags.push_back(std::make_pair(player->GetPID(), Ticks - m_StartedLoadingTicks));
+	}
+
+	return Lags;
+}
+
 void CGame::StopLaggers()
 {
 	for (auto & player : m_Players)
@@ -1286,6 +1850,253 @@ void CGame::StopLaggers()
 	}
 }
 
+bool CGame::GetSlowConsumer(uint32_t Ticks, CGamePlayer *player) const
+{
+	// a player is a slow consumer if too much is queued for them or if their queue hasn't moved in a while
+
+	CTCPSocket *Socket = player->GetSocket();
+
+	if (Socket->GetSendBufferSize() == 0)
+		return false;
+
+	return Socket->GetSendBufferSize() >= m_Config->SendQueueLimit || Ticks - Socket->GetLastSendTicks() >= m_Config->SendQueueStall;
+}
+
+void CGame::CheckSendQueues(uint32_t Ticks)
+{
+	// everything we send a player who doesn't read it piles up in their send queue
+	// in the lobby and while loading there's nothing else we can do so disconnect them
+	// during the game bot_sendqueuepolicy decides between the lag screen (see Update) and disconnecting them
+
+	if (m_State == State::Loaded && m_Config->SendQueuePolicy == SENDQUEUE_POLICY_LAG)
+		return;
+
+	for (auto & player : m_Players)
+	{
+		if (player->GetDeleteMe() || !GetSlowConsumer(Ticks, player))
+			continue;
+
+		Print("[GAME: " + GetGameName() + "] player [" + player->GetName() + "] isn't reading, dropping them (" + std::to_string(player->GetSocket()->GetSendBufferSize()) + " bytes queued, no progress for " + std::to_string(Ticks - player->GetSocket()->GetLastSendTicks()) + " ms)");
+		DeletePlayer(player, PLAYERLEAVE_DISCONNECT);
+		player->GetSocket()->ClearSendBuffer();
+	}
+}
+
+void CGame::LogNetStats()
+{
+	for (auto & player : m_Players)
+	{
+		std::string Stats = "rtt " + std::to_string(player->GetPing()) + " ms (min " + std::to_string(player->GetMinPing()) + ", jitter " + std::to_string(player->GetPingJitter()) + ", " + std::to_string(player->GetNumPings()) + " samples)";
+		const CTCPInfo &TCPInfo = player->GetTCPInfo();
+
+		if (TCPInfo.Valid)
+			Stats += ", tcp rtt " + std::to_string(TCPInfo.RTT / 1000) + " ms (var " + std::to_string(TCPInfo.RTTVar / 1000) + "), retransmits " + std::to_string(TCPInfo.Retransmits) + ", cwnd " + std::to_string(TCPInfo.CongestionWindow) + ", unacked " + std::to_string(TCPInfo.UnackedBytes) + " bytes";
+
+		Stats += ", send queue " + std::to_string(player->GetSocket()->GetSendBufferSize()) + " bytes";
+
+		if (const CDownloadPacer *Pacer = player->GetDownloadPacer())
+			Stats += ", map download " + std::to_string(Pacer->GetAcked()) + "/" + std::to_string(m_Map->GetMapSize()) + " bytes at " + std::to_string(Pacer->GetThroughput(GetTicks()) / 1024) + " KB/s (" + Pacer->GetModeName() + ", bandwidth " + std::to_string(Pacer->GetBandwidth() / 1024) + " KB/s, min rtt " + std::to_string(Pacer->GetMinRTT()) + " ms, window " + std::to_string(Pacer->GetWindow()) + " bytes)";
+
+		if (player->GetTotalDeferredActions() > 0)
+			Stats += ", " + std::to_string(player->GetDeferredActions()->size()) + " actions deferred (" + std::to_string(player->GetDeferredActionBytes()) + " bytes, " + std::to_string(player->GetTotalDeferredActions()) + " in total)";
+
+		Print("[GAME: " + GetGameName() + "] [" + player->GetName() + "] " + Stats);
+	}
+
+	if (m_Config->ReconnectPort != 0)
+		Print("[GAME: " + GetGameName() + "] reconnect history: " + std::to_string(m_GameData.size()) + " packets, " + std::to_string(m_GameDataBytes) + " bytes (limit " + std::to_string(m_Config->ReconnectHistory) + ", peak " + std::to_string(m_GameDataPeakBytes) + ")");
+
+	if (m_ActionKicks > 0)
+		Print("[GAME: " + GetGameName() + "] players disconnected for going over their action budget: " + std::to_string(m_ActionKicks));
+
+	if (m_SpectatorFeed)
+		Print("[GAME: " + GetGameName() + "] spectators: " + std::to_string(m_SpectatorFeed->GetNumViewers()) + " viewers (peak " + std::to_string(m_SpectatorFeed->GetPeakViewers()) + ", dropped " + std::to_string(m_SpectatorFeed->GetDroppedViewers()) + "), " + std::to_string(m_SpectatorFeed->GetBytes()) + " bytes held");
+
+	if (m_DroppedHandshakes > 0 || m_DroppedFull > 0 || m_DroppedRate > 0)
+		Print("[GAME: " + GetGameName() + "] dropped connections: " + std::to_string(m_DroppedHandshakes) + " handshake timeouts, " + std::to_string(m_DroppedFull) + " over the pending limit, " + std::to_string(m_DroppedRate) + " rate limited");
+}
+
+bool CGame::AdmitConnection(uint32_t Ticks, CTCPSocket *socket)
+{
+	// connections that haven't joined yet are cheap to open and cost us a socket in every loop iteration
+	// so limit how many can be pending at once, how many can come from one IP and how often one IP can connect
+	// a limit that's set to 0 is disabled
+
+	const uint32_t IP = socket->GetIP();
+
+	if (m_Config->MaxPotentials != 0 && m_Potentials.size() >= m_Config->MaxPotentials)
+	{
+		++m_DroppedFull;
+		return false;
+	}
+
+	if (m_Config->MaxPotentialsPerIP != 0)
+	{
+		uint32_t PotentialsFromIP = 0;
+
+		for (auto & potential : m_Potentials)
+		{
+			if (potential->GetSocket() && potential->GetExternalIP() == IP)
+				++PotentialsFromIP;
+		}
+
+		if (PotentialsFromIP >= m_Config->MaxPotentialsPerIP)
+		{
+			++m_DroppedFull;
+			return false;
+		}
+	}
+
+	if (m_Config->AcceptRate == 0 || m_Config->AcceptBurst == 0)
+		return true;
+
+	// forget about IPs that have been quiet long enough to have a full bucket again, they'd start with a full one anyway
+
+	if (m_AcceptBuckets.size() >= 256)
+	{
+		for (auto i = begin(m_AcceptBuckets); i != end(m_AcceptBuckets);)
+		{
+			if (i->second.full(Ticks))
+				i = m_AcceptBuckets.erase(i);
+			else
+				++i;
+		}
+	}
+
+	auto Bucket = m_AcceptBuckets.find(IP);
+
+	if (Bucket == end(m_AcceptBuckets))
+		Bucket = m_AcceptBuckets.emplace(IP, CTokenBucket(m_Config->AcceptRate, m_Config->AcceptBurst, Ticks)).first;
+
+	if (!Bucket->second.take(Ticks))
+	{
+		++m_DroppedRate;
+		return false;
+	}
+
+	return true;
+}
+
+void CGame::SetPlayerTimeouts()
+{
+	const uint32_t Timeout = GetPlayerTimeout();
+
+	for (auto & player : m_Players)
+		player->SetTimeout(Timeout);
+}
+
+void CGame::UpdateLatency()
+{
+	uint32_t MaxRTT = 0;
+	uint32_t MaxBacklog = 0;
+
+	for (auto & player : m_Players)
+	{
+		MaxRTT = std::max(MaxRTT, player->GetPing());
+		MaxBacklog = std::max(MaxBacklog, m_SyncCounter - player->GetSyncCounter());
+	}
+
+	const uint32_t OldLatency = m_Latency;
+
+	if (m_LatencyController->Update(MaxRTT, MaxBacklog))
+	{
+		m_Latency = m_LatencyController->GetLatency();
+		m_SyncLimit = m_LatencyController->GetSyncLimit();
+		Print("[GAME: " + GetGameName() + "] latency changed from " + std::to_string(OldLatency) + " to " + std::to_string(m_Latency) + " ms (sync limit " + std::to_string(m_SyncLimit) + ", max rtt " + std::to_string(MaxRTT) + " ms, max backlog " + std::to_string(MaxBacklog) + ")");
+	}
+}
+
+void CGame::CheckSumFrames()
+{
+	// compare every frame that all the remaining players have sent a checksum for
+	// players who are being deleted don't count, this is called again when one is deleted so the frames they were holding up get compared
+
+	uint16_t Expected = 0;
+
+	for (auto & player : m_Players)
+	{
+		if (!player->GetDeleteMe() && player->GetPID() < MAX_PID)
+			Expected |= (uint16_t)(1 << player->GetPID());
+	}
+
+	if (Expected == 0)
+		return;
+
+	while ((m_CheckSumMasks[m_CheckSumFrame % CHECKSUM_RING_FRAMES] & Expected) == Expected)
+	{
+		const uint32_t Row = m_CheckSumFrame % CHECKSUM_RING_FRAMES;
+		const uint32_t *CheckSums = m_CheckSums[Row];
+
+		// find the checksum most players agree on, this is usually the first one we look at
+
+		uint32_t Majority = 0;
+		uint32_t MajorityCount = 0;
+
+		for (uint8_t i = 0; i < MAX_PID; ++i)
+		{
+			if (!(Expected & (1 << i)))
+				continue;
+
+			uint32_t Count = 0;
+
+			for (uint8_t j = 0; j < MAX_PID; ++j)
+			{
+				if ((Expected & (1 << j)) && CheckSums[j] == CheckSums[i])
+					++Count;
+			}
+
+			if (Count > MajorityCount)
+			{
+				Majority = CheckSums[i];
+				MajorityCount = Count;
+			}
+		}
+
+		uint16_t Diverged = 0;
+
+		for (uint8_t i = 0; i < MAX_PID; ++i)
+		{
+			if ((Expected & (1 << i)) && CheckSums[i] != Majority)
+				Diverged |= (uint16_t)(1 << i);
+		}
+
+		// only report when the set of diverged players changes, once a player desyncs their checksums are usually different on every frame
+
+		if (Diverged && Diverged != m_DesyncPIDs)
+		{
+			std::string DivergedString;
+
+			for (auto & player : m_Players)
+			{
+				if (player->GetPID() < MAX_PID && (Diverged & (1 << player->GetPID())))
+				{
+					if (!DivergedString.empty())
+						DivergedString += ", ";
+
+					DivergedString += player->GetName() + " (" + std::to_string(CheckSums[player->GetPID()]) + ")";
+				}
+			}
+
+			Print("[GAME: " + GetGameName() + "] desync detected at frame " + std::to_string(m_CheckSumFrame) + ", majority checksum " + std::to_string(Majority) + " (" + std::to_string(MajorityCount) + " players), diverged [" + DivergedString + "]");
+
+			if (!m_Desynced)
+			{
+				SendAllChat("Warning! Desync detected!");
+				SendAllChat("Warning! Desync detected!");
+				SendAllChat("Warning! Desync detected!");
+			}
+
+			m_Desynced = true;
+			m_DesyncFrame = m_CheckSumFrame;
+			m_DesyncCheckSum = Majority;
+			m_DesyncPIDs = Diverged;
+		}
+
+		m_CheckSumMasks[Row] = 0;
+		++m_CheckSumFrame;
+	}
+}
+
 void CGame::CreateVirtualHost()
 {
 	if (m_VirtualHostPID != 255)
@@ -24,15 +24,34 @@ CODE PORTED FROM THE ORIGINAL GHOST PROJECT: http://ghost.pwner.org/
 #include "gameslot.h"
 #include <vector>
 #include <queue>
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <memory>
 typedef std::vector<uint8_t> BYTEARRAY;
 
+#define MAX_PID                    16 // PIDs are handed out from 1 and a game never has more than 12 players plus the virtual host
+#define CHECKSUM_RING_FRAMES      256 // sync frames kept for desync detection, must be larger than the lag screen threshold
+
+// what to do with a player that doesn't read what we send during the game (bot_sendqueuepolicy)
+
+#define SENDQUEUE_POLICY_LAG        0 // put them in the lag screen until they catch up, the other players can vote to drop them
+#define SENDQUEUE_POLICY_DROP       1 // disconnect them
+
+// what to do with a player that sends more actions than their action budget allows (bot_actionpolicy)
+
+#define ACTION_POLICY_DEFER         0 // relay the extra actions in later action packets, disconnect them only if bot_actionbacklog overflows
+#define ACTION_POLICY_DROP          1 // disconnect them
+
 //
 // CGame
 //
 
 class CUDPSocket;
 class CTCPServer;
+class CTCPSocket;
 class CGameProtocol;
+class CGPSProtocol;
 class CPotentialPlayer;
 class CGamePlayer;
 class CMap;
@@ -40,6 +59,9 @@ class CIncomingJoinPlayer;
 class CIncomingAction;
 class CIncomingChatPlayer;
 class CIncomingMapSize;
+class CLatencyController;
+class CSpectatorFeed;
+class CDownloadScheduler;
 
 class CTimer
 {
@@ -67,6 +89,49 @@ private:
 	uint32_t m_Ticks;
 };
 
+// a token bucket holding up to Burst tokens and refilled at Rate tokens per second
+// tokens are kept in thousandths so that rates below one per millisecond still refill smoothly
+
+class CTokenBucket
+{
+public:
+	CTokenBucket(uint32_t Rate, uint32_t Burst, uint32_t CurTicks)
+		: m_Rate(Rate),
+		m_Burst(Burst),
+		m_Tokens((uint64_t)Burst * 1000),
+		m_Ticks(CurTicks)
+	{ }
+
+	bool take(uint32_t CurTicks, uint32_t Cost = 1)
+	{
+		refill(CurTicks);
+
+		if (m_Tokens < (uint64_t)Cost * 1000)
+			return false;
+
+		m_Tokens -= (uint64_t)Cost * 1000;
+		return true;
+	}
+
+	bool full(uint32_t CurTicks)
+	{
+		refill(CurTicks);
+		return m_Tokens == (uint64_t)m_Burst * 1000;
+	}
+
+private:
+	void refill(uint32_t CurTicks)
+	{
+		m_Tokens = std::min<uint64_t>(m_Tokens + (uint64_t)(CurTicks - m_Ticks) * m_Rate, (uint64_t)m_Burst * 1000);
+		m_Ticks = CurTicks;
+	}
+
+	uint32_t m_Rate;
+	uint32_t m_Burst;
+	uint64_t m_Tokens;
+	uint32_t m_Ticks;
+};
+
 struct CGameConfig
 {
 	std::string GameName;
@@ -74,43 +139,113 @@ struct CGameConfig
 	uint8_t     War3Version;
 	uint32_t    Latency;
 	uint32_t    AutoStart;
+	uint32_t    LANBroadcastInterval;
+	bool        DynamicLatency;
+	uint32_t    MinLatency;
+	uint32_t    MaxLatency;
+	uint32_t    NetStatsInterval;
+	uint32_t    LobbyTimeout;
+	uint32_t    LoadingTimeout;
+	uint32_t    GameTimeout;
+	uint32_t    LagScreenGrace;
+	uint32_t    GamePingInterval;
+	uint32_t    HandshakeTimeout;
+	uint32_t    MaxPotentials;
+	uint32_t    MaxPotentialsPerIP;
+	uint32_t    AcceptRate;
+	uint32_t    AcceptBurst;
+	uint32_t    SendQueueLimit;
+	uint32_t    SendQueueStall;
+	uint8_t     SendQueuePolicy;
+	bool        LoadInGame;
+	uint16_t    ReconnectPort;
+	uint32_t    ReconnectWaitTime;
+	uint32_t    ReconnectHistory;
+	uint16_t    SpectatorPort;
+	uint32_t    SpectatorDelay;
+	uint32_t    SpectatorHistory;
+	uint32_t    SpectatorMaxViewers;
+	uint32_t    ActionRate;
+	uint32_t    ActionBurst;
+	uint32_t    MaxIntervalActions;
+	uint32_t    ActionBacklog;
+	uint8_t     ActionPolicy;
 };
 
 class CGame
 {
 protected:
 	CUDPSocket *m_UDPSocket;
+	CDownloadScheduler *m_DownloadScheduler;      // sends the map to our downloading players, shared with every other game
 	CTCPServer *m_Socket;                         // listening socket
 	CGameProtocol *m_Protocol;                    // game protocol
+	CGPSProtocol *m_GPSProtocol;                  // GProxy++ protocol
 	std::vector<CGameSlot> m_Slots;               // std::vector of slots
 	std::vector<CPotentialPlayer *> m_Potentials; // std::vector of potential players (connections that haven't sent a W3GS_REQJOIN packet yet)
 	std::vector<CGamePlayer *> m_Players;         // std::vector of players
 	std::vector<CIncomingAction *> m_Actions;     // queue of actions to be sent
-	const CMap *m_Map;                            // map data
+	std::deque<BYTEARRAY> m_GameData;             // the most recent game data packets (actions and player leaves) sent during the game, replayed to reconnecting GProxy++ players
+	BYTEARRAY m_SlotInfo;                         // cached EncodeSlotInfo output for m_Slots, rebuilt on demand when m_SlotInfoDirty is set
+	BYTEARRAY m_SlotInfoJoinPIDs;                 // players that already received the current m_SlotInfo in their SLOTINFOJOIN
+	BYTEARRAY m_GameInfo;                         // cached W3GS_GAMEINFO, used for LAN broadcasts and W3GS_SEARCHGAME replies
+	std::map<uint32_t, CTokenBucket> m_AcceptBuckets; // connection rate limit per source IP
+	std::map<uint8_t, CTokenBucket> m_ActionBuckets; // action bytes budget per PID
+	std::shared_ptr<const CMap> m_Map;            // map data, shared with every other game hosting the same map
 	const CGameConfig* m_Config;
+	CLatencyController *m_LatencyController;      // adjusts m_Latency and m_SyncLimit while the game is running (nullptr if bot_dynamiclatency is off)
+	CSpectatorFeed *m_SpectatorFeed;              // the game data stream for spectators (nullptr if bot_spectatorport is off)
 	uint32_t m_RandomSeed;                        // the random seed sent to the Warcraft III clients
 	uint32_t m_HostCounter;                       // a unique game number
 	uint32_t m_EntryKey;                          // random entry key for LAN, used to prove that a player is actually joining from LAN
+	uint32_t m_Latency;                           // the current action interval, starts out as bot_latency
 	uint32_t m_SyncLimit;                         // the maximum number of packets a player can fall out of sync before starting the lag screen
 	uint32_t m_SyncCounter;                       // the number of actions sent so far (for determining if anyone is lagging)
 	uint32_t m_CountDownCounter;                  // the countdown is finished when this reaches zero
 	uint32_t m_StartedLaggingTicks;               // GetTicks when the last lag screen started
 	uint32_t m_LastLagScreenTicks;                // GetTicks when the last lag screen was active (continuously updated)
+	uint32_t m_StartedLoadingTicks;               // GetTicks when the game started loading
+	uint32_t m_LoadingWaitTicks;                  // the total time players who finished loading waited for the others (spent in the game instead of on the loading screen with bot_loadingame)
 	uint32_t m_EmptyWaitingTicks;
+	uint32_t m_LANPlayers;                        // the player count last sent in W3GS_REFRESHGAME
+	uint32_t m_GameDataBase;                      // the sequence number of m_GameData.front()
+	uint32_t m_GameDataBytes;                     // the size of everything in m_GameData, kept below bot_reconnecthistory
+	uint32_t m_GameDataPeakBytes;                 // the largest m_GameDataBytes so far
+	uint32_t m_DroppedHandshakes;                 // connections dropped because they didn't send a valid W3GS_REQJOIN in time
+	uint32_t m_DroppedFull;                       // connections refused because bot_maxpotentials or bot_maxpotentialsperip was reached
+	uint32_t m_DroppedRate;                       // connections refused because their IP connected too often
+	uint32_t m_ActionKicks;                       // players disconnected for going over their action budget
 	CTimer m_ActionSentTimer;                     // GetTicks when the last action packet was sent
 	CTimer m_PingTimer;                           // GetTicks when the last ping was sent
-	CTimer m_DownloadTimer;                       // GetTicks when the last map download cycle was performed
+	CTimer m_BroadcastTimer;                      // GetTicks when the game was last broadcast to the local network
 	CTimer m_SyncSlotInfoTimer;                   // GetTicks when the download counter was last reset
 	CTimer m_CountDownTimer;                      // GetTicks when the last countdown message was sent
 	CTimer m_LagScreenResetTimer;                 // GetTicks when the "lag" screen was last reset
+	CTimer m_LatencyTimer;                        // GetTicks when the latency was last re-evaluated
+	CTimer m_NetStatsTimer;                       // GetTicks when the network statistics were last logged
 	uint16_t m_HostPort;                          // the port to host games on
 	uint8_t m_VirtualHostPID;                     // host's PID
 	bool m_Exiting;                               // set to true and this class will be deleted next update
 	bool m_SlotInfoChanged;                       // if the slot info has changed and hasn't been sent to the players yet (optimization)
+	bool m_SlotInfoDirty;                         // if m_Slots has changed since m_SlotInfo was encoded
+	mutable bool m_SlotIndexDirty;                // if m_Slots has changed since m_SIDFromPID, m_OpenSlots and m_UsedColours were built
+	bool m_SlotInfoQueued;                        // if a slot info broadcast is pending, it's sent once in UpdatePost no matter how many slots changed
 
 	bool m_Lagging;                               // if the lag screen is active or not
 	bool m_Desynced;                              // if the game has desynced or not
 
+	CGamePlayer *m_PlayerFromPID[MAX_PID];        // the player with each PID (nullptr if none), kept in step with m_Players
+	mutable uint8_t m_SIDFromPID[MAX_PID];        // the slot of each PID (255 if none), rebuilt from m_Slots when m_SlotIndexDirty is set
+	mutable uint32_t m_OpenSlots;                 // bit n is set if slot n is open
+	mutable uint16_t m_UsedColours;               // bit n is set if colour n belongs to a slot
+	uint16_t m_UsedPIDs;                          // bit n is set if PID n belongs to a player in m_Players
+
+	uint32_t m_CheckSums[CHECKSUM_RING_FRAMES][MAX_PID]; // keepalive checksums indexed by [sync frame % CHECKSUM_RING_FRAMES][PID]
+	uint16_t m_CheckSumMasks[CHECKSUM_RING_FRAMES];       // which PIDs have sent their checksum for each frame in the ring
+	uint32_t m_CheckSumFrame;                     // the oldest sync frame that hasn't been compared yet
+	uint32_t m_DesyncFrame;                       // the sync frame of the last detected desync
+	uint32_t m_DesyncCheckSum;                    // the majority checksum of that frame
+	uint16_t m_DesyncPIDs;                        // bitmask of the PIDs that diverged from the majority
+
 	enum class State
 	{
 		Waiting,
@@ -122,16 +257,36 @@ protected:
 	State m_State;
 
 public:
-	CGame(const CMap* Map, const CGameConfig* Config, CUDPSocket* UDPSocket, uint32_t HostCounter);
+	CGame(std::shared_ptr<const CMap> Map, const CGameConfig* Config, CUDPSocket* UDPSocket, CDownloadScheduler* DownloadScheduler, uint32_t HostCounter);
 	~CGame();
 	CGame(CGame &) = delete;
 
 	inline std::string GetGameName() const            { return m_Config->GameName; }
 	inline std::string GetVirtualHostName() const     { return m_Config->VirtualHostName; }
-	inline uint32_t GetLatency() const                { return m_Config->Latency; }
+	inline uint32_t GetLatency() const                { return m_Latency; }
+	inline uint32_t GetSyncLimit() const              { return m_SyncLimit; }
 	inline uint32_t GetLastLagScreenTicks() const     { return m_LastLagScreenTicks; }
+	inline uint32_t GetLagScreenGrace() const         { return m_Config->LagScreenGrace; }
+	inline uint32_t GetLoadingWaitTicks() const       { return m_LoadingWaitTicks; }
+	inline uint16_t GetReconnectPort() const          { return m_Config->ReconnectPort; }
+	inline uint32_t GetReconnectWaitTime() const      { return m_Config->ReconnectWaitTime; }
+	inline bool GetGameLoaded() const                 { return m_State == State::Loaded; }
+	inline CGPSProtocol *GetGPSProtocol() const       { return m_GPSProtocol; }
+	inline CSpectatorFeed *GetSpectatorFeed() const   { return m_SpectatorFeed; }
+	inline bool GetDesynced() const                   { return m_Desynced; }
+	inline uint32_t GetDesyncFrame() const            { return m_DesyncFrame; }
+	inline uint32_t GetDesyncCheckSum() const         { return m_DesyncCheckSum; }
+	inline uint16_t GetDesyncPIDs() const             { return m_DesyncPIDs; }
+	inline uint8_t GetWar3Version() const             { return m_Config->War3Version; }
+	inline uint32_t GetLANHostCounter() const         { return m_HostCounter & 0x0FFFFFFF; }
+	inline const BYTEARRAY &GetGameInfo() const       { return m_GameInfo; }
+	inline bool GetLobbyOpen() const                  { return m_State == State::Waiting && !m_GameInfo.empty(); }
 	
+	inline const std::vector<CGamePlayer *> &GetPlayers() const { return m_Players; }
 	uint32_t GetNumPlayers() const;
+	uint32_t GetPlayerTimeout() const;
+	bool GetGameDataQueued() const;
+	inline uint32_t GetHandshakeTimeout() const       { return m_Config->HandshakeTimeout; }
 
 	inline void SetExiting(bool nExiting)                      { m_Exiting = nExiting; }
 
@@ -145,27 +300,40 @@ public:
 
 	void Send(CGamePlayer *player, const BYTEARRAY &data);
 	void SendAll(const BYTEARRAY &data);
+	void SendAllGameData(const BYTEARRAY &data);
 
 	// functions to send packets to players
 
 	void SendAllChat(const std::string &message);
 	void SendAllSlotInfo();
+	void QueueSlotInfo();
+	const BYTEARRAY &GetSlotInfo();
 	void SendVirtualHostPlayerInfo(CGamePlayer *player);
 	void SendAllActions();
+	void SendLANRefresh();
+
+	// map downloads, the download scheduler decides whose turn it is
+
+	uint32_t GetMapPartWait(const CGamePlayer *player, uint32_t Ticks) const;
+	uint32_t SendMapParts(CGamePlayer *player, uint32_t Ticks, uint32_t budget, void *send_fd);
 
 	// events
 	// note: these are only called while iterating through the m_Potentials or m_Players std::vectors
 	// therefore you can't modify those std::vectors and must use the player's m_DeleteMe member to flag for deletion
 
 	void EventPlayerDeleted(uint32_t Ticks, CGamePlayer *player);
+	void EventPotentialTimedOut(CPotentialPlayer *potential);
 	void EventPlayerDisconnectTimedOut(CGamePlayer *player);
 	void EventPlayerDisconnectSocketError(CGamePlayer *player);
 	void EventPlayerDisconnectConnectionClosed(CGamePlayer *player);
+	bool EventPlayerGProxyDisconnect(CGamePlayer *player);
+	void EventPlayerReconnectTimedOut(CGamePlayer *player);
 	void EventPlayerJoined(CPotentialPlayer *potential, CIncomingJoinPlayer *joinPlayer);
 	void EventPlayerLeft(CGamePlayer *player, uint32_t reason);
 	void EventPlayerLoaded(CGamePlayer *player);
 	void EventPlayerAction(CGamePlayer *player, CIncomingAction *action);
-	void EventPlayerKeepAlive(CGamePlayer *player);
+	bool AdmitAction(uint32_t Ticks, CGamePlayer *player, CIncomingAction *action);
+	void EventPlayerKeepAlive(CGamePlayer *player, uint32_t checkSum);
 	void EventPlayerChatToHost(CGamePlayer *player, CIncomingChatPlayer *chatPlayer);
 	void EventPlayerChangeTeam(CGamePlayer *player, uint8_t team);
 	void EventPlayerChangeColour(CGamePlayer *player, uint8_t colour);
@@ -177,11 +345,15 @@ public:
 	// these events are called outside of any iterations
 
 	void EventGameStarted(uint32_t Ticks);
+	bool EventPlayerReconnected(CGamePlayer *player, CTCPSocket *socket, uint32_t lastPacket);
 
 	// other functions
 
 	void DeletePlayer(CGamePlayer* player, uint32_t nLeftCode);
+	void IndexSlots() const;
 	uint8_t GetSIDFromPID(uint8_t PID) const;
+	CGamePlayer *GetPlayerFromPID(uint8_t PID) const;
+	CSpectatorFeed *ReleaseSpectatorFeed();
 	uint8_t GetNewPID();
 	uint8_t GetNewColour();
 	BYTEARRAY GetPIDs();
@@ -192,6 +364,14 @@ public:
 	void ColourSlot(uint8_t SID, uint8_t colour);
 	void StartCountDown();
 	void StopLaggers();
+	std::vector<std::pair<uint8_t, uint32_t>> GetLoadingLags(uint32_t Ticks) const;
+	bool GetSlowConsumer(uint32_t Ticks, CGamePlayer *player) const;
+	void CheckSendQueues(uint32_t Ticks);
+	void UpdateLatency();
+	void LogNetStats();
+	bool AdmitConnection(uint32_t Ticks, CTCPSocket *socket);
+	void SetPlayerTimeouts();
+	void CheckSumFrames();
 	void CreateVirtualHost();
 	void DeleteVirtualHost();
 };
@@ -20,9 +20,17 @@ CODE PORTED FROM THE ORIGINAL GHOST PROJECT: http://ghost.pwner.org/
 
 #include "gameplayer.h"
 #include "gameprotocol.h"
+#include "gpsprotocol.h"
 #include "game.h"
+#include "download.h"
 #include "util.h"
 
+#include <algorithm>
+#include <cstdlib>
+
+uint32_t GetTicks();
+void Print(const std::string &message);
+
 //
 // CPotentialPlayer
 //
@@ -32,6 +40,7 @@ CPotentialPlayer::CPotentialPlayer(CGameProtocol *nProtocol, CGame *nGame, CTCPS
 	m_Game(nGame),
 	m_Socket(nSocket),
 	m_IncomingJoinPlayer(nullptr),
+	m_ConnectTicks(GetTicks()),
 	m_DeleteMe(false)
 {
 
@@ -45,7 +54,7 @@ CPotentialPlayer::~CPotentialPlayer()
 	delete m_IncomingJoinPlayer;
 }
 
-bool CPotentialPlayer::Update(void *fd)
+bool CPotentialPlayer::Update(uint32_t Ticks, void *fd)
 {
 	if (m_DeleteMe)
 		return true;
@@ -53,6 +62,15 @@ bool CPotentialPlayer::Update(void *fd)
 	if (!m_Socket)
 		return false;
 
+	// a real client sends W3GS_REQJOIN right after connecting, anything that hasn't by now is most likely a port scanner or a stuck connection
+	// this is measured from the connect time rather than the last receive so trickling bytes doesn't keep a connection alive
+
+	if (Ticks - m_ConnectTicks >= m_Game->GetHandshakeTimeout())
+	{
+		m_Game->EventPotentialTimedOut(this);
+		return true;
+	}
+
 	m_Socket->DoRecv((fd_set *)fd);
 
 	// extract as many packets as possible from the socket's receive buffer and process them
@@ -70,10 +88,17 @@ bool CPotentialPlayer::Update(void *fd)
 			// bytes 2 and 3 contain the length of the packet
 
 			const uint16_t Length = ByteArrayToUInt16(Bytes, 2);
-			const BYTEARRAY Data = BYTEARRAY(begin(Bytes), begin(Bytes) + Length);
+
+			if (Length < 4)
+			{
+				m_DeleteMe = true;
+				break;
+			}
 
 			if (Bytes.size() >= Length)
 			{
+				const BYTEARRAY Data = BYTEARRAY(begin(Bytes), begin(Bytes) + Length);
+
 				if (Bytes[0] == W3GS_HEADER_CONSTANT && Bytes[1] == CGameProtocol::W3GS_REQJOIN)
 				{
 					delete m_IncomingJoinPlayer;
@@ -95,6 +120,13 @@ bool CPotentialPlayer::Update(void *fd)
 			else
 				break;
 		}
+		else
+		{
+			// this isn't a Warcraft III client, without this we would spin on the same bytes forever
+
+			m_DeleteMe = true;
+			break;
+		}
 	}
 
 	*RecvBuffer = RecvBuffer->substr(LengthProcessed);
@@ -120,45 +152,102 @@ CGamePlayer::CGamePlayer(CPotentialPlayer *potential, uint8_t nPID, const std::s
 	m_Game(potential->m_Game),
 	m_Socket(potential->GetSocket()),
 	m_InternalIP(nInternalIP),
+	m_TCPInfo(),
+	m_NumPings(0),
+	m_MinPing(0),
+	m_Ping(0),
+	m_PingJitter(0),
 	m_Name(nName),
 	m_LeftCode(PLAYERLEAVE_LOBBY),
 	m_SyncCounter(0),
 	m_LastMapPartSent(0),
 	m_LastMapPartAcked(0),
+	m_DownloadPacer(nullptr),
 	m_StartedLaggingTicks(0),
+	m_FinishedLoadingTicks(0),
+	m_GameDataNext(0),
+	m_TotalPacketsSent(0),
+	m_TotalPacketsReceived(1),
+	m_ReconnectKey(rand()),
+	m_DisconnectedTicks(0),
+	m_LastGProxyAckTicks(0),
+	m_DeferredActionBytes(0),
+	m_TotalDeferredActions(0),
+	m_IntervalActions(0),
 	m_PID(nPID),
 	m_DownloadStarted(false),
 	m_DownloadFinished(false),
 	m_FinishedLoading(false),
 	m_Lagging(false),
 	m_DropVote(false),
+	m_GProxy(false),
+	m_Disconnected(false),
 	m_DeleteMe(false)
 {
-
+	// m_TotalPacketsReceived starts at 1 because the W3GS_REQJOIN was received by the CPotentialPlayer but GProxy++ counts it too
 }
 
 CGamePlayer::~CGamePlayer()
 {
 	delete m_Socket;
+	delete m_DownloadPacer;
+
+	while (!m_DeferredActions.empty())
+	{
+		delete m_DeferredActions.front();
+		m_DeferredActions.pop();
+	}
 }
 
 bool CGamePlayer::Update(uint32_t Ticks, void *fd)
 {
+	// a GProxy++ player that lost their connection has no socket to read from until they reconnect
+
+	if (m_Disconnected)
+	{
+		if (Ticks - m_DisconnectedTicks >= m_Game->GetReconnectWaitTime())
+			m_Game->EventPlayerReconnectTimedOut(this);
+
+		return m_DeleteMe;
+	}
+
 	// check for socket timeouts
-	// if we don't receive anything from a player for 30 seconds we can assume they've dropped
-	// this works because in the lobby we send pings every 5 seconds and expect a response to each one
-	// and in the game the Warcraft 3 client sends keepalives frequently (at least once per second it looks like)
+	// if we don't receive anything from a player for a while we can assume they've dropped
+	// this works because we send pings regularly (every second in the game) and expect a response to each one
+	// and in the game the Warcraft 3 client also sends a keepalive for every action packet
+	// the timeout depends on the phase of the game, see CGame::GetPlayerTimeout
 
-	if (Ticks - m_Socket->GetLastRecv() >= 30000)
+	const uint32_t Timeout = m_Game->GetPlayerTimeout();
+
+	if (Ticks - m_Socket->GetLastRecv() >= Timeout)
 	{
-		// not only do we not do any timeouts if the game is lagging, we allow for an additional grace period of 10 seconds
-		// this is because Warcraft 3 stops sending packets during the lag screen
+		// we allow for an additional grace period after the lag screen because Warcraft 3 stops sending packets during the lag screen
 		// so when the lag screen finishes we would immediately disconnect everyone if we didn't give them some extra time
+		// this doesn't apply to the players we're waiting for, a lagging player that's still around keeps sending keepalives while catching up
+		// and if the kernel still sees acknowledgements from them their machine is alive, so only drop them when it doesn't
+
+		if (m_Lagging)
+		{
+			CTCPInfo TCPInfo;
 
-		if (Ticks - m_Game->GetLastLagScreenTicks() >= 10000)
+			if (!m_Socket->GetTCPInfo(TCPInfo) || TCPInfo.LastAckRecv >= Timeout)
+				m_Game->EventPlayerDisconnectTimedOut(this);
+		}
+		else if (Ticks - m_Game->GetLastLagScreenTicks() >= m_Game->GetLagScreenGrace())
 		{
 			m_Game->EventPlayerDisconnectTimedOut(this);
 		}
+
+		if (m_Disconnected)
+			return m_DeleteMe;
+	}
+
+	// acknowledge what we received from a GProxy++ player every 10 seconds so it can forget about it
+
+	if (m_GProxy && m_Game->GetGameLoaded() && Ticks - m_LastGProxyAckTicks >= 10000)
+	{
+		m_Socket->PutBytes(m_Game->GetGPSProtocol()->SEND_GPSS_ACK(m_TotalPacketsReceived));
+		m_LastGProxyAckTicks = Ticks;
 	}
 
 	m_Socket->DoRecv((fd_set *)fd);
@@ -180,12 +269,20 @@ bool CGamePlayer::Update(uint32_t Ticks, void *fd)
 		// bytes 2 and 3 contain the length of the packet
 
 		const uint16_t Length = ByteArrayToUInt16(Bytes, 2);
-		const BYTEARRAY Data = BYTEARRAY(begin(Bytes), begin(Bytes) + Length);
+
+		if (Length < 4)
+		{
+			m_Game->DeletePlayer(this, PLAYERLEAVE_DISCONNECT);
+			break;
+		}
 
 		if (Bytes[0] == W3GS_HEADER_CONSTANT)
 		{
 			if (Bytes.size() >= Length)
 			{
+				const BYTEARRAY Data = BYTEARRAY(begin(Bytes), begin(Bytes) + Length);
+				++m_TotalPacketsReceived;
+
 				// byte 1 contains the packet ID
 
 				switch (Bytes[1])
@@ -200,6 +297,7 @@ bool CGamePlayer::Update(uint32_t Ticks, void *fd)
 						if (!m_FinishedLoading)
 						{
 							m_FinishedLoading = true;
+							m_FinishedLoadingTicks = Ticks;
 							m_Game->EventPlayerLoaded(this);
 						}
 					}
@@ -217,9 +315,8 @@ bool CGamePlayer::Update(uint32_t Ticks, void *fd)
 					break;
 
 				case CGameProtocol::W3GS_OUTGOING_KEEPALIVE:
-					m_CheckSums.push(m_Protocol->RECEIVE_W3GS_OUTGOING_KEEPALIVE(Data));
 					++m_SyncCounter;
-					m_Game->EventPlayerKeepAlive(this);
+					m_Game->EventPlayerKeepAlive(this, m_Protocol->RECEIVE_W3GS_OUTGOING_KEEPALIVE(Data));
 					break;
 
 				case CGameProtocol::W3GS_CHAT_TO_HOST:
@@ -250,7 +347,52 @@ bool CGamePlayer::Update(uint32_t Ticks, void *fd)
 					break;
 
 				case CGameProtocol::W3GS_PONG_TO_HOST:
-					m_Protocol->RECEIVE_W3GS_PONG_TO_HOST(Data);
+				{
+					// the very first pong seems to be 1 so discard it, see RECEIVE_W3GS_PONG_TO_HOST
+
+					const uint32_t Pong = m_Protocol->RECEIVE_W3GS_PONG_TO_HOST(Data);
+
+					if (Pong != 1 && Ticks >= Pong)
+						AddPing(Ticks - Pong);
+
+					break;
+				}
+				}
+
+				LengthProcessed += Length;
+				Bytes = BYTEARRAY(begin(Bytes) + Length, end(Bytes));
+			}
+			else
+				break;
+		}
+		else if (Bytes[0] == GPS_HEADER_CONSTANT)
+		{
+			if (Bytes.size() >= Length)
+			{
+				const BYTEARRAY Data = BYTEARRAY(begin(Bytes), begin(Bytes) + Length);
+				uint32_t LastPacket;
+
+				switch (Bytes[1])
+				{
+				case CGPSProtocol::GPS_INIT:
+					if (m_Game->GetReconnectPort() != 0 && m_Game->GetGPSProtocol()->RECEIVE_GPSC_INIT(Data))
+					{
+						m_GProxy = true;
+						m_Socket->PutBytes(m_Game->GetGPSProtocol()->SEND_GPSS_INIT(m_Game->GetReconnectPort(), m_PID, m_ReconnectKey, 0));
+						Print("[GAME: " + m_Game->GetGameName() + "] player [" + m_Name + "] is using GProxy++");
+					}
+
+					break;
+
+				case CGPSProtocol::GPS_ACK:
+					// the player received everything up to LastPacket so we don't have to replay it anymore
+
+					if (m_Game->GetGPSProtocol()->RECEIVE_GPSC_ACK(Data, LastPacket))
+					{
+						while (!m_GameDataSent.empty() && m_GameDataSent.front().first < LastPacket)
+							m_GameDataSent.pop_front();
+					}
+
 					break;
 				}
 
@@ -260,13 +402,21 @@ bool CGamePlayer::Update(uint32_t Ticks, void *fd)
 			else
 				break;
 		}
+		else
+		{
+			// this isn't Warcraft III or GProxy++ talking, without this we would spin on the same bytes forever
+
+			m_Game->DeletePlayer(this, PLAYERLEAVE_DISCONNECT);
+			break;
+		}
 	}
 
 	*RecvBuffer = RecvBuffer->substr(LengthProcessed);
 
 	// try to find out why we're requesting deletion
+	// a GProxy++ player who lost their connection during the game is kept around, see CGame::EventPlayerGProxyDisconnect
 
-	if (m_Socket)
+	if (m_Socket && !m_DeleteMe)
 	{
 		if (m_Socket->HasError())
 		{
@@ -280,10 +430,128 @@ bool CGamePlayer::Update(uint32_t Ticks, void *fd)
 		}
 	}
 
-	return m_DeleteMe || m_Socket->HasError() || !m_Socket->GetConnected();
+	return m_DeleteMe || (!m_Disconnected && (m_Socket->HasError() || !m_Socket->GetConnected()));
 }
 
 void CGamePlayer::Send(const BYTEARRAY &data)
 {
+	// whatever we send while a GProxy++ player is disconnected never reaches them and isn't counted, game data is replayed from the game's history instead
+
+	if (m_Disconnected)
+		return;
+
+	++m_TotalPacketsSent;
 	m_Socket->PutBytes(data);
 }
+
+void CGamePlayer::SendGameData(const BYTEARRAY &data, uint32_t seq)
+{
+	if (m_Disconnected)
+		return;
+
+	if (m_GProxy)
+		m_GameDataSent.push_back(std::make_pair(m_TotalPacketsSent, seq));
+
+	m_GameDataNext = seq + 1;
+	Send(data);
+}
+
+void CGamePlayer::PruneGameData(uint32_t firstSeq)
+{
+	// the game no longer has these packets so there's no point in remembering when we sent them
+
+	while (!m_GameDataSent.empty() && m_GameDataSent.front().second < firstSeq)
+		m_GameDataSent.pop_front();
+}
+
+uint32_t CGamePlayer::GetResumeSeq(uint32_t lastPacket)
+{
+	// the player received every packet numbered below lastPacket, the first game data packet after that is where we resume
+
+	while (!m_GameDataSent.empty() && m_GameDataSent.front().first < lastPacket)
+		m_GameDataSent.pop_front();
+
+	return m_GameDataSent.empty() ? m_GameDataNext : m_GameDataSent.front().second;
+}
+
+void CGamePlayer::SetDisconnected(uint32_t Ticks)
+{
+	m_Disconnected = true;
+	m_DisconnectedTicks = Ticks;
+	m_Socket->Reset();
+}
+
+void CGamePlayer::Reconnect(CTCPSocket *socket, uint32_t lastPacket)
+{
+	// GProxy++ numbers the packets it receives from the start of the connection so carry on from where it left off
+	// the caller replays the game data the player missed, which records it again under the new packet numbers
+
+	delete m_Socket;
+	m_Socket = socket;
+	m_Disconnected = false;
+	m_TotalPacketsSent = lastPacket;
+	m_GameDataSent.clear();
+	m_LastGProxyAckTicks = GetTicks();
+	m_Socket->PutBytes(m_Game->GetGPSProtocol()->SEND_GPSS_RECONNECT(m_TotalPacketsReceived));
+	SetTimeout(m_Game->GetPlayerTimeout());
+}
+
+void CGamePlayer::DeferAction(CIncomingAction *action)
+{
+	m_DeferredActions.push(action);
+	m_DeferredActionBytes += action->GetLength();
+	++m_TotalDeferredActions;
+}
+
+CIncomingAction *CGamePlayer::UndeferAction()
+{
+	CIncomingAction *Action = m_DeferredActions.front();
+	m_DeferredActions.pop();
+	m_DeferredActionBytes -= Action->GetLength();
+	return Action;
+}
+
+void CGamePlayer::AddPing(uint32_t ping)
+{
+	if (m_NumPings == 0)
+	{
+		m_MinPing = ping;
+		m_Ping = ping;
+		m_PingJitter = ping / 2;
+	}
+	else
+	{
+		const uint32_t Deviation = ping > m_Ping ? ping - m_Ping : m_Ping - ping;
+
+		if (ping < m_MinPing)
+			m_MinPing = ping;
+
+		m_PingJitter = (3 * m_PingJitter + Deviation) / 4;
+		m_Ping = (7 * m_Ping + ping) / 8;
+	}
+
+	++m_NumPings;
+}
+
+void CGamePlayer::SetTimeout(uint32_t timeout)
+{
+	// let the kernel give up on the connection at about the same time we would
+	// keepalive probes start after half the timeout without any traffic and are sent every second after that
+
+	const uint32_t Half = std::max<uint32_t>(timeout / 2000, 1);
+
+	m_Socket->SetUserTimeout(timeout);
+	m_Socket->SetKeepAlive(true, Half, 1, Half);
+}
+
+void CGamePlayer::SampleTCPInfo()
+{
+	if (m_Socket)
+		m_Socket->GetTCPInfo(m_TCPInfo);
+}
+
+void CGamePlayer::SetDownloadPacer(CDownloadPacer *pacer)
+{
+	delete m_DownloadPacer;
+	m_DownloadPacer = pacer;
+}
@@ -23,11 +23,14 @@ CODE PORTED FROM THE ORIGINAL GHOST PROJECT: http://ghost.pwner.org/
 
 #include "socket.h"
 #include <queue>
+#include <deque>
 
 class CTCPSocket;
 class CGameProtocol;
 class CGame;
 class CIncomingJoinPlayer;
+class CIncomingAction;
+class CDownloadPacer;
 
 //
 // CPotentialPlayer
@@ -45,6 +48,7 @@ protected:
 
 	CTCPSocket *m_Socket;
 	CIncomingJoinPlayer *m_IncomingJoinPlayer;
+	uint32_t m_ConnectTicks;                      // GetTicks when the connection was accepted, the handshake has to finish within bot_handshaketimeout of this
 	bool m_DeleteMe;
 
 public:
@@ -62,7 +66,7 @@ public:
 
 	// processing functions
 
-	bool Update(void *fd);
+	bool Update(uint32_t Ticks, void *fd);
 
 	// other functions
 
@@ -84,19 +88,39 @@ protected:
 
 private:
 	uint32_t m_InternalIP;                    // the player's internal IP address as reported by the player when connecting
-	std::queue<uint32_t> m_CheckSums;         // the last few checksums the player has sent (for detecting desyncs)
+	CTCPInfo m_TCPInfo;                       // the last TCP_INFO sample taken from the player's socket
+	uint32_t m_NumPings;                      // the number of round trips measured from W3GS_PONG_TO_HOST
+	uint32_t m_MinPing;                       // the lowest round trip time seen so far
+	uint32_t m_Ping;                          // smoothed round trip time (EWMA with a gain of 1/8, like TCP's srtt)
+	uint32_t m_PingJitter;                    // smoothed deviation of the round trip time (EWMA with a gain of 1/4, like TCP's rttvar)
 	std::string m_Name;                       // the player's name
 	uint32_t m_LeftCode;                      // the code to be sent in W3GS_PLAYERLEAVE_OTHERS for why this player left the game
 	uint32_t m_SyncCounter;                   // the number of keepalive packets received from this player
 	uint32_t m_LastMapPartSent;               // the last mappart sent to the player (for sending more than one part at a time)
 	uint32_t m_LastMapPartAcked;              // the last mappart acknowledged by the player
+	CDownloadPacer *m_DownloadPacer;          // decides when the next mappart is sent (nullptr unless the player is downloading the map)
 	uint32_t m_StartedLaggingTicks;           // GetTicks when the player started laggin
+	uint32_t m_FinishedLoadingTicks;          // GetTicks when the player finished loading
+	std::queue<BYTEARRAY> m_LoadInGameData;   // game data buffered while the player is still loading with bot_loadingame, sent once they finish
+	std::deque<std::pair<uint32_t, uint32_t>> m_GameDataSent; // (packet number, game data sequence number) of every game data packet sent to a GProxy++ player that they haven't acknowledged yet
+	uint32_t m_GameDataNext;                  // the sequence number of the next game data packet this player should get
+	uint32_t m_TotalPacketsSent;              // the number of W3GS packets sent to the player, GProxy++ acknowledges and resumes by this count
+	uint32_t m_TotalPacketsReceived;          // the number of W3GS packets received from the player
+	uint32_t m_ReconnectKey;                  // the key a GProxy++ player has to present when reconnecting
+	uint32_t m_DisconnectedTicks;             // GetTicks when a GProxy++ player lost their connection
+	uint32_t m_LastGProxyAckTicks;            // GetTicks when the last GPS_ACK was sent
+	std::queue<CIncomingAction *> m_DeferredActions; // actions over the player's action budget, relayed in later action packets
+	uint32_t m_DeferredActionBytes;           // the size of everything in m_DeferredActions
+	uint32_t m_TotalDeferredActions;          // the number of actions that had to wait for a later action packet
+	uint32_t m_IntervalActions;               // the number of actions queued for the next action packet
 	uint8_t m_PID;                            // the player's PID
 	bool m_DownloadStarted;                   // if we've started downloading the map or not
 	bool m_DownloadFinished;                  // if we've finished downloading the map or not
 	bool m_FinishedLoading;                   // if the player has finished loading or not
 	bool m_Lagging;                           // if the player is lagging or not (on the lag screen)
 	bool m_DropVote;                          // if the player voted to drop the laggers or not (on the lag screen)
+	bool m_GProxy;                            // if the player is using GProxy++ and can reconnect
+	bool m_Disconnected;                      // if a GProxy++ player lost their connection and we're waiting for them to reconnect
 
 protected:
 	bool m_DeleteMe;
@@ -112,17 +136,32 @@ public:
 	inline uint8_t GetPID() const                                       { return m_PID; }
 	inline std::string GetName() const                                  { return m_Name; }
 	inline uint32_t GetInternalIP() const                               { return m_InternalIP; }
-	inline std::queue<uint32_t> *GetCheckSums()                         { return &m_CheckSums; }
 	inline uint32_t GetLeftCode() const                                 { return m_LeftCode; }
 	inline uint32_t GetSyncCounter() const                              { return m_SyncCounter; }
 	inline uint32_t GetLastMapPartSent() const                          { return m_LastMapPartSent; }
 	inline uint32_t GetLastMapPartAcked() const                         { return m_LastMapPartAcked; }
+	inline CDownloadPacer *GetDownloadPacer() const                     { return m_DownloadPacer; }
 	inline uint32_t GetStartedLaggingTicks() const                      { return m_StartedLaggingTicks; }
+	inline uint32_t GetFinishedLoadingTicks() const                     { return m_FinishedLoadingTicks; }
+	inline std::queue<BYTEARRAY> *GetLoadInGameData()                   { return &m_LoadInGameData; }
 	inline bool GetDownloadStarted() const                              { return m_DownloadStarted; }
 	inline bool GetDownloadFinished() const                             { return m_DownloadFinished; }
 	inline bool GetFinishedLoading() const                              { return m_FinishedLoading; }
 	inline bool GetLagging() const                                      { return m_Lagging; }
 	inline bool GetDropVote() const                                     { return m_DropVote; }
+	inline uint32_t GetNumPings() const                                 { return m_NumPings; }
+	inline uint32_t GetMinPing() const                                  { return m_MinPing; }
+	inline uint32_t GetPing() const                                     { return m_Ping; }
+	inline uint32_t GetPingJitter() const                               { return m_PingJitter; }
+	inline const CTCPInfo &GetTCPInfo() const                           { return m_TCPInfo; }
+	inline bool GetGProxy() const                                       { return m_GProxy; }
+	inline bool GetDisconnected() const                                 { return m_Disconnected; }
+	inline uint32_t GetReconnectKey() const                             { return m_ReconnectKey; }
+	inline uint32_t GetDisconnectedTicks() const                        { return m_DisconnectedTicks; }
+	inline std::queue<CIncomingAction *> *GetDeferredActions()          { return &m_DeferredActions; }
+	inline uint32_t GetDeferredActionBytes() const                      { return m_DeferredActionBytes; }
+	inline uint32_t GetTotalDeferredActions() const                     { return m_TotalDeferredActions; }
+	inline uint32_t GetIntervalActions() const                          { return m_IntervalActions; }
 
 	inline void SetSocket(CTCPSocket *nSocket)                                           { m_Socket = nSocket; }
 	inline void SetDeleteMe(bool nDeleteMe)                                              { m_DeleteMe = nDeleteMe; }
@@ -135,6 +174,8 @@ public:
 	inline void SetDownloadFinished(bool nDownloadFinished)                              { m_DownloadFinished = nDownloadFinished; }
 	inline void SetLagging(bool nLagging)                                                { m_Lagging = nLagging; }
 	inline void SetDropVote(bool nDropVote)                                              { m_DropVote = nDropVote; }
+	inline void AddLoadInGameData(const BYTEARRAY &data)                                 { m_LoadInGameData.push(data); }
+	inline void SetIntervalActions(uint32_t nIntervalActions)                            { m_IntervalActions = nIntervalActions; }
 
 	// processing functions
 
@@ -143,6 +184,17 @@ public:
 	// other functions
 
 	void Send(const BYTEARRAY &data);
+	void SendGameData(const BYTEARRAY &data, uint32_t seq);
+	void PruneGameData(uint32_t firstSeq);
+	uint32_t GetResumeSeq(uint32_t lastPacket);
+	void SetDisconnected(uint32_t Ticks);
+	void Reconnect(CTCPSocket *socket, uint32_t lastPacket);
+	void DeferAction(CIncomingAction *action);
+	CIncomingAction *UndeferAction();
+	void AddPing(uint32_t ping);
+	void SetTimeout(uint32_t timeout);
+	void SampleTCPInfo();
+	void SetDownloadPacer(CDownloadPacer *pacer);
 };
 
 #endif  // AURA_GAMEPLAYER_H_
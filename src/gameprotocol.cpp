@@ -22,6 +22,7 @@ CODE PORTED FROM THE ORIGINAL GHOST PROJECT: http://ghost.pwner.org/
 #include "util.h"
 #include "crc32.h"
 #include "gameslot.h"
+#include "map.h"
 
 void Print(const std::string &message);
 
@@ -244,6 +245,25 @@ uint32_t CGameProtocol::RECEIVE_W3GS_PONG_TO_HOST(const BYTEARRAY &data)
 	return 1;
 }
 
+uint32_t CGameProtocol::RECEIVE_W3GS_SEARCHGAME(const BYTEARRAY &data)
+{
+	// DEBUG_Print( "RECEIVED W3GS_SEARCHGAME" );
+	// DEBUG_Print( data );
+
+	// 2 bytes					-> Header
+	// 2 bytes					-> Length
+	// 4 bytes					-> Product ID ("PX3W" for TFT, "3RAW" for ROC)
+	// 4 bytes					-> Version
+	// 4 bytes					-> ??? (always zero)
+
+	// returns the version the client is looking for or zero if the packet is malformed
+
+	if (data.size() >= 16 && data[0] == W3GS_HEADER_CONSTANT && data[1] == W3GS_SEARCHGAME && ValidateLength(data))
+		return ByteArrayToUInt32(data, 8);
+
+	return 0;
+}
+
 ////////////////////
 // SEND FUNCTIONS //
 ////////////////////
@@ -255,17 +275,16 @@ BYTEARRAY CGameProtocol::SEND_W3GS_PING_FROM_HOST(uint32_t ticks)
 	return packet;
 }
 
-BYTEARRAY CGameProtocol::SEND_W3GS_SLOTINFOJOIN(uint8_t PID, uint16_t port, uint32_t externalIP, const std::vector<CGameSlot> &slots, uint32_t randomSeed, uint8_t layoutStyle, uint8_t playerSlots)
+BYTEARRAY CGameProtocol::SEND_W3GS_SLOTINFOJOIN(uint8_t PID, uint16_t port, uint32_t externalIP, const BYTEARRAY &slotInfo)
 {
 	BYTEARRAY packet;
 	const uint8_t Zeros[] = { 0, 0, 0, 0 };
-	const BYTEARRAY SlotInfo = EncodeSlotInfo(slots, randomSeed, layoutStyle, playerSlots);
 	packet.push_back(W3GS_HEADER_CONSTANT);   // W3GS header constant
 	packet.push_back(W3GS_SLOTINFOJOIN);   // W3GS_SLOTINFOJOIN
 	packet.push_back(0);   // packet length will be assigned later
 	packet.push_back(0);   // packet length will be assigned later
-	AppendByteArray(packet, (uint16_t)SlotInfo.size());    // SlotInfo length
-	AppendByteArray(packet, SlotInfo);   // SlotInfo
+	AppendByteArray(packet, (uint16_t)slotInfo.size());    // SlotInfo length
+	AppendByteArray(packet, slotInfo);   // SlotInfo
 	packet.push_back(PID);   // PID
 	packet.push_back(2);   // AF_INET
 	packet.push_back(0);   // AF_INET continued...
@@ -347,14 +366,13 @@ BYTEARRAY CGameProtocol::SEND_W3GS_GAMELOADED_OTHERS(uint8_t PID)
 	return BYTEARRAY();
 }
 
-BYTEARRAY CGameProtocol::SEND_W3GS_SLOTINFO(const std::vector<CGameSlot> &slots, uint32_t randomSeed, uint8_t layoutStyle, uint8_t playerSlots)
+BYTEARRAY CGameProtocol::SEND_W3GS_SLOTINFO(const BYTEARRAY &slotInfo)
 {
-	const BYTEARRAY SlotInfo = EncodeSlotInfo(slots, randomSeed, layoutStyle, playerSlots);
-	const uint16_t SlotInfoSize = (uint16_t)SlotInfo.size();
+	const uint16_t SlotInfoSize = (uint16_t)slotInfo.size();
 
 	BYTEARRAY packet = { W3GS_HEADER_CONSTANT, W3GS_SLOTINFO, 0, 0 };
 	AppendByteArray(packet, SlotInfoSize); // SlotInfo length
-	AppendByteArray(packet, SlotInfo);        // SlotInfo
+	AppendByteArray(packet, slotInfo);        // SlotInfo
 	AssignLength(packet);
 	return packet;
 }
@@ -489,22 +507,27 @@ BYTEARRAY CGameProtocol::SEND_W3GS_GAMEINFO(uint8_t war3Version, uint32_t mapGam
 	return BYTEARRAY();
 }
 
-BYTEARRAY CGameProtocol::SEND_W3GS_CREATEGAME(uint8_t war3Version)
+BYTEARRAY CGameProtocol::SEND_W3GS_CREATEGAME(uint8_t war3Version, uint32_t hostCounter)
 {
-	return BYTEARRAY{ W3GS_HEADER_CONSTANT, W3GS_CREATEGAME, 16, 0, 80, 88, 51, 87, war3Version, 0, 0, 0, 1, 0, 0, 0 };
+	BYTEARRAY packet = { W3GS_HEADER_CONSTANT, W3GS_CREATEGAME, 16, 0, 80, 88, 51, 87, war3Version, 0, 0, 0 };
+	AppendByteArray(packet, hostCounter);  // Host Counter
+	return packet;
 }
 
-BYTEARRAY CGameProtocol::SEND_W3GS_REFRESHGAME(uint32_t players, uint32_t playerSlots)
+BYTEARRAY CGameProtocol::SEND_W3GS_REFRESHGAME(uint32_t hostCounter, uint32_t players, uint32_t playerSlots)
 {
-	BYTEARRAY packet = { W3GS_HEADER_CONSTANT, W3GS_REFRESHGAME, 16, 0, 1, 0, 0, 0 };
+	BYTEARRAY packet = { W3GS_HEADER_CONSTANT, W3GS_REFRESHGAME, 16, 0 };
+	AppendByteArray(packet, hostCounter);  // Host Counter
 	AppendByteArray(packet, players);      // Players
 	AppendByteArray(packet, playerSlots);  // Player Slots
 	return packet;
 }
 
-BYTEARRAY CGameProtocol::SEND_W3GS_DECREATEGAME()
+BYTEARRAY CGameProtocol::SEND_W3GS_DECREATEGAME(uint32_t hostCounter)
 {
-	return BYTEARRAY{ W3GS_HEADER_CONSTANT, W3GS_DECREATEGAME, 8, 0, 1, 0, 0, 0 };
+	BYTEARRAY packet = { W3GS_HEADER_CONSTANT, W3GS_DECREATEGAME, 8, 0 };
+	AppendByteArray(packet, hostCounter);  // Host Counter
+	return packet;
 }
 
 BYTEARRAY CGameProtocol::SEND_W3GS_MAPCHECK(const std::string &mapPath, uint32_t mapSize, uint32_t mapInfo, uint32_t mapCRC, const std::array<uint8_t, 20>& mapSHA1)
@@ -530,35 +553,18 @@ BYTEARRAY CGameProtocol::SEND_W3GS_STARTDOWNLOAD(uint8_t fromPID)
 	return BYTEARRAY{ W3GS_HEADER_CONSTANT, W3GS_STARTDOWNLOAD, 9, 0, 1, 0, 0, 0, fromPID };
 }
 
-BYTEARRAY CGameProtocol::SEND_W3GS_MAPPART(uint8_t fromPID, uint8_t toPID, uint32_t start, const std::string *mapData)
+BYTEARRAY CGameProtocol::SEND_W3GS_MAPPART(uint8_t fromPID, uint8_t toPID, const uint8_t *header, const uint8_t *data, uint32_t length)
 {
-	if (start < mapData->size())
-	{
-		BYTEARRAY packet = { W3GS_HEADER_CONSTANT, W3GS_MAPPART, 0, 0, toPID, fromPID, 1, 0, 0, 0 };
-		AppendByteArray(packet, start);   // start position
+	// the header (including start position, length and crc) is prebuilt by CMap when the map is loaded
+	// only the PIDs differ between players
 
-		// calculate end position (don't send more than 1442 map bytes in one packet)
-
-		uint32_t End = start + 1442;
-
-		if (End > mapData->size())
-			End = mapData->size();
-
-		// calculate crc
-
-		const BYTEARRAY crc32 = CreateByteArray(CRC32((const uint8_t*)mapData->c_str() + start, End - start));
-		AppendByteArray(packet, crc32);
-
-		// map data
-
-		const BYTEARRAY data = CreateByteArray((const uint8_t *)mapData->c_str() + start, End - start);
-		AppendByteArray(packet, data);
-		AssignLength(packet);
-		return packet;
-	}
-
-	Print("[GAMEPROTO] invalid parameters passed to SEND_W3GS_MAPPART");
-	return BYTEARRAY();
+	BYTEARRAY packet;
+	packet.reserve(MAPPART_HEADER_SIZE + length);
+	packet.insert(end(packet), header, header + MAPPART_HEADER_SIZE);
+	packet.insert(end(packet), data, data + length);
+	packet[4] = toPID;
+	packet[5] = fromPID;
+	return packet;
 }
 
 BYTEARRAY CGameProtocol::SEND_W3GS_INCOMING_ACTION2(const std::vector<CIncomingAction *>& actions)
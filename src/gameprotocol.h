@@ -109,16 +109,17 @@ public:
 	CIncomingChatPlayer *RECEIVE_W3GS_CHAT_TO_HOST(const BYTEARRAY &data);
 	CIncomingMapSize *RECEIVE_W3GS_MAPSIZE(const BYTEARRAY &data);
 	uint32_t RECEIVE_W3GS_PONG_TO_HOST(const BYTEARRAY &data);
+	uint32_t RECEIVE_W3GS_SEARCHGAME(const BYTEARRAY &data);
 
 	// send functions
 
 	BYTEARRAY SEND_W3GS_PING_FROM_HOST(uint32_t ticks);
-	BYTEARRAY SEND_W3GS_SLOTINFOJOIN(uint8_t PID, uint16_t port, uint32_t externalIP, const std::vector<CGameSlot> &slots, uint32_t randomSeed, uint8_t layoutStyle, uint8_t playerSlots);
+	BYTEARRAY SEND_W3GS_SLOTINFOJOIN(uint8_t PID, uint16_t port, uint32_t externalIP, const BYTEARRAY &slotInfo);
 	BYTEARRAY SEND_W3GS_REJECTJOIN(uint32_t reason);
 	BYTEARRAY SEND_W3GS_PLAYERINFO(uint8_t PID, const std::string &name, uint32_t externalIP, uint32_t internalIP);
 	BYTEARRAY SEND_W3GS_PLAYERLEAVE_OTHERS(uint8_t PID, uint32_t leftCode);
 	BYTEARRAY SEND_W3GS_GAMELOADED_OTHERS(uint8_t PID);
-	BYTEARRAY SEND_W3GS_SLOTINFO(const std::vector<CGameSlot> &slots, uint32_t randomSeed, uint8_t layoutStyle, uint8_t playerSlots);
+	BYTEARRAY SEND_W3GS_SLOTINFO(const BYTEARRAY &slotInfo);
 	BYTEARRAY SEND_W3GS_COUNTDOWN_START();
 	BYTEARRAY SEND_W3GS_COUNTDOWN_END();
 	BYTEARRAY SEND_W3GS_INCOMING_ACTION(const std::vector<CIncomingAction *>& actions, uint16_t sendInterval);
@@ -127,18 +128,19 @@ public:
 	BYTEARRAY SEND_W3GS_START_LAG(const std::vector<std::pair<uint8_t, uint32_t>>& lags);
 	BYTEARRAY SEND_W3GS_STOP_LAG(uint8_t pid, uint32_t time);
 	BYTEARRAY SEND_W3GS_GAMEINFO(uint8_t war3Version, uint32_t mapGameType, uint32_t mapFlags, uint16_t mapWidth, uint16_t mapHeight, const std::string &gameName, const std::string &hostName, uint32_t upTime, const std::string &mapPath, uint32_t mapCRC, uint32_t slotsTotal, uint32_t slotsOpen, uint16_t port, uint32_t hostCounter, uint32_t entryKey);
-	BYTEARRAY SEND_W3GS_CREATEGAME(uint8_t war3Version);
-	BYTEARRAY SEND_W3GS_REFRESHGAME(uint32_t players, uint32_t playerSlots);
-	BYTEARRAY SEND_W3GS_DECREATEGAME();
+	BYTEARRAY SEND_W3GS_CREATEGAME(uint8_t war3Version, uint32_t hostCounter);
+	BYTEARRAY SEND_W3GS_REFRESHGAME(uint32_t hostCounter, uint32_t players, uint32_t playerSlots);
+	BYTEARRAY SEND_W3GS_DECREATEGAME(uint32_t hostCounter);
 	BYTEARRAY SEND_W3GS_MAPCHECK(const std::string &mapPath, uint32_t mapSize, uint32_t mapInfo, uint32_t mapCRC, const std::array<uint8_t, 20>& mapSHA1);
 	BYTEARRAY SEND_W3GS_STARTDOWNLOAD(uint8_t fromPID);
-	BYTEARRAY SEND_W3GS_MAPPART(uint8_t fromPID, uint8_t toPID, uint32_t start, const std::string *mapData);
+	BYTEARRAY SEND_W3GS_MAPPART(uint8_t fromPID, uint8_t toPID, const uint8_t *header, const uint8_t *data, uint32_t length);
 
 	// other functions
 
+	BYTEARRAY EncodeSlotInfo(const std::vector<CGameSlot> &slots, uint32_t randomSeed, uint8_t layoutStyle, uint8_t playerSlots);
+
 private:
 	bool ValidateLength(const BYTEARRAY &content);
-	BYTEARRAY EncodeSlotInfo(const std::vector<CGameSlot> &slots, uint32_t randomSeed, uint8_t layoutStyle, uint8_t playerSlots);
 };
 
 //
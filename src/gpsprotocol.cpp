@@ -0,0 +1,129 @@
+/*
+
+Copyright [2010] [Josko Nikolic]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+CODE PORTED FROM THE ORIGINAL GHOST PROJECT: http://ghost.pwner.org/
+
+*/
+
+#include "gpsprotocol.h"
+#include "util.h"
+
+//
+// CGPSProtocol
+//
+
+CGPSProtocol::CGPSProtocol()
+{
+
+}
+
+CGPSProtocol::~CGPSProtocol()
+{
+
+}
+
+///////////////////////
+// RECEIVE FUNCTIONS //
+///////////////////////
+
+bool CGPSProtocol::RECEIVE_GPSC_INIT(const BYTEARRAY &data)
+{
+	// 2 bytes                    -> Header
+	// 2 bytes                    -> Length
+	// 4 bytes                    -> Version
+
+	return ValidateLength(data) && data.size() == 8;
+}
+
+bool CGPSProtocol::RECEIVE_GPSC_RECONNECT(const BYTEARRAY &data, uint8_t &PID, uint32_t &reconnectKey, uint32_t &lastPacket)
+{
+	// 2 bytes                    -> Header
+	// 2 bytes                    -> Length
+	// 1 byte                     -> PID
+	// 4 bytes                    -> ReconnectKey
+	// 4 bytes                    -> LastPacket
+
+	if (ValidateLength(data) && data.size() == 13)
+	{
+		PID = data[4];
+		reconnectKey = ByteArrayToUInt32(data, 5);
+		lastPacket = ByteArrayToUInt32(data, 9);
+		return true;
+	}
+
+	return false;
+}
+
+bool CGPSProtocol::RECEIVE_GPSC_ACK(const BYTEARRAY &data, uint32_t &lastPacket)
+{
+	// 2 bytes                    -> Header
+	// 2 bytes                    -> Length
+	// 4 bytes                    -> LastPacket
+
+	if (ValidateLength(data) && data.size() == 8)
+	{
+		lastPacket = ByteArrayToUInt32(data, 4);
+		return true;
+	}
+
+	return false;
+}
+
+////////////////////
+// SEND FUNCTIONS //
+////////////////////
+
+BYTEARRAY CGPSProtocol::SEND_GPSS_INIT(uint16_t reconnectPort, uint8_t PID, uint32_t reconnectKey, uint8_t numEmptyActions)
+{
+	BYTEARRAY packet = { GPS_HEADER_CONSTANT, GPS_INIT, 12, 0 };
+	AppendByteArray(packet, reconnectPort);
+	packet.push_back(PID);
+	AppendByteArray(packet, reconnectKey);
+	packet.push_back(numEmptyActions);
+	return packet;
+}
+
+BYTEARRAY CGPSProtocol::SEND_GPSS_RECONNECT(uint32_t lastPacket)
+{
+	BYTEARRAY packet = { GPS_HEADER_CONSTANT, GPS_RECONNECT, 8, 0 };
+	AppendByteArray(packet, lastPacket);
+	return packet;
+}
+
+BYTEARRAY CGPSProtocol::SEND_GPSS_ACK(uint32_t lastPacket)
+{
+	BYTEARRAY packet = { GPS_HEADER_CONSTANT, GPS_ACK, 8, 0 };
+	AppendByteArray(packet, lastPacket);
+	return packet;
+}
+
+BYTEARRAY CGPSProtocol::SEND_GPSS_REJECT(uint32_t reason)
+{
+	BYTEARRAY packet = { GPS_HEADER_CONSTANT, GPS_REJECT, 8, 0 };
+	AppendByteArray(packet, reason);
+	return packet;
+}
+
+/////////////////////
+// OTHER FUNCTIONS //
+/////////////////////
+
+bool CGPSProtocol::ValidateLength(const BYTEARRAY &content)
+{
+	// verify that bytes 3 and 4 (indices 2 and 3) of the content array describe the length
+
+	return content.size() >= 4 && (uint16_t)(content[3] << 8 | content[2]) == content.size();
+}
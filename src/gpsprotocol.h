@@ -0,0 +1,70 @@
+/*
+
+Copyright [2010] [Josko Nikolic]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+CODE PORTED FROM THE ORIGINAL GHOST PROJECT: http://ghost.pwner.org/
+
+*/
+
+#ifndef AURA_GPSPROTOCOL_H_
+#define AURA_GPSPROTOCOL_H_
+
+#include <vector>
+#include <stdint.h>
+typedef std::vector<uint8_t> BYTEARRAY;
+
+//
+// CGPSProtocol
+//
+
+// the GProxy++ reconnect extension, its packets share the connection with W3GS but use their own header constant
+
+#define GPS_HEADER_CONSTANT       248
+
+#define REJECTGPS_INVALID           1
+#define REJECTGPS_NOTFOUND          2
+
+class CGPSProtocol
+{
+public:
+	enum Protocol
+	{
+		GPS_INIT = 1,
+		GPS_RECONNECT = 2,
+		GPS_ACK = 3,
+		GPS_REJECT = 4
+	};
+
+	explicit CGPSProtocol();
+	~CGPSProtocol();
+
+	// receive functions
+
+	bool RECEIVE_GPSC_INIT(const BYTEARRAY &data);
+	bool RECEIVE_GPSC_RECONNECT(const BYTEARRAY &data, uint8_t &PID, uint32_t &reconnectKey, uint32_t &lastPacket);
+	bool RECEIVE_GPSC_ACK(const BYTEARRAY &data, uint32_t &lastPacket);
+
+	// send functions
+
+	BYTEARRAY SEND_GPSS_INIT(uint16_t reconnectPort, uint8_t PID, uint32_t reconnectKey, uint8_t numEmptyActions);
+	BYTEARRAY SEND_GPSS_RECONNECT(uint32_t lastPacket);
+	BYTEARRAY SEND_GPSS_ACK(uint32_t lastPacket);
+	BYTEARRAY SEND_GPSS_REJECT(uint32_t reason);
+
+private:
+	bool ValidateLength(const BYTEARRAY &content);
+};
+
+#endif  // AURA_GPSPROTOCOL_H_
@@ -0,0 +1,78 @@
+/*
+
+Copyright [2010] [Josko Nikolic]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include "latency.h"
+
+#include <algorithm>
+
+//
+// CLatencyController
+//
+
+CLatencyController::CLatencyController(uint32_t nLatency, uint32_t nMinLatency, uint32_t nMaxLatency, uint32_t nMaxSyncLimit)
+	: m_Latency(nLatency),
+	m_MinLatency(std::max<uint32_t>(nMinLatency, 10)),
+	m_MaxLatency(std::max<uint32_t>(nMaxLatency, nMinLatency)),
+	m_SyncLimit(50),
+	m_SyncBudget(50 * nLatency),
+	m_MaxSyncLimit(nMaxSyncLimit)
+{
+	m_Latency = std::min(std::max(m_Latency, m_MinLatency), m_MaxLatency);
+	m_SyncLimit = std::min<uint32_t>(std::max<uint32_t>(m_SyncBudget / m_Latency, 10), m_MaxSyncLimit);
+}
+
+CLatencyController::~CLatencyController()
+{
+
+}
+
+bool CLatencyController::Update(uint32_t maxRTT, uint32_t maxBacklog)
+{
+	// the interval has to cover about half a round trip, otherwise the actions for the slowest player arrive in bursts and the game stutters
+	// below that we go as low as the configuration allows because a shorter interval means more responsive unit control
+
+	uint32_t Target = std::max(m_MinLatency, maxRTT / 2);
+
+	// if someone is already halfway to the lag screen sending actions faster only makes it worse, back off before it triggers
+
+	if (maxBacklog > m_SyncLimit / 2)
+		Target = std::max(Target, m_Latency + m_Latency / 4);
+
+	Target = std::min(Target, m_MaxLatency);
+
+	// raise quickly (half the distance at a time) but lower slowly (10 ms at a time) so one good ping doesn't cause a lag spike
+	// ignore changes smaller than 5 ms, they aren't noticeable and would only spam the log
+
+	uint32_t NewLatency = m_Latency;
+
+	if (Target >= m_Latency + 5)
+		NewLatency = m_Latency + std::max<uint32_t>((Target - m_Latency + 1) / 2, 5);
+	else if (Target + 5 <= m_Latency)
+		NewLatency = m_Latency - std::min<uint32_t>(m_Latency - Target, 10);
+
+	if (NewLatency == m_Latency)
+		return false;
+
+	m_Latency = NewLatency;
+
+	// players that are behind right now fell behind at the old interval
+	// make sure a higher latency (and therefore a lower sync limit) can't start the lag screen by itself
+
+	m_SyncLimit = std::min<uint32_t>(std::max<uint32_t>(std::max<uint32_t>(m_SyncBudget / m_Latency, 10), maxBacklog * 2), m_MaxSyncLimit);
+	return true;
+}
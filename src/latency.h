@@ -0,0 +1,58 @@
+/*
+
+Copyright [2010] [Josko Nikolic]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#ifndef AURA_LATENCY_H_
+#define AURA_LATENCY_H_
+
+#include <stdint.h>
+
+//
+// CLatencyController
+//
+
+// picks the action interval (latency) and the lag screen threshold (sync limit) for a running game
+// the sync limit is derived from a fixed time budget so the lag screen triggers after the same amount of time no matter what the latency is
+// the budget is taken from the configured latency with the classic limit of 50 keepalives
+// the sync limit never goes above the number of frames the game can keep checksums for, at a low latency the lag screen then triggers sooner
+
+class CLatencyController
+{
+private:
+	uint32_t m_Latency;                       // the current action interval in milliseconds
+	uint32_t m_MinLatency;                    // config value: the lowest interval we'll go down to
+	uint32_t m_MaxLatency;                    // config value: the highest interval we'll go up to
+	uint32_t m_SyncLimit;                     // the number of keepalives a player can fall behind before the lag screen starts
+	uint32_t m_SyncBudget;                    // the time in milliseconds a player can fall behind before the lag screen starts
+	uint32_t m_MaxSyncLimit;                  // the highest sync limit the game can handle
+
+public:
+	CLatencyController(uint32_t nLatency, uint32_t nMinLatency, uint32_t nMaxLatency, uint32_t nMaxSyncLimit);
+	~CLatencyController();
+
+	inline uint32_t GetLatency() const                  { return m_Latency; }
+	inline uint32_t GetSyncLimit() const                { return m_SyncLimit; }
+
+	// called about once a second while the game is running and nobody is on the lag screen
+	// maxRTT is the highest smoothed round trip time of all players (0 if nobody has answered a ping yet)
+	// maxBacklog is the highest number of keepalives any player is behind
+	// returns true if the latency changed
+
+	bool Update(uint32_t maxRTT, uint32_t maxBacklog);
+};
+
+#endif  // AURA_LATENCY_H_
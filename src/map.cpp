@@ -21,8 +21,13 @@ CODE PORTED FROM THE ORIGINAL GHOST PROJECT: http://ghost.pwner.org/
 #include "map.h"
 #include "config.h"
 #include "gameslot.h"
+#include "gameprotocol.h"
+#include "util.h"
+#include "crc32.h"
+#include "mappedfile.h"
 #include <string>
 #include <sstream>
+#include <algorithm>
 
 void Print(const std::string &message);
 
@@ -88,9 +93,18 @@ bool ConfigRead(CConfig* cfg, const std::string& key, std::array<T, N>& result,
 // CMap
 //
 
-CMap::CMap(std::string const& MapPath, CConfig *MAP)
+CMap::CMap(std::string const& MapPath, CConfig *MAP, bool HugePages)
+	: m_MapData(nullptr),
+	m_MapDataSize(0)
 {
-	Load(MapPath, MAP);
+	Load(MapPath, MAP, HugePages);
+}
+
+CMap::CMap(std::string const& MapPath, const CMapMetadata &Metadata, bool HugePages)
+	: m_MapData(nullptr),
+	m_MapDataSize(0)
+{
+	Load(MapPath, Metadata, HugePages);
 }
 
 CMap::~CMap()
@@ -167,29 +181,60 @@ uint8_t CMap::GetMapLayoutStyle() const
 	return 3;
 }
 
-void CMap::Load(std::string const& MapPath, CConfig *MAP)
+bool CMap::ReadConfig(CConfig *MAP, CMapMetadata &Metadata)
 {
-	m_Valid = false;
-
-	m_MapPath = MapPath;
-
-	if (!ConfigRead(MAP, "map_size", m_MapSize)) { return; }
-	if (!ConfigRead(MAP, "map_info", m_MapInfo)) { return; }
-	if (!ConfigRead(MAP, "map_crc", m_MapCRC)) { return; }
-	if (!ConfigRead(MAP, "map_sha1", m_MapSHA1)) { return; }
-	if (!ConfigRead(MAP, "map_options", m_MapOptions)) { return; }
-	if (!ConfigRead(MAP, "map_width", m_MapWidth)) { return; }
-	if (!ConfigRead(MAP, "map_height", m_MapHeight)) { return; }
-
-	m_Slots.clear();
+	if (!ConfigRead(MAP, "map_size", Metadata.Size)) { return false; }
+	if (!ConfigRead(MAP, "map_info", Metadata.Info)) { return false; }
+	if (!ConfigRead(MAP, "map_crc", Metadata.CRC)) { return false; }
+	if (!ConfigRead(MAP, "map_sha1", Metadata.SHA1)) { return false; }
+	if (!ConfigRead(MAP, "map_options", Metadata.Options)) { return false; }
+	if (!ConfigRead(MAP, "map_width", Metadata.Width)) { return false; }
+	if (!ConfigRead(MAP, "map_height", Metadata.Height)) { return false; }
+
+	Metadata.Slots.clear();
 	for (uint32_t Slot = 1; Slot <= 12; ++Slot)
 	{
 		std::array<uint8_t, 9> SlotData;
 		if (!ConfigRead(MAP, "map_slot" + std::to_string(Slot), SlotData, false)) { 
 			break;
 		}
-		m_Slots.push_back(CGameSlot(SlotData[0], SlotData[1], SlotData[2], SlotData[3], SlotData[4], SlotData[5], SlotData[6], SlotData[7], SlotData[8]));
+		Metadata.Slots.push_back(SlotData);
+	}
+
+	Metadata.LocalPath = MAP->GetString("map_localpath", std::string());
+	return true;
+}
+
+void CMap::Load(std::string const& MapPath, CConfig *MAP, bool HugePages)
+{
+	CMapMetadata Metadata;
+
+	if (!ReadConfig(MAP, Metadata))
+	{
+		m_Valid = false;
+		m_MapPath = MapPath;
+		return;
 	}
+
+	Load(MapPath, Metadata, HugePages);
+}
+
+void CMap::Load(std::string const& MapPath, const CMapMetadata &Metadata, bool HugePages)
+{
+	m_Valid = false;
+
+	m_MapPath = MapPath;
+	m_MapSize = Metadata.Size;
+	m_MapInfo = Metadata.Info;
+	m_MapCRC = Metadata.CRC;
+	m_MapSHA1 = Metadata.SHA1;
+	m_MapOptions = Metadata.Options;
+	m_MapWidth = Metadata.Width;
+	m_MapHeight = Metadata.Height;
+
+	m_Slots.clear();
+	for (auto & SlotData : Metadata.Slots)
+		m_Slots.push_back(CGameSlot(SlotData[0], SlotData[1], SlotData[2], SlotData[3], SlotData[4], SlotData[5], SlotData[6], SlotData[7], SlotData[8]));
 	m_MapNumPlayers = m_Slots.size();
 
 	m_MapSpeed = MAPSPEED::FAST;
@@ -236,7 +281,97 @@ void CMap::Load(std::string const& MapPath, CConfig *MAP)
 			m_Slots.push_back(CGameSlot(0, 255, SLOTSTATUS_OPEN, 0, 12, 12, SLOTRACE_RANDOM));
 	}
 
+	LoadMapData(Metadata.LocalPath.empty() ? GetLocalPath(m_MapPath) : Metadata.LocalPath, HugePages);
+	BuildMapParts();
 	CheckValid();
+
+	m_MapCheck.clear();
+
+	if (m_Valid)
+		m_MapCheck = CGameProtocol().SEND_W3GS_MAPCHECK(m_MapPath, m_MapSize, m_MapInfo, m_MapCRC, m_MapSHA1);
+}
+
+std::string CMap::GetLocalPath(std::string const& MapPath)
+{
+	// map_path is the path Warcraft III uses, relative to its install directory and with back slashes
+
+	std::string LocalPath = MapPath;
+#ifndef WIN32
+	std::replace(begin(LocalPath), end(LocalPath), '\\', '/');
+#endif
+	return LocalPath;
+}
+
+void CMap::LoadMapData(const std::string &LocalPath, bool HugePages)
+{
+	// the map file is found at map_localpath, or where Warcraft III would find it relative to our working directory
+	// players who don't have the map can only download it if the file is exactly the map described by map_size and map_info
+
+	m_MapFile.reset();
+	m_MapData = nullptr;
+	m_MapDataSize = 0;
+
+	std::shared_ptr<CMappedFile> File = CMappedFile::Open(LocalPath, HugePages);
+
+	if (!File)
+	{
+		Print("[MAP] map downloads are disabled, players who don't have the map will be kicked");
+		return;
+	}
+
+	if (File->GetSize() != m_MapSize)
+	{
+		Print("[MAP] map downloads are disabled, [" + LocalPath + "] is " + std::to_string(File->GetSize()) + " bytes but map_size is " + std::to_string(m_MapSize));
+		return;
+	}
+
+	const uint32_t CRC = CRC32(File->GetData(), File->GetSize());
+
+	if (CRC != m_MapInfo)
+	{
+		Print("[MAP] map downloads are disabled, the crc of [" + LocalPath + "] doesn't match map_info");
+		return;
+	}
+
+	m_MapFile = File;
+	m_MapData = File->GetData();
+	m_MapDataSize = File->GetSize();
+}
+
+void CMap::BuildMapParts()
+{
+	// every player downloading the map is sent the exact same sequence of parts so the crc of each part only has to be calculated once
+	// the headers are complete except for toPID and fromPID (bytes 4 and 5) which SEND_W3GS_MAPPART patches per player
+
+	m_MapParts.clear();
+	m_MapPartHeaders.clear();
+
+	if (!m_MapData)
+		return;
+
+	const uint32_t NumParts = (m_MapDataSize + MAPPART_SIZE - 1) / MAPPART_SIZE;
+	m_MapParts.reserve(NumParts);
+	m_MapPartHeaders.reserve(NumParts * MAPPART_HEADER_SIZE);
+
+	for (uint32_t Offset = 0; Offset < m_MapDataSize; Offset += MAPPART_SIZE)
+	{
+		CMapPart Part;
+		Part.Offset = Offset;
+		Part.Length = std::min<uint32_t>(MAPPART_SIZE, m_MapDataSize - Offset);
+		Part.CRC = CRC32(m_MapData + Offset, Part.Length);
+		m_MapParts.push_back(Part);
+
+		BYTEARRAY Header = { W3GS_HEADER_CONSTANT, CGameProtocol::W3GS_MAPPART, 0, 0, 0, 0, 1, 0, 0, 0 };
+		AppendByteArray(Header, Part.Offset);
+		AppendByteArray(Header, Part.CRC);
+
+		const uint16_t Length = (uint16_t)(MAPPART_HEADER_SIZE + Part.Length);
+		Header[2] = (uint8_t)Length;
+		Header[3] = (uint8_t)(Length >> 8);
+		AppendByteArray(m_MapPartHeaders, Header);
+	}
+
+	Print("[MAP] prepared " + std::to_string(NumParts) + " map parts");
 }
 
 void CMap::CheckValid()
@@ -253,7 +388,7 @@ void CMap::CheckValid()
 		Print("[MAP] warning - map_path contains forward slashes '/' but it must use Windows style back slashes '\\'");
 	}
 
-	if (!m_MapData.empty() && m_MapData.size() != m_MapSize)
+	if (m_MapData && m_MapDataSize != m_MapSize)
 	{
 		Print("[MAP] invalid map_size detected - size mismatch with actual map data");
 		return;
@@ -272,9 +407,3 @@ void CMap::CheckValid()
 	}
 	m_Valid = true;
 }
-
-const std::string* CMap::GetMapData() const
-{
-	// todo; صͼ֧
-	return &m_MapData;
-}
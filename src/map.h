@@ -27,11 +27,40 @@ CODE PORTED FROM THE ORIGINAL GHOST PROJECT: http://ghost.pwner.org/
 
 #include <array>
 #include <vector>
+#include <memory>
+#include <string>
 #include <stdint.h>
+typedef std::vector<uint8_t> BYTEARRAY;
+
+#define MAPPART_SIZE             1442 // the number of map bytes sent in one W3GS_MAPPART packet
+#define MAPPART_HEADER_SIZE        18 // header + toPID + fromPID + unknown + start position + crc
+
+struct CMapPart
+{
+	uint32_t Offset;
+	uint32_t Length;
+	uint32_t CRC;
+};
+
+// everything a map config says about a map, read from a config file, the map catalog or the map file itself
+
+struct CMapMetadata
+{
+	uint32_t Size;                                // map_size
+	uint32_t Info;                                // map_info, the crc32 of the map file
+	uint32_t CRC;                                 // map_crc
+	std::array<uint8_t, 20> SHA1;                 // map_sha1
+	uint8_t Options;                              // map_options
+	uint16_t Width;                               // map_width
+	uint16_t Height;                              // map_height
+	std::vector<std::array<uint8_t, 9>> Slots;    // map_slot<x>
+	std::string LocalPath;                        // map_localpath, empty if the map file is where map_path says
+};
 
 class CAura;
 class CGameSlot;
 class CConfig;
+class CMappedFile;
 
 class CMap
 {
@@ -84,7 +113,8 @@ public:
 	};
 
 public:
-	CMap(std::string const& MapPath, CConfig *MAP);
+	CMap(std::string const& MapPath, CConfig *MAP, bool HugePages = false);
+	CMap(std::string const& MapPath, const CMapMetadata &Metadata, bool HugePages = false);
 	~CMap();
 
 	inline bool GetValid() const                               { return m_Valid; }
@@ -100,15 +130,34 @@ public:
 	inline uint16_t GetMapHeight() const                       { return m_MapHeight; }
 	inline uint32_t GetMapNumPlayers() const                   { return m_MapNumPlayers; }
 	inline std::vector<CGameSlot> GetSlots() const             { return m_Slots; }
+	inline uint32_t GetNumMapParts() const                     { return m_MapParts.size(); }
+	inline const CMapPart &GetMapPart(uint32_t part) const     { return m_MapParts[part]; }
+	inline const uint8_t *GetMapPartHeader(uint32_t part) const { return m_MapPartHeaders.data() + part * MAPPART_HEADER_SIZE; }
+	inline const uint8_t *GetMapPartData(uint32_t part) const  { return m_MapData + m_MapParts[part].Offset; }
+	inline bool GetMapDataLoaded() const                       { return m_MapData != nullptr; }
+	inline const std::shared_ptr<CMappedFile> &GetMapFile() const { return m_MapFile; }
+	inline uint32_t GetMapDataSize() const                     { return m_MapDataSize; }
+	inline const BYTEARRAY &GetMapCheck() const                { return m_MapCheck; }
 
 	uint32_t GetMapGameFlags() const;
 	uint8_t GetMapLayoutStyle() const;
-	const std::string *GetMapData() const;
-	void Load(std::string const& MapPath, CConfig *MAP);
+	void Load(std::string const& MapPath, CConfig *MAP, bool HugePages);
+	void Load(std::string const& MapPath, const CMapMetadata &Metadata, bool HugePages);
 	void CheckValid();
 
+	static bool ReadConfig(CConfig *MAP, CMapMetadata &Metadata);
+	static std::string GetLocalPath(std::string const& MapPath);
+
 private:
-	std::string m_MapData;              // the map data itself, for sending the map to players
+	void LoadMapData(const std::string &LocalPath, bool HugePages);
+	void BuildMapParts();
+
+	std::shared_ptr<CMappedFile> m_MapFile; // the map file mapped into memory, shared with every other map using the same file
+	const uint8_t *m_MapData;           // the map data itself, for sending the map to players (nullptr if the map file isn't available)
+	uint32_t m_MapDataSize;
+	std::vector<CMapPart> m_MapParts;   // offset, length and crc of every MAPPART, computed once when the map data is loaded
+	BYTEARRAY m_MapPartHeaders;         // prebuilt W3GS_MAPPART headers (MAPPART_HEADER_SIZE bytes per part) with toPID/fromPID left as zero
+	BYTEARRAY m_MapCheck;               // prebuilt W3GS_MAPCHECK, the same for every player of every game hosting this map
 	std::array<uint8_t, 20> m_MapSHA1;  // config value: map sha1 (20 bytes)
 	uint32_t m_MapSize;                 // config value: map size (4 bytes)
 	uint32_t m_MapInfo;                 // config value: map info (4 bytes) -> this is the real CRC
@@ -0,0 +1,692 @@
+/*
+
+Copyright [2010] [Josko Nikolic]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+CODE PORTED FROM THE ORIGINAL GHOST PROJECT: http://ghost.pwner.org/
+
+*/
+
+#include "mapcache.h"
+#include "mappedfile.h"
+#include "mpq.h"
+#include "gameslot.h"
+#include "map.h"
+#include "config.h"
+#include "crc32.h"
+#include "sha1.h"
+#include "rolc.h"
+#include "workpool.h"
+
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <cstring>
+#include <sys/stat.h>
+
+#ifdef WIN32
+#include <direct.h>
+#endif
+
+uint32_t GetTicks();
+void Print(const std::string &message);
+
+// map configs store numbers as their little endian bytes in decimal, e.g. "map_size = 0 16 128 0"
+
+static std::string ToBytes(uint32_t n, uint32_t count)
+{
+	std::string Result;
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		if (i > 0)
+			Result += " ";
+
+		Result += std::to_string((n >> (i * 8)) & 0xFF);
+	}
+
+	return Result;
+}
+
+// the saved sha1 contexts are stored as hex
+
+static std::string ToHex(const uint8_t *data, uint32_t length)
+{
+	static const char Digits[] = "0123456789abcdef";
+	std::string Result;
+
+	for (uint32_t i = 0; i < length; ++i)
+	{
+		Result += Digits[data[i] >> 4];
+		Result += Digits[data[i] & 15];
+	}
+
+	return Result;
+}
+
+static uint8_t FromHexDigit(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	else if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	else if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+
+	return 0;
+}
+
+static void FromHex(const std::string &hex, uint8_t *data, uint32_t length)
+{
+	for (uint32_t i = 0; i < length && i * 2 + 1 < hex.size(); ++i)
+		data[i] = (FromHexDigit(hex[i * 2]) << 4) | FromHexDigit(hex[i * 2 + 1]);
+}
+
+// a bounds checked reader for war3map.w3i, once it runs past the end every value reads as zero and m_Error is set
+
+class CW3IReader
+{
+private:
+	const std::string &m_Data;
+	size_t m_Pos;
+	bool m_Error;
+
+public:
+	explicit CW3IReader(const std::string &nData)
+		: m_Data(nData),
+		m_Pos(0),
+		m_Error(false)
+	{ }
+
+	inline bool GetError() const                          { return m_Error; }
+
+	void Skip(size_t n)
+	{
+		if (m_Pos + n > m_Data.size())
+			m_Error = true;
+		else
+			m_Pos += n;
+	}
+
+	uint32_t Int()
+	{
+		if (m_Pos + 4 > m_Data.size())
+		{
+			m_Error = true;
+			return 0;
+		}
+
+		uint32_t Value;
+		memcpy(&Value, m_Data.data() + m_Pos, 4);
+		m_Pos += 4;
+		return Value;
+	}
+
+	std::string String()
+	{
+		const size_t End = m_Data.find('\0', m_Pos);
+
+		if (End == std::string::npos)
+		{
+			m_Error = true;
+			return std::string();
+		}
+
+		std::string Value = m_Data.substr(m_Pos, End - m_Pos);
+		m_Pos = End + 1;
+		return Value;
+	}
+};
+
+//
+// CMapCache
+//
+
+CMapCache::CMapCache(const std::string &nCachePath, const std::string &nJASSPath)
+	: m_CachePath(nCachePath),
+	m_JASSPath(nJASSPath)
+{
+
+}
+
+CMapCache::~CMapCache()
+{
+
+}
+
+std::string CMapCache::GetConfig(const std::string &localPath)
+{
+	struct stat Stat;
+
+	if (stat(localPath.c_str(), &Stat) != 0)
+	{
+		Print("[MAPCACHE] unable to find map file [" + localPath + "]");
+		return std::string();
+	}
+
+	std::shared_ptr<CMappedFile> File = CMappedFile::Open(localPath, false);
+
+	if (!File)
+		return std::string();
+
+	// the config is named after the map file and its path so that maps with the same name in different directories don't collide
+
+	const std::string::size_type Slash = localPath.find_last_of("\\/");
+	const std::string Name = Slash == std::string::npos ? localPath : localPath.substr(Slash + 1);
+	const std::string CachePath = m_CachePath + "/" + Name + "." + std::to_string(CRC32((const uint8_t *)localPath.data(), localPath.size())) + ".cfg";
+	const std::string Size = std::to_string(File->GetSize());
+	const std::string MTime = std::to_string((uint64_t)Stat.st_mtime);
+	const uint32_t FileCRC = CRC32(File->GetData(), File->GetSize());
+	const std::string CRC = std::to_string(FileCRC);
+	const std::string JASS = GetJASSKey();
+
+	std::vector<CMapInput> Inputs;
+
+	{
+		std::ifstream Cached(CachePath.c_str());
+
+		if (Cached)
+		{
+			Cached.close();
+			CConfig Config(CachePath);
+
+			if (Config.GetInt("cache_version", 0) == MAPCACHE_VERSION && Config.GetString("cache_size", std::string()) == Size && Config.GetString("cache_mtime", std::string()) == MTime && Config.GetString("cache_crc", std::string()) == CRC && Config.GetString("cache_jass", std::string()) == JASS)
+			{
+				Print("[MAPCACHE] using cached config [" + CachePath + "] for [" + localPath + "]");
+				return CachePath;
+			}
+
+			// the map (or common.j or blizzard.j) changed, but usually only a few of its inputs did (e.g. war3map.j after a script edit)
+
+			if (Config.GetInt("cache_version", 0) == MAPCACHE_VERSION)
+				ReadInputs(&Config, Inputs);
+		}
+	}
+
+	Print("[MAPCACHE] scanning map file [" + localPath + "]");
+
+	const uint32_t ScanStart = GetTicks();
+	CMapMetadata Metadata;
+
+	if (!Scan(File, FileCRC, Metadata, &Inputs))
+		return std::string();
+
+	Print("[MAPCACHE] scanned [" + localPath + "] in " + std::to_string(GetTicks() - ScanStart) + " ms");
+
+	std::string SHA1String;
+
+	for (uint32_t i = 0; i < 20; ++i)
+		SHA1String += (i > 0 ? " " : "") + std::to_string(Metadata.SHA1[i]);
+
+	std::vector<std::string> Lines;
+	Lines.push_back("cache_version = " + std::to_string(MAPCACHE_VERSION));
+	Lines.push_back("cache_size = " + Size);
+	Lines.push_back("cache_mtime = " + MTime);
+	Lines.push_back("cache_crc = " + CRC);
+	Lines.push_back("cache_jass = " + JASS);
+	Lines.push_back("map_localpath = " + localPath);
+	Lines.push_back("map_size = " + ToBytes(Metadata.Size, 4));
+	Lines.push_back("map_info = " + ToBytes(Metadata.Info, 4));
+	Lines.push_back("map_crc = " + ToBytes(Metadata.CRC, 4));
+	Lines.push_back("map_sha1 = " + SHA1String);
+	Lines.push_back("map_options = " + std::to_string(Metadata.Options));
+	Lines.push_back("map_width = " + ToBytes(Metadata.Width, 2));
+	Lines.push_back("map_height = " + ToBytes(Metadata.Height, 2));
+
+	for (uint32_t i = 0; i < Metadata.Slots.size(); ++i)
+	{
+		std::string Slot = "map_slot" + std::to_string(i + 1) + " =";
+
+		for (auto & value : Metadata.Slots[i])
+			Slot += " " + std::to_string(value);
+
+		Lines.push_back(Slot);
+	}
+
+	for (uint32_t i = 0; i < Inputs.size(); ++i)
+	{
+		const CMapInput &Input = Inputs[i];
+		Lines.push_back("cache_input" + std::to_string(i) + " = " + std::to_string(Input.Found) + " " + std::to_string(Input.Key.FileSize) + " " + std::to_string(Input.Key.CompressedSize) + " " + std::to_string(Input.Key.Flags) + " " + std::to_string(Input.Key.CRC) + " " + std::to_string(Input.Rolc));
+		Lines.push_back("cache_input" + std::to_string(i) + "_context = " + Input.Context);
+	}
+
+#ifdef WIN32
+	_mkdir(m_CachePath.c_str());
+#else
+	mkdir(m_CachePath.c_str(), 0755);
+#endif
+
+	// the config is written next to the old one and renamed over it, a config cut short by a crash would otherwise pass the checks above
+
+	const std::string TempPath = CachePath + ".tmp";
+	std::ofstream Out(TempPath.c_str(), std::ios::trunc);
+
+	if (!Out)
+	{
+		Print("[MAPCACHE] unable to write [" + TempPath + "]");
+		return std::string();
+	}
+
+	for (auto & line : Lines)
+		Out << line << "\n";
+
+	Out.close();
+
+#ifdef WIN32
+	remove(CachePath.c_str());
+#endif
+
+	if (!Out || rename(TempPath.c_str(), CachePath.c_str()) != 0)
+	{
+		Print("[MAPCACHE] unable to write [" + CachePath + "]");
+		remove(TempPath.c_str());
+		return std::string();
+	}
+
+	Print("[MAPCACHE] wrote [" + CachePath + "]");
+	return CachePath;
+}
+
+std::string CMapCache::GetJASSKey() const
+{
+	// the size and crc of common.j and blizzard.j in bot_jasspath, "-" for a file that's missing
+	// they're only hashed for maps without their own copies but reading two small files on every load is cheaper than finding out
+
+	std::string Key;
+
+	for (const char *name : { "common.j", "blizzard.j" })
+	{
+		std::ifstream In((m_JASSPath + "/" + name).c_str(), std::ios::binary);
+
+		if (!Key.empty())
+			Key += " ";
+
+		if (!In)
+		{
+			Key += "-";
+			continue;
+		}
+
+		const std::string Data((std::istreambuf_iterator<char>(In)), std::istreambuf_iterator<char>());
+		Key += std::to_string(Data.size()) + ":" + std::to_string(CRC32((const uint8_t *)Data.data(), Data.size()));
+	}
+
+	return Key;
+}
+
+void CMapCache::ReadInputs(CConfig *CFG, std::vector<CMapInput> &inputs)
+{
+	inputs.clear();
+
+	for (uint32_t i = 0; ; ++i)
+	{
+		std::istringstream SS(CFG->GetString("cache_input" + std::to_string(i), std::string()));
+		CMapInput Input;
+
+		if (!(SS >> Input.Found >> Input.Key.FileSize >> Input.Key.CompressedSize >> Input.Key.Flags >> Input.Key.CRC >> Input.Rolc))
+			break;
+
+		Input.Context = CFG->GetString("cache_input" + std::to_string(i) + "_context", std::string());
+		inputs.push_back(Input);
+	}
+}
+
+bool CMapCache::Scan(const std::shared_ptr<CMappedFile> &file, uint32_t crc, CMapMetadata &metadata, std::vector<CMapInput> *inputs) const
+{
+	CMPQArchive Archive(file);
+
+	if (!Archive.GetValid())
+	{
+		Print("[MAPCACHE] [" + file->GetPath() + "] isn't a valid map");
+		return false;
+	}
+
+	// the inputs of map_crc and map_sha1 in the order they're hashed, with the names they can have inside the map
+	// each input is read, decompressed and run through rolc on its own, only sha1 has to see them in order
+
+	struct CInput
+	{
+		CInput(const std::vector<std::string> &nNames, const std::string &nDiskPath = std::string())
+			: Names(nNames),
+			DiskPath(nDiskPath),
+			Digest(),
+			RolcCached(false)
+		{ }
+
+		std::vector<std::string> Names;
+		std::string DiskPath;
+		std::string Name;                         // the name the map has the input under (empty if it was read from DiskPath)
+		CMapInput Digest;
+		bool RolcCached;
+		std::string Data;
+	};
+
+	std::vector<CInput> Inputs = {
+		{ { "common.j", "scripts\\common.j" }, m_JASSPath + "/common.j" },
+		{ { "blizzard.j", "scripts\\blizzard.j" }, m_JASSPath + "/blizzard.j" },
+		{ { "war3map.j", "scripts\\war3map.j" } },
+		{ { "war3map.w3e" } },
+		{ { "war3map.wpm" } },
+		{ { "war3map.doo" } },
+		{ { "war3map.w3u" } },
+		{ { "war3map.w3b" } },
+		{ { "war3map.w3d" } },
+		{ { "war3map.w3a" } },
+		{ { "war3map.w3q" } }
+	};
+
+	// find every input and what it was the last time, without decompressing anything yet
+
+	std::vector<CMapInput> Previous;
+
+	if (inputs && inputs->size() == Inputs.size())
+		Previous = *inputs;
+
+	uint32_t SHA1Reused = 0;
+	bool Prefix = true;
+
+	for (uint32_t i = 0; i < Inputs.size(); ++i)
+	{
+		CInput &Input = Inputs[i];
+		Input.Digest.Found = false;
+		Input.Digest.Key = CMPQFileKey{ 0, 0, 0, 0 };
+		Input.Digest.Rolc = 0;
+		Input.RolcCached = false;
+
+		for (auto & name : Input.Names)
+		{
+			if (Archive.GetFileKey(name, Input.Digest.Key))
+			{
+				Input.Digest.Found = true;
+				Input.Name = name;
+				break;
+			}
+		}
+
+		if (!Input.Digest.Found && !Input.DiskPath.empty())
+		{
+			std::ifstream In(Input.DiskPath.c_str(), std::ios::binary);
+
+			if (In)
+			{
+				Input.Data.assign(std::istreambuf_iterator<char>(In), std::istreambuf_iterator<char>());
+				Input.Digest.Found = true;
+				Input.Digest.Key = CMPQFileKey{ (uint32_t)Input.Data.size(), (uint32_t)Input.Data.size(), 0, CRC32((const uint8_t *)Input.Data.data(), Input.Data.size()) };
+			}
+		}
+
+		const bool Unchanged = !Previous.empty() && Previous[i].Found == Input.Digest.Found && (!Input.Digest.Found || Previous[i].Key == Input.Digest.Key);
+
+		if (Unchanged && Input.Digest.Found)
+		{
+			Input.Digest.Rolc = Previous[i].Rolc;
+			Input.RolcCached = true;
+		}
+
+		// sha1 can only continue from the context after the last of a run of unchanged inputs at the start
+
+		Prefix = Prefix && Unchanged && Previous[i].Context.size() == sizeof(hash::sha1::context) * 2;
+
+		if (Prefix)
+		{
+			Input.Digest.Context = Previous[i].Context;
+			SHA1Reused = i + 1;
+		}
+	}
+
+	// everything after the reused sha1 prefix is read, the rolc of an unchanged input is reused even then
+	// the inputs and war3map.w3i are read on the work pool, the last task is war3map.w3i
+
+	std::vector<CInput *> Reads;
+
+	for (uint32_t i = SHA1Reused; i < Inputs.size(); ++i)
+	{
+		if (Inputs[i].Digest.Found)
+			Reads.push_back(&Inputs[i]);
+	}
+
+	std::string W3I;
+	bool HaveW3I = false;
+
+	const bool Success = CWorkPool::Get().Run(Reads.size() + 1, [&](uint32_t task)
+	{
+		if (task == Reads.size())
+		{
+			HaveW3I = Archive.ReadFile("war3map.w3i", W3I);
+			return true;
+		}
+
+		CInput *Input = Reads[task];
+
+		if (!Input->Name.empty() && !Archive.ReadFile(Input->Name, Input->Data))
+		{
+			Print("[MAPCACHE] unable to read [" + Input->Name + "]");
+			return false;
+		}
+
+		if (!Input->RolcCached)
+			Input->Digest.Rolc = hash::rolc::block((const unsigned char *)Input->Data.data(), Input->Data.size());
+
+		return true;
+	});
+
+	if (!Success)
+		return false;
+
+	hash::rolc Rolc;
+	hash::sha1 SHA1;
+	uint64_t Hashed = 0;
+
+	if (SHA1Reused > 0)
+	{
+		hash::sha1::context Context;
+		FromHex(Inputs[SHA1Reused - 1].Digest.Context, (uint8_t *)&Context, sizeof(Context));
+		SHA1.restore(Context);
+	}
+
+	for (uint32_t i = 0; i < Inputs.size(); ++i)
+	{
+		CInput &Input = Inputs[i];
+
+		if (Input.Digest.Found)
+			Rolc.update(Input.Digest.Rolc);
+
+		if (i >= SHA1Reused)
+		{
+			if (Input.Digest.Found)
+			{
+				SHA1.update((const unsigned char *)Input.Data.data(), Input.Data.size());
+				Hashed += Input.Data.size();
+			}
+
+			// common.j and blizzard.j are followed by a constant
+
+			if (i == 1)
+				SHA1.update((const unsigned char *)"\x9E\x37\xF1\x03", 4);
+
+			const hash::sha1::context Context = SHA1.save();
+			Input.Digest.Context = ToHex((const uint8_t *)&Context, sizeof(Context));
+		}
+
+		if (i == 1)
+			Rolc.update(0x03F1379E);
+	}
+
+	if (SHA1Reused > 0 || !Previous.empty())
+		Print("[MAPCACHE] reused the hashes of " + std::to_string(SHA1Reused) + " unchanged inputs, hashed " + std::to_string(Hashed) + " bytes");
+
+	if (inputs)
+	{
+		inputs->clear();
+
+		for (auto & input : Inputs)
+			inputs->push_back(input.Digest);
+	}
+
+	if (!Inputs[0].Digest.Found || !Inputs[1].Digest.Found)
+		Print("[MAPCACHE] warning - common.j or blizzard.j wasn't found in the map or in [" + m_JASSPath + "], map_crc and map_sha1 will be wrong");
+
+	if (!Inputs[2].Digest.Found)
+	{
+		Print("[MAPCACHE] [" + file->GetPath() + "] doesn't have a war3map.j");
+		return false;
+	}
+
+	metadata.Size = file->GetSize();
+	metadata.Info = crc;
+	metadata.CRC = Rolc.final();
+	SHA1.final(metadata.SHA1.data());
+	metadata.LocalPath = file->GetPath();
+
+	if (!HaveW3I || !ReadW3I(W3I, metadata))
+	{
+		Print("[MAPCACHE] [" + file->GetPath() + "] doesn't have a readable war3map.w3i");
+		return false;
+	}
+
+	return true;
+}
+
+bool CMapCache::ReadW3I(const std::string &data, CMapMetadata &metadata)
+{
+	// versions 18 (Reign of Chaos), 25 (The Frozen Throne) and 28 (1.31) are understood
+
+	CW3IReader W3I(data);
+	const uint32_t Version = W3I.Int();
+
+	if (Version != 18 && Version != 25 && Version != 28)
+	{
+		Print("[MAPCACHE] unsupported war3map.w3i version " + std::to_string(Version));
+		return false;
+	}
+
+	W3I.Skip(8);                                  // number of saves, editor version
+
+	if (Version >= 28)
+		W3I.Skip(16);                             // game version
+
+	W3I.String();                                 // name
+	W3I.String();                                 // author
+	W3I.String();                                 // description
+	W3I.String();                                 // players recommended
+	W3I.Skip(48);                                 // camera bounds and complements
+	const uint32_t Width = W3I.Int();             // playable width
+	const uint32_t Height = W3I.Int();            // playable height
+	const uint32_t Flags = W3I.Int();
+	W3I.Skip(1);                                  // main ground type
+
+	if (Version == 18)
+	{
+		W3I.Skip(4);                              // campaign background
+		W3I.String();                             // loading screen text, title and subtitle
+		W3I.String();
+		W3I.String();
+		W3I.Skip(4);                              // loading screen
+		W3I.String();                             // prologue text, title and subtitle
+		W3I.String();
+		W3I.String();
+	}
+	else
+	{
+		W3I.Skip(4);                              // loading screen background
+		W3I.String();                             // loading screen model, text, title and subtitle
+		W3I.String();
+		W3I.String();
+		W3I.String();
+		W3I.Skip(4);                              // game data set
+		W3I.String();                             // prologue path, text, title and subtitle
+		W3I.String();
+		W3I.String();
+		W3I.String();
+		W3I.Skip(20);                             // fog type, start, end, density and colour
+		W3I.Skip(4);                              // weather
+		W3I.String();                             // sound environment
+		W3I.Skip(5);                              // light environment, water tinting
+
+		if (Version >= 28)
+			W3I.Skip(4);                          // script language
+	}
+
+	struct CPlayer
+	{
+		uint32_t Colour;
+		uint32_t Type;
+		uint32_t Race;
+		uint32_t Team;
+	};
+
+	std::vector<CPlayer> Players;
+	const uint32_t NumPlayers = W3I.Int();
+
+	for (uint32_t i = 0; i < NumPlayers && !W3I.GetError(); ++i)
+	{
+		CPlayer Player;
+		Player.Colour = W3I.Int();
+		Player.Type = W3I.Int();
+		Player.Race = W3I.Int();
+		Player.Team = 0;
+		W3I.Skip(4);                              // fixed start position
+		W3I.String();                             // name
+		W3I.Skip(16);                             // start position, ally priorities
+
+		// only human and computer players get a slot
+
+		if (Player.Type == 1 || Player.Type == 2)
+			Players.push_back(Player);
+	}
+
+	const uint32_t NumForces = W3I.Int();
+
+	for (uint32_t i = 0; i < NumForces && !W3I.GetError(); ++i)
+	{
+		W3I.Skip(4);                              // flags
+		const uint32_t PlayerMask = W3I.Int();
+		W3I.String();                             // name
+
+		for (auto & player : Players)
+		{
+			if (player.Colour < 32 && (PlayerMask & (1 << player.Colour)))
+				player.Team = i;
+		}
+	}
+
+	if (W3I.GetError() || Players.empty() || Players.size() > 12)
+		return false;
+
+	metadata.Options = Flags & 0x64;
+	metadata.Width = Width;
+	metadata.Height = Height;
+	metadata.Slots.clear();
+
+	for (auto & Player : Players)
+	{
+		const bool Computer = Player.Type == 2;
+		uint32_t Race = 32;
+
+		if (Player.Race == 1)
+			Race = 1;
+		else if (Player.Race == 2)
+			Race = 2;
+		else if (Player.Race == 3)
+			Race = 8;
+		else if (Player.Race == 4)
+			Race = 4;
+
+		// pid, download status, slot status, computer, team, colour, race, computer type, handicap
+
+		metadata.Slots.push_back({ 0, 255, (uint8_t)(Computer ? 2 : 0), (uint8_t)(Computer ? 1 : 0), (uint8_t)Player.Team, (uint8_t)Player.Colour, (uint8_t)Race, 1, 100 });
+	}
+
+	return true;
+}
@@ -0,0 +1,83 @@
+/*
+
+Copyright [2010] [Josko Nikolic]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+CODE PORTED FROM THE ORIGINAL GHOST PROJECT: http://ghost.pwner.org/
+
+*/
+
+#ifndef AURA_MAPCACHE_H_
+#define AURA_MAPCACHE_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdint.h>
+
+#include "mpq.h"
+
+class CMappedFile;
+class CConfig;
+struct CMapMetadata;
+
+//
+// CMapCache
+//
+
+// derives a map config (map_size, map_info, map_crc, map_sha1, map_options, map_width, map_height and map_slot<x>)
+// straight from the map file the same way tools/mapdump does, so hosting a map doesn't need the Windows only tools
+// the configs are written to bot_mapcachepath together with the map file's size, mtime and crc and the size and crc of common.j and blizzard.j
+// and reused as long as those match, a restart only has to crc the map file and the two script files
+// when the map file did change the config also remembers every map_crc/map_sha1 input (common.j, war3map.j, ...)
+// so a rebuilt map only has to decompress and hash the inputs that actually changed
+
+#define MAPCACHE_VERSION 1
+
+// one input of map_crc and map_sha1 as it was the last time the map was scanned
+
+struct CMapInput
+{
+	bool Found;
+	CMPQFileKey Key;                              // for files read from bot_jasspath the size and crc of the file, Flags is 0
+	uint32_t Rolc;                                // rolc::block of the input
+	std::string Context;                          // the sha1 context after this input (and everything before it), hex encoded
+};
+
+class CMapCache
+{
+private:
+	std::string m_CachePath;                      // the directory the generated configs are written to
+	std::string m_JASSPath;                       // the directory common.j and blizzard.j are read from when the map doesn't have its own
+
+public:
+	CMapCache(const std::string &nCachePath, const std::string &nJASSPath);
+	~CMapCache();
+
+	// returns the path of an up to date config for the map file at localPath, or an empty string if the map can't be read
+
+	std::string GetConfig(const std::string &localPath);
+
+	// reads everything a map config says about the map out of the map file, crc is the crc32 of the whole file
+	// inputs can hold the inputs of an earlier scan of the same map to reuse, it's replaced with the inputs of this scan
+
+	bool Scan(const std::shared_ptr<CMappedFile> &file, uint32_t crc, CMapMetadata &metadata, std::vector<CMapInput> *inputs = nullptr) const;
+
+private:
+	std::string GetJASSKey() const;
+	static void ReadInputs(CConfig *CFG, std::vector<CMapInput> &inputs);
+	static bool ReadW3I(const std::string &data, CMapMetadata &metadata);
+};
+
+#endif  // AURA_MAPCACHE_H_
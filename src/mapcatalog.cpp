@@ -0,0 +1,259 @@
+/*
+
+Copyright [2010] [Josko Nikolic]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+CODE PORTED FROM THE ORIGINAL GHOST PROJECT: http://ghost.pwner.org/
+
+*/
+
+#include "mapcatalog.h"
+#include "mappedfile.h"
+#include "gameslot.h"
+#include "map.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+
+void Print(const std::string &message);
+
+//
+// CMapCatalog
+//
+
+CMapCatalog::CMapCatalog(const std::string &nPath)
+	: m_File(CMappedFile::Open(nPath, false)),
+	m_Records(nullptr),
+	m_NameIndex(nullptr),
+	m_HashIndex(nullptr),
+	m_Names(nullptr),
+	m_NamesSize(0),
+	m_NumMaps(0)
+{
+	if (!m_File)
+		return;
+
+	// only the header and the table bounds are checked here, records are checked as they're read
+
+	const uint8_t *Data = m_File->GetData();
+	const uint32_t Size = m_File->GetSize();
+	CHeader Header;
+
+	if (Size < sizeof(CHeader))
+	{
+		Print("[MAP] [" + nPath + "] isn't a map catalog");
+		return;
+	}
+
+	memcpy(&Header, Data, sizeof(CHeader));
+
+	if (Header.Magic != MAPCATALOG_MAGIC || Header.Version != MAPCATALOG_VERSION)
+	{
+		Print("[MAP] [" + nPath + "] isn't a version " + std::to_string(MAPCATALOG_VERSION) + " map catalog, run ydhost-index again");
+		return;
+	}
+
+	if ((uint64_t)Header.RecordsOffset + (uint64_t)Header.NumMaps * sizeof(CRecord) > Size || (uint64_t)Header.NameIndexOffset + (uint64_t)Header.NumMaps * 4 > Size ||
+		(uint64_t)Header.HashIndexOffset + (uint64_t)Header.NumMaps * 4 > Size || (uint64_t)Header.NamesOffset + Header.NamesSize > Size ||
+		Header.RecordsOffset % 4 != 0 || Header.NameIndexOffset % 4 != 0 || Header.HashIndexOffset % 4 != 0)
+	{
+		Print("[MAP] [" + nPath + "] is truncated or corrupt");
+		return;
+	}
+
+	m_Records = (const CRecord *)(Data + Header.RecordsOffset);
+	m_NameIndex = (const uint32_t *)(Data + Header.NameIndexOffset);
+	m_HashIndex = (const uint32_t *)(Data + Header.HashIndexOffset);
+	m_Names = (const char *)(Data + Header.NamesOffset);
+	m_NamesSize = Header.NamesSize;
+	m_NumMaps = Header.NumMaps;
+	Print("[MAP] using map catalog [" + nPath + "] with " + std::to_string(m_NumMaps) + " maps");
+}
+
+CMapCatalog::~CMapCatalog()
+{
+
+}
+
+std::string CMapCatalog::GetName(const CRecord &record) const
+{
+	if ((uint64_t)record.NameOffset + record.NameLength > m_NamesSize)
+		return std::string();
+
+	return std::string(m_Names + record.NameOffset, record.NameLength);
+}
+
+void CMapCatalog::GetMetadata(const CRecord &record, CMapMetadata &metadata) const
+{
+	metadata.Size = record.Size;
+	metadata.Info = record.Info;
+	metadata.CRC = record.CRC;
+	memcpy(metadata.SHA1.data(), record.SHA1, 20);
+	metadata.Width = record.Width;
+	metadata.Height = record.Height;
+	metadata.Options = record.Options;
+	metadata.Slots.clear();
+
+	for (uint32_t i = 0; i < record.NumSlots && i < 12; ++i)
+	{
+		std::array<uint8_t, 9> Slot;
+		memcpy(Slot.data(), record.Slots[i], 9);
+		metadata.Slots.push_back(Slot);
+	}
+
+	metadata.LocalPath.clear();
+}
+
+bool CMapCatalog::Find(const std::string &name, CMapMetadata &metadata) const
+{
+	uint32_t Low = 0;
+	uint32_t High = m_NumMaps;
+
+	while (Low < High)
+	{
+		const uint32_t Middle = Low + (High - Low) / 2;
+
+		if (m_NameIndex[Middle] >= m_NumMaps)
+			return false;
+
+		const CRecord &Record = m_Records[m_NameIndex[Middle]];
+		const int Compare = GetName(Record).compare(name);
+
+		if (Compare == 0)
+		{
+			GetMetadata(Record, metadata);
+			return true;
+		}
+
+		if (Compare < 0)
+			Low = Middle + 1;
+		else
+			High = Middle;
+	}
+
+	return false;
+}
+
+bool CMapCatalog::FindByContent(uint32_t size, uint32_t info, std::string &name) const
+{
+	uint32_t Low = 0;
+	uint32_t High = m_NumMaps;
+
+	while (Low < High)
+	{
+		const uint32_t Middle = Low + (High - Low) / 2;
+
+		if (m_HashIndex[Middle] >= m_NumMaps)
+			return false;
+
+		const CRecord &Record = m_Records[m_HashIndex[Middle]];
+
+		if (Record.Info == info && Record.Size == size)
+		{
+			name = GetName(Record);
+			return true;
+		}
+
+		if (Record.Info < info || (Record.Info == info && Record.Size < size))
+			Low = Middle + 1;
+		else
+			High = Middle;
+	}
+
+	return false;
+}
+
+bool CMapCatalog::Write(const std::string &path, const std::vector<std::pair<std::string, CMapMetadata>> &maps)
+{
+	const uint32_t NumMaps = maps.size();
+	std::vector<CRecord> Records(NumMaps);
+	std::string Names;
+
+	for (uint32_t i = 0; i < NumMaps; ++i)
+	{
+		const CMapMetadata &Metadata = maps[i].second;
+		CRecord &Record = Records[i];
+		memset(&Record, 0, sizeof(CRecord));
+		Record.NameOffset = Names.size();
+		Record.NameLength = maps[i].first.size();
+		Record.Size = Metadata.Size;
+		Record.Info = Metadata.Info;
+		Record.CRC = Metadata.CRC;
+		memcpy(Record.SHA1, Metadata.SHA1.data(), 20);
+		Record.Width = Metadata.Width;
+		Record.Height = Metadata.Height;
+		Record.Options = Metadata.Options;
+		Record.NumSlots = (uint8_t)std::min<size_t>(Metadata.Slots.size(), 12);
+
+		for (uint32_t j = 0; j < Record.NumSlots; ++j)
+			memcpy(Record.Slots[j], Metadata.Slots[j].data(), 9);
+
+		Names += maps[i].first;
+	}
+
+	std::vector<uint32_t> NameIndex(NumMaps);
+	std::vector<uint32_t> HashIndex(NumMaps);
+
+	for (uint32_t i = 0; i < NumMaps; ++i)
+		NameIndex[i] = HashIndex[i] = i;
+
+	std::sort(begin(NameIndex), end(NameIndex), [&maps](uint32_t a, uint32_t b)
+	{
+		return maps[a].first < maps[b].first;
+	});
+
+	std::sort(begin(HashIndex), end(HashIndex), [&Records](uint32_t a, uint32_t b)
+	{
+		if (Records[a].Info != Records[b].Info)
+			return Records[a].Info < Records[b].Info;
+
+		return Records[a].Size < Records[b].Size;
+	});
+
+	CHeader Header;
+	Header.Magic = MAPCATALOG_MAGIC;
+	Header.Version = MAPCATALOG_VERSION;
+	Header.NumMaps = NumMaps;
+	Header.RecordsOffset = sizeof(CHeader);
+	Header.NameIndexOffset = Header.RecordsOffset + NumMaps * sizeof(CRecord);
+	Header.HashIndexOffset = Header.NameIndexOffset + NumMaps * 4;
+	Header.NamesOffset = Header.HashIndexOffset + NumMaps * 4;
+	Header.NamesSize = Names.size();
+
+	// the catalog is written next to the old one and renamed over it so a running bot never maps half a catalog
+
+	const std::string TempPath = path + ".tmp";
+	std::ofstream Out(TempPath.c_str(), std::ios::binary | std::ios::trunc);
+
+	if (!Out)
+		return false;
+
+	Out.write((const char *)&Header, sizeof(CHeader));
+	Out.write((const char *)Records.data(), NumMaps * sizeof(CRecord));
+	Out.write((const char *)NameIndex.data(), NumMaps * 4);
+	Out.write((const char *)HashIndex.data(), NumMaps * 4);
+	Out.write(Names.data(), Names.size());
+	Out.close();
+
+	if (!Out)
+		return false;
+
+#ifdef WIN32
+	remove(path.c_str());
+#endif
+
+	return rename(TempPath.c_str(), path.c_str()) == 0;
+}
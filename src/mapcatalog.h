@@ -0,0 +1,116 @@
+/*
+
+Copyright [2010] [Josko Nikolic]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+CODE PORTED FROM THE ORIGINAL GHOST PROJECT: http://ghost.pwner.org/
+
+*/
+
+#ifndef AURA_MAPCATALOG_H_
+#define AURA_MAPCATALOG_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <stdint.h>
+
+class CMappedFile;
+struct CMapMetadata;
+
+//
+// CMapCatalog
+//
+
+// the metadata of every map in a maps directory in one binary file, written by ydhost-index (tools/mapindex)
+// the catalog is mapped and searched in place, opening it costs the same for ten maps as for ten thousand
+//
+// layout (all values little endian):
+//  header:     magic, version, number of maps, offsets of the records, the name index, the content index and the names
+//  records:    one fixed size CRecord per map
+//  name index: record numbers sorted by map file name
+//  hash index: record numbers sorted by map_info then map_size, to find a map by its content
+//  names:      the map file names, not terminated
+
+#define MAPCATALOG_MAGIC   0x5441434D // "MCAT"
+#define MAPCATALOG_VERSION 1
+
+class CMapCatalog
+{
+private:
+	struct CHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint32_t NumMaps;
+		uint32_t RecordsOffset;
+		uint32_t NameIndexOffset;
+		uint32_t HashIndexOffset;
+		uint32_t NamesOffset;
+		uint32_t NamesSize;
+	};
+
+	struct CRecord
+	{
+		uint32_t NameOffset;                      // into the names
+		uint32_t NameLength;
+		uint32_t Size;
+		uint32_t Info;
+		uint32_t CRC;
+		uint8_t SHA1[20];
+		uint16_t Width;
+		uint16_t Height;
+		uint8_t Options;
+		uint8_t NumSlots;
+		uint8_t Slots[12][9];
+		uint8_t Padding[2];
+	};
+
+	static_assert(sizeof(CRecord) == 156, "the record layout is part of the catalog format");
+
+	std::shared_ptr<CMappedFile> m_File;
+	const CRecord *m_Records;
+	const uint32_t *m_NameIndex;
+	const uint32_t *m_HashIndex;
+	const char *m_Names;
+	uint32_t m_NamesSize;
+	uint32_t m_NumMaps;
+
+public:
+	explicit CMapCatalog(const std::string &nPath);
+	~CMapCatalog();
+	CMapCatalog(CMapCatalog &) = delete;
+
+	inline bool GetValid() const                          { return m_Records != nullptr; }
+	inline uint32_t GetNumMaps() const                    { return m_NumMaps; }
+
+	// looks a map up by its file name, the metadata's LocalPath is left empty
+
+	bool Find(const std::string &name, CMapMetadata &metadata) const;
+
+	// looks a map up by the size and crc32 of the map file, e.g. to find a renamed map
+
+	bool FindByContent(uint32_t size, uint32_t info, std::string &name) const;
+
+	// writes a catalog of these maps (file name and metadata), returns false if the file can't be written
+
+	static bool Write(const std::string &path, const std::vector<std::pair<std::string, CMapMetadata>> &maps);
+
+private:
+	std::string GetName(const CRecord &record) const;
+	void GetMetadata(const CRecord &record, CMapMetadata &metadata) const;
+};
+
+#endif  // AURA_MAPCATALOG_H_
@@ -0,0 +1,188 @@
+/*
+
+Copyright [2010] [Josko Nikolic]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+CODE PORTED FROM THE ORIGINAL GHOST PROJECT: http://ghost.pwner.org/
+
+*/
+
+#include "maplibrary.h"
+#include "mapcache.h"
+#include "mapcatalog.h"
+#include "map.h"
+#include "gameslot.h"
+#include "config.h"
+
+#include <vector>
+#include <algorithm>
+
+uint32_t GetTicks();
+void Print(const std::string &message);
+
+//
+// CMapLibrary
+//
+
+CMapLibrary::CMapLibrary(const std::string &nMapDir, const std::string &nCatalogPath, const std::string &nCachePath, const std::string &nJASSPath, uint64_t nMemoryBudget, bool nHugePages)
+	: m_Catalog(nullptr),
+	m_MapDir(nMapDir),
+	m_CachePath(nCachePath),
+	m_JASSPath(nJASSPath),
+	m_MemoryBudget(nMemoryBudget),
+	m_HugePages(nHugePages)
+{
+	if (!nCatalogPath.empty())
+	{
+		m_Catalog = new CMapCatalog(nCatalogPath);
+
+		if (!m_Catalog->GetValid())
+		{
+			delete m_Catalog;
+			m_Catalog = nullptr;
+		}
+	}
+}
+
+CMapLibrary::~CMapLibrary()
+{
+	delete m_Catalog;
+}
+
+std::string CMapLibrary::GetFileName(const std::string &MapPath)
+{
+	const std::string::size_type Slash = MapPath.find_last_of("\\/");
+	return Slash == std::string::npos ? MapPath : MapPath.substr(Slash + 1);
+}
+
+std::string CMapLibrary::GetLocalPath(const std::string &MapPath) const
+{
+	if (m_MapDir.empty())
+		return CMap::GetLocalPath(MapPath);
+
+	return m_MapDir + "/" + GetFileName(MapPath);
+}
+
+std::shared_ptr<CMap> CMapLibrary::Get(const std::string &MapPath, const std::string &CFGPath)
+{
+	auto i = m_Maps.find(MapPath);
+
+	if (i != end(m_Maps))
+	{
+		i->second.LastUsed = GetTicks();
+		return i->second.Map;
+	}
+
+	std::shared_ptr<CMap> Map = Load(MapPath, CFGPath);
+
+	if (!Map)
+		return nullptr;
+
+	m_Maps[MapPath] = CEntry{ Map, GetTicks() };
+	Print("[MAP] loaded [" + MapPath + "], " + std::to_string(m_Maps.size()) + " maps are loaded (" + std::to_string(GetMappedBytes()) + " bytes mapped)");
+	Trim();
+	return Map;
+}
+
+std::shared_ptr<CMap> CMapLibrary::Load(const std::string &MapPath, const std::string &CFGPath) const
+{
+	std::shared_ptr<CMap> Map;
+	CMapMetadata Metadata;
+
+	if (CFGPath.empty() && m_Catalog && m_Catalog->Find(GetFileName(MapPath), Metadata))
+	{
+		Metadata.LocalPath = GetLocalPath(MapPath);
+		Map = std::make_shared<CMap>(MapPath, Metadata, m_HugePages);
+
+		// the map file was replaced since ydhost-index last ran, the catalog's metadata is for the old version
+
+		if (Map->GetValid() && !Map->GetMapDataLoaded())
+		{
+			Print("[MAP] the catalog entry for [" + MapPath + "] is out of date, scanning the map file instead");
+			Map.reset();
+		}
+	}
+
+	if (!Map)
+	{
+		std::string MapCFGPath = CFGPath;
+
+		if (MapCFGPath.empty())
+			MapCFGPath = CMapCache(m_CachePath, m_JASSPath).GetConfig(GetLocalPath(MapPath));
+
+		if (MapCFGPath.empty())
+			return nullptr;
+
+		CConfig MAP(MapCFGPath);
+		Map = std::make_shared<CMap>(MapPath, &MAP, m_HugePages);
+	}
+
+	if (!Map->GetValid())
+		return nullptr;
+
+	return Map;
+}
+
+void CMapLibrary::Replace(const std::string &MapPath, const std::shared_ptr<CMap> &Map)
+{
+	m_Maps[MapPath] = CEntry{ Map, GetTicks() };
+	Print("[MAP] replaced [" + MapPath + "], " + std::to_string(m_Maps.size()) + " maps are loaded (" + std::to_string(GetMappedBytes()) + " bytes mapped)");
+	Trim();
+}
+
+void CMapLibrary::Trim()
+{
+	// the library holds one reference itself, any other reference is a game hosting the map
+
+	const uint32_t Ticks = GetTicks();
+	std::vector<std::map<std::string, CEntry>::iterator> Unused;
+
+	for (auto i = begin(m_Maps); i != end(m_Maps); ++i)
+	{
+		if (i->second.Map.use_count() > 1)
+			i->second.LastUsed = Ticks;
+		else
+			Unused.push_back(i);
+	}
+
+	uint64_t MappedBytes = GetMappedBytes();
+
+	if (MappedBytes <= m_MemoryBudget)
+		return;
+
+	std::sort(begin(Unused), end(Unused), [](const std::map<std::string, CEntry>::iterator &a, const std::map<std::string, CEntry>::iterator &b)
+	{
+		return a->second.LastUsed < b->second.LastUsed;
+	});
+
+	for (auto & i : Unused)
+	{
+		if (MappedBytes <= m_MemoryBudget)
+			break;
+
+		Print("[MAP] unloading [" + i->first + "], it hasn't been used for " + std::to_string((Ticks - i->second.LastUsed) / 1000) + " seconds");
+		MappedBytes -= i->second.Map->GetMapDataSize();
+		m_Maps.erase(i);
+	}
+}
+
+uint64_t CMapLibrary::GetMappedBytes() const
+{
+	uint64_t MappedBytes = 0;
+
+	for (auto & entry : m_Maps)
+		MappedBytes += entry.second.Map->GetMapDataSize();
+
+	return MappedBytes;
+}
@@ -0,0 +1,91 @@
+/*
+
+Copyright [2010] [Josko Nikolic]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+CODE PORTED FROM THE ORIGINAL GHOST PROJECT: http://ghost.pwner.org/
+
+*/
+
+#ifndef AURA_MAPLIBRARY_H_
+#define AURA_MAPLIBRARY_H_
+
+#include <map>
+#include <memory>
+#include <string>
+#include <stdint.h>
+
+class CMap;
+class CMapCatalog;
+
+//
+// CMapLibrary
+//
+
+// loads maps on demand and shares each one (with its map parts and prebuilt packets) between every game hosting it
+// a map stays loaded while a game holds it, maps no game holds are unloaded least recently used first
+// once the loaded maps together map more than bot_mapmemory bytes
+// a map's metadata comes from its config, the map catalog (bot_mapcatalog) or, failing both, a scan of the map file
+
+class CMapLibrary
+{
+private:
+	struct CEntry
+	{
+		std::shared_ptr<CMap> Map;
+		uint32_t LastUsed;                        // GetTicks() of the last time a game held the map
+	};
+
+	std::map<std::string, CEntry> m_Maps;         // the loaded maps by map path
+	CMapCatalog *m_Catalog;                       // the metadata of the maps in m_MapDir written by ydhost-index (nullptr if there's no catalog)
+	std::string m_MapDir;                         // the local directory maps are loaded from (empty = where Warcraft III would find them relative to us)
+	std::string m_CachePath;                      // passed on to CMapCache
+	std::string m_JASSPath;                       // passed on to CMapCache
+	uint64_t m_MemoryBudget;                      // the most bytes of map files kept mapped before unused maps are unloaded
+	bool m_HugePages;
+
+public:
+	CMapLibrary(const std::string &nMapDir, const std::string &nCatalogPath, const std::string &nCachePath, const std::string &nJASSPath, uint64_t nMemoryBudget, bool nHugePages);
+	~CMapLibrary();
+	CMapLibrary(CMapLibrary &) = delete;
+
+	inline uint32_t GetNumMaps() const                    { return m_Maps.size(); }
+
+	// returns the map with this (Warcraft III) map path, loading it if it isn't loaded yet, or nullptr if it isn't valid
+	// the metadata is read from CFGPath, or looked up in the catalog or generated from the map file when CFGPath is empty
+
+	std::shared_ptr<CMap> Get(const std::string &MapPath, const std::string &CFGPath = std::string());
+
+	// loads the map the same way as Get but without adding it to the library, this is safe to call from another thread
+	// as long as the library isn't destroyed meanwhile, the map file is read again even if the map is already loaded
+
+	std::shared_ptr<CMap> Load(const std::string &MapPath, const std::string &CFGPath = std::string()) const;
+
+	// puts a map loaded with Load in the library, replacing the map loaded with this map path (games hosting the old map keep it)
+
+	void Replace(const std::string &MapPath, const std::shared_ptr<CMap> &Map);
+
+	// the local file the map with this map path is loaded from
+
+	std::string GetLocalPath(const std::string &MapPath) const;
+	static std::string GetFileName(const std::string &MapPath);
+
+	// unloads unused maps until the budget is met, call it whenever a game releases its map
+
+	void Trim();
+
+	uint64_t GetMappedBytes() const;
+};
+
+#endif  // AURA_MAPLIBRARY_H_
@@ -0,0 +1,279 @@
+/*
+
+Copyright [2010] [Josko Nikolic]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+CODE PORTED FROM THE ORIGINAL GHOST PROJECT: http://ghost.pwner.org/
+
+*/
+
+#include "mappedfile.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+void Print(const std::string &message);
+
+//
+// CMappedFile
+//
+
+// the identity of a file on disk and the version of it that's there right now
+
+struct CFileID
+{
+	uint64_t Device;
+	uint64_t Inode;
+	uint64_t MTime;
+	uint64_t Size;
+};
+
+#ifdef WIN32
+static bool GetFileID(void *file, CFileID &id)
+{
+	BY_HANDLE_FILE_INFORMATION Info;
+
+	if (!GetFileInformationByHandle(file, &Info))
+		return false;
+
+	id.Device = Info.dwVolumeSerialNumber;
+	id.Inode = ((uint64_t)Info.nFileIndexHigh << 32) | Info.nFileIndexLow;
+	id.MTime = ((uint64_t)Info.ftLastWriteTime.dwHighDateTime << 32) | Info.ftLastWriteTime.dwLowDateTime;
+	id.Size = ((uint64_t)Info.nFileSizeHigh << 32) | Info.nFileSizeLow;
+	return true;
+}
+
+static bool GetFileID(const std::string &path, CFileID &id)
+{
+	// stat doesn't know file indexes, the file is opened without any access just to ask for them
+
+	HANDLE File = CreateFileA(path.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, 0, nullptr);
+
+	if (File == INVALID_HANDLE_VALUE)
+		return false;
+
+	const bool Success = GetFileID(File, id);
+	CloseHandle(File);
+	return Success;
+}
+#else
+static void GetFileID(const struct stat &Stat, CFileID &id)
+{
+	id.Device = (uint64_t)Stat.st_dev;
+	id.Inode = (uint64_t)Stat.st_ino;
+	id.MTime = (uint64_t)Stat.st_mtime;
+	id.Size = (uint64_t)Stat.st_size;
+}
+
+static bool GetFileID(const std::string &path, CFileID &id)
+{
+	struct stat Stat;
+
+	if (stat(path.c_str(), &Stat) != 0)
+		return false;
+
+	GetFileID(Stat, id);
+	return true;
+}
+#endif
+
+std::map<std::string, std::weak_ptr<CMappedFile>> CMappedFile::m_Registry;
+std::mutex CMappedFile::m_RegistryMutex;
+
+CMappedFile::CMappedFile(const std::string &nPath)
+	: m_Path(nPath),
+	m_Data(nullptr),
+	m_Size(0),
+	m_MTime(0),
+	m_Device(0),
+	m_Inode(0)
+#ifdef WIN32
+	, m_File(INVALID_HANDLE_VALUE),
+	m_Mapping(nullptr)
+#endif
+{
+
+}
+
+CMappedFile::~CMappedFile()
+{
+#ifdef WIN32
+	if (m_Data)
+		UnmapViewOfFile(m_Data);
+
+	if (m_Mapping)
+		CloseHandle(m_Mapping);
+
+	if (m_File != INVALID_HANDLE_VALUE)
+		CloseHandle(m_File);
+#else
+	if (m_Data)
+		munmap((void *)m_Data, m_Size);
+#endif
+
+	std::lock_guard<std::mutex> Lock(m_RegistryMutex);
+	auto i = m_Registry.find(m_Path);
+
+	if (i != end(m_Registry) && i->second.expired())
+		m_Registry.erase(i);
+}
+
+std::shared_ptr<CMappedFile> CMappedFile::Open(const std::string &path, bool hugePages)
+{
+	// a file that was replaced since it was mapped (e.g. a new version of a map renamed over the old one) is mapped again
+	// the users of the old mapping keep it until they let go of it, only new users get the new file
+
+	CFileID ID = CFileID();
+	const bool Exists = GetFileID(path, ID);
+
+	{
+		std::lock_guard<std::mutex> Lock(m_RegistryMutex);
+		auto i = m_Registry.find(path);
+
+		if (i != end(m_Registry))
+		{
+			std::shared_ptr<CMappedFile> File = i->second.lock();
+
+			if (File && Exists && (ID.Device != File->m_Device || ID.Inode != File->m_Inode))
+				File.reset();
+
+			if (File && (!Exists || (ID.MTime == File->m_MTime && ID.Size == File->m_Size)))
+				return File;
+
+			// the same file changed, it was rewritten in place (e.g. by cp) while it's mapped and the old mapping sees the new data too
+			// the games using it may already be sending a mix of both versions, it's not mapped again as if nothing happened
+
+			if (File)
+			{
+				Print("[MAP] [" + path + "] was rewritten while it's in use, install a new version by renaming it over the old file or under a new name");
+				return nullptr;
+			}
+		}
+	}
+
+	// the file is mapped without holding the lock, a failed mapping's destructor takes it again
+
+	std::shared_ptr<CMappedFile> File(new CMappedFile(path));
+
+	if (!File->Map(hugePages))
+		return nullptr;
+
+	std::lock_guard<std::mutex> Lock(m_RegistryMutex);
+	m_Registry[path] = File;
+	return File;
+}
+
+bool CMappedFile::Map(bool hugePages)
+{
+	// W3GS_MAPPART offsets are 32 bit and Warcraft III won't take maps anywhere near that big anyway
+
+#ifdef WIN32
+	m_File = CreateFileA(m_Path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+	if (m_File == INVALID_HANDLE_VALUE)
+	{
+		Print("[MAP] unable to open [" + m_Path + "] (error " + std::to_string(GetLastError()) + ")");
+		return false;
+	}
+
+	LARGE_INTEGER Size;
+
+	if (!GetFileSizeEx(m_File, &Size) || Size.QuadPart == 0 || Size.QuadPart > 0x7FFFFFFF)
+	{
+		Print("[MAP] unable to map [" + m_Path + "], the file is empty or too big");
+		return false;
+	}
+
+	m_Mapping = CreateFileMappingA(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+	if (m_Mapping)
+		m_Data = (const uint8_t *)MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0);
+
+	if (!m_Data)
+	{
+		Print("[MAP] unable to map [" + m_Path + "] (error " + std::to_string(GetLastError()) + ")");
+		return false;
+	}
+
+	m_Size = (uint32_t)Size.QuadPart;
+
+	// the file can't be written while we have it open so this is the version that was mapped
+
+	CFileID ID = CFileID();
+
+	if (GetFileID(m_File, ID))
+	{
+		m_MTime = ID.MTime;
+		m_Device = ID.Device;
+		m_Inode = ID.Inode;
+	}
+#else
+	const int fd = open(m_Path.c_str(), O_RDONLY);
+
+	if (fd == -1)
+	{
+		Print("[MAP] unable to open [" + m_Path + "]");
+		return false;
+	}
+
+	struct stat Stat;
+
+	if (fstat(fd, &Stat) != 0 || Stat.st_size == 0 || Stat.st_size > 0x7FFFFFFF)
+	{
+		Print("[MAP] unable to map [" + m_Path + "], the file is empty or too big");
+		close(fd);
+		return false;
+	}
+
+	// the mapping keeps the file open, the descriptor isn't needed after this
+
+	void *Data = mmap(nullptr, Stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (Data == MAP_FAILED)
+	{
+		Print("[MAP] unable to map [" + m_Path + "]");
+		return false;
+	}
+
+	m_Data = (const uint8_t *)Data;
+	CFileID ID = CFileID();
+	GetFileID(Stat, ID);
+	m_Size = (uint32_t)Stat.st_size;
+	m_MTime = ID.MTime;
+	m_Device = ID.Device;
+	m_Inode = ID.Inode;
+
+	// downloads read the map front to back, let the kernel read ahead aggressively and start on it right away
+
+	madvise(Data, m_Size, MADV_SEQUENTIAL);
+	madvise(Data, m_Size, MADV_WILLNEED);
+
+#ifdef MADV_HUGEPAGE
+	if (hugePages && madvise(Data, m_Size, MADV_HUGEPAGE) != 0)
+		Print("[MAP] huge pages aren't available for [" + m_Path + "]");
+#endif
+#endif
+
+	Print("[MAP] mapped [" + m_Path + "] (" + std::to_string(m_Size) + " bytes)");
+	return true;
+}
@@ -0,0 +1,80 @@
+/*
+
+Copyright [2010] [Josko Nikolic]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+CODE PORTED FROM THE ORIGINAL GHOST PROJECT: http://ghost.pwner.org/
+
+*/
+
+#ifndef AURA_MAPPEDFILE_H_
+#define AURA_MAPPEDFILE_H_
+
+#include <string>
+#include <memory>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+
+//
+// CMappedFile
+//
+
+// a file mapped read-only into memory, the map downloads are served straight from the page cache
+// every open file is kept in a registry so that all the maps (and through them all the games) using the same file share one mapping
+// the mapping is released when the last user lets go of it, files can be opened and released from any thread
+// a file should be replaced by writing the new version next to it and renaming it over the old one, never rewritten in place
+// a file rewritten in place changes under the mappings that already use it, so it isn't mapped again until every user let go of it
+
+class CMappedFile
+{
+private:
+	static std::map<std::string, std::weak_ptr<CMappedFile>> m_Registry;
+	static std::mutex m_RegistryMutex;
+
+	std::string m_Path;
+	const uint8_t *m_Data;
+	uint32_t m_Size;
+	uint64_t m_MTime;                             // the modification time of the file when it was mapped
+	uint64_t m_Device;                            // the device and inode of the file that was mapped (the volume serial number and file index on Windows)
+	uint64_t m_Inode;
+#ifdef WIN32
+	void *m_File;
+	void *m_Mapping;
+#endif
+
+	CMappedFile(const std::string &nPath);
+
+public:
+	~CMappedFile();
+	CMappedFile(CMappedFile &) = delete;
+
+	inline const std::string &GetPath() const             { return m_Path; }
+	inline const uint8_t *GetData() const                 { return m_Data; }
+	inline uint32_t GetSize() const                       { return m_Size; }
+
+	// returns true if both are mappings of the same file on disk, even if it was renamed or changed in between
+
+	inline bool IsSameFile(const CMappedFile &other) const { return m_Device == other.m_Device && m_Inode == other.m_Inode; }
+
+	// returns the shared mapping of the file or nullptr if it can't be mapped
+	// with hugePages the kernel is asked to back the mapping with huge pages where it can (Linux only)
+
+	static std::shared_ptr<CMappedFile> Open(const std::string &path, bool hugePages);
+
+private:
+	bool Map(bool hugePages);
+};
+
+#endif  // AURA_MAPPEDFILE_H_
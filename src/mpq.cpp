@@ -0,0 +1,370 @@
+/*
+
+Copyright [2010] [Josko Nikolic]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+CODE PORTED FROM THE ORIGINAL GHOST PROJECT: http://ghost.pwner.org/
+
+*/
+
+#include "mpq.h"
+#include "mappedfile.h"
+#include "explode.h"
+#include "crc32.h"
+#include "workpool.h"
+
+#include <cstring>
+#include <algorithm>
+#include <new>
+#include <zlib.h>
+#include <bzlib.h>
+
+// the table every MPQ hash and the encryption are built on
+// it's built the first time it's needed, function local statics are initialized once even with several threads reading archives
+
+struct CCryptTable
+{
+	uint32_t Table[0x500];
+
+	CCryptTable()
+	{
+		uint32_t Seed = 0x00100001;
+
+		for (uint32_t Index1 = 0; Index1 < 0x100; ++Index1)
+		{
+			for (uint32_t Index2 = Index1, i = 0; i < 5; ++i, Index2 += 0x100)
+			{
+				Seed = (Seed * 125 + 3) % 0x2AAAAB;
+				const uint32_t Temp1 = (Seed & 0xFFFF) << 0x10;
+				Seed = (Seed * 125 + 3) % 0x2AAAAB;
+				const uint32_t Temp2 = Seed & 0xFFFF;
+				Table[Index2] = Temp1 | Temp2;
+			}
+		}
+	}
+};
+
+static const uint32_t *GetCryptTable()
+{
+	static const CCryptTable CryptTable;
+	return CryptTable.Table;
+}
+
+//
+// CMPQArchive
+//
+
+CMPQArchive::CMPQArchive(const std::shared_ptr<CMappedFile> &nFile)
+	: m_File(nFile),
+	m_Archive(nullptr),
+	m_ArchiveSize(0),
+	m_SectorSize(0),
+	m_Valid(false),
+	m_SplitSectors(true)
+{
+	const uint8_t *Data = m_File->GetData();
+	const uint32_t Size = m_File->GetSize();
+
+	// the archive header is on a 512 byte boundary, maps have their own header in the first 512 bytes
+
+	for (uint32_t Offset = 0; Offset + 32 <= Size; Offset += 512)
+	{
+		if (memcmp(Data + Offset, "MPQ\x1A", 4) == 0)
+		{
+			m_Archive = Data + Offset;
+			m_ArchiveSize = Size - Offset;
+			break;
+		}
+	}
+
+	if (!m_Archive)
+		return;
+
+	uint16_t BlockSize;
+	uint32_t HashTablePos, BlockTablePos, HashTableSize, BlockTableSize;
+	memcpy(&BlockSize, m_Archive + 14, 2);
+	memcpy(&HashTablePos, m_Archive + 16, 4);
+	memcpy(&BlockTablePos, m_Archive + 20, 4);
+	memcpy(&HashTableSize, m_Archive + 24, 4);
+	memcpy(&BlockTableSize, m_Archive + 28, 4);
+
+	if (BlockSize > 20 || HashTableSize == 0 || HashTablePos >= m_ArchiveSize || BlockTablePos >= m_ArchiveSize)
+		return;
+
+	m_SectorSize = 512 << BlockSize;
+
+	// protected maps often claim tables bigger than the archive, only what's actually there can be read
+
+	HashTableSize = std::min<uint32_t>(HashTableSize, (m_ArchiveSize - HashTablePos) / sizeof(CHashEntry));
+	BlockTableSize = std::min<uint32_t>(BlockTableSize, (m_ArchiveSize - BlockTablePos) / sizeof(CBlockEntry));
+
+	m_HashTable.resize(HashTableSize);
+	memcpy(m_HashTable.data(), m_Archive + HashTablePos, HashTableSize * sizeof(CHashEntry));
+	Decrypt((uint32_t *)m_HashTable.data(), HashTableSize * sizeof(CHashEntry), HashString("(hash table)", 3));
+
+	m_BlockTable.resize(BlockTableSize);
+	memcpy(m_BlockTable.data(), m_Archive + BlockTablePos, BlockTableSize * sizeof(CBlockEntry));
+	Decrypt((uint32_t *)m_BlockTable.data(), BlockTableSize * sizeof(CBlockEntry), HashString("(block table)", 3));
+
+	m_Valid = !m_HashTable.empty();
+}
+
+CMPQArchive::~CMPQArchive()
+{
+
+}
+
+uint32_t CMPQArchive::HashString(const std::string &str, uint32_t type)
+{
+	const uint32_t *CryptTable = GetCryptTable();
+	uint32_t Seed1 = 0x7FED7FED;
+	uint32_t Seed2 = 0xEEEEEEEE;
+
+	for (auto c : str)
+	{
+		// names are case insensitive and use back slashes
+
+		uint32_t Ch = (uint8_t)toupper((uint8_t)c);
+
+		if (Ch == '/')
+			Ch = '\\';
+
+		Seed1 = CryptTable[type * 0x100 + Ch] ^ (Seed1 + Seed2);
+		Seed2 = Ch + Seed1 + Seed2 + (Seed2 << 5) + 3;
+	}
+
+	return Seed1;
+}
+
+void CMPQArchive::Decrypt(uint32_t *data, uint32_t length, uint32_t key)
+{
+	// length is in bytes, a trailing partial dword isn't encrypted
+
+	const uint32_t *CryptTable = GetCryptTable();
+	uint32_t Seed = 0xEEEEEEEE;
+
+	for (uint32_t i = 0; i < length / 4; ++i)
+	{
+		Seed += CryptTable[0x400 + (key & 0xFF)];
+		const uint32_t Ch = data[i] ^ (key + Seed);
+		key = ((~key << 0x15) + 0x11111111) | (key >> 0x0B);
+		Seed = Ch + Seed + (Seed << 5) + 3;
+		data[i] = Ch;
+	}
+}
+
+const CMPQArchive::CBlockEntry *CMPQArchive::FindFile(const std::string &name) const
+{
+	const uint32_t Start = HashString(name, 0) % m_HashTable.size();
+	const uint32_t Name1 = HashString(name, 1);
+	const uint32_t Name2 = HashString(name, 2);
+	const CBlockEntry *Found = nullptr;
+
+	// walk the hash table from the name's position until an empty entry, prefer the neutral locale like Warcraft III does
+
+	for (uint32_t i = 0; i < m_HashTable.size(); ++i)
+	{
+		const CHashEntry &Entry = m_HashTable[(Start + i) % m_HashTable.size()];
+
+		if (Entry.BlockIndex == 0xFFFFFFFF)
+			break;
+
+		if (Entry.Name1 != Name1 || Entry.Name2 != Name2 || Entry.BlockIndex >= m_BlockTable.size())
+			continue;
+
+		if ((Entry.Locale & 0xFFFF) == 0)
+			return &m_BlockTable[Entry.BlockIndex];
+
+		if (!Found)
+			Found = &m_BlockTable[Entry.BlockIndex];
+	}
+
+	return Found;
+}
+
+bool CMPQArchive::GetFileKey(const std::string &name, CMPQFileKey &key) const
+{
+	if (!m_Valid)
+		return false;
+
+	const CBlockEntry *Block = FindFile(name);
+
+	if (!Block || !(Block->Flags & MPQ_FILE_EXISTS) || (uint64_t)Block->FilePos + Block->CompressedSize > m_ArchiveSize)
+		return false;
+
+	key.FileSize = Block->FileSize;
+	key.CompressedSize = Block->CompressedSize;
+	key.Flags = Block->Flags;
+	key.CRC = CRC32(m_Archive + Block->FilePos, Block->CompressedSize);
+	return true;
+}
+
+bool CMPQArchive::ReadFile(const std::string &name, std::string &data) const
+{
+	if (!m_Valid)
+		return false;
+
+	const CBlockEntry *Block = FindFile(name);
+
+	if (!Block || !(Block->Flags & MPQ_FILE_EXISTS) || (uint64_t)Block->FilePos + Block->CompressedSize > m_ArchiveSize)
+		return false;
+
+	const uint8_t *Raw = m_Archive + Block->FilePos;
+	uint32_t Key = 0;
+
+	if (Block->Flags & MPQ_FILE_ENCRYPTED)
+	{
+		const std::string::size_type Slash = name.find_last_of("\\/");
+		Key = HashString(Slash == std::string::npos ? name : name.substr(Slash + 1), 3);
+
+		if (Block->Flags & MPQ_FILE_FIX_KEY)
+			Key = (Key + Block->FilePos) ^ Block->FileSize;
+	}
+
+	// the sizes come from the archive and protected maps lie about them, nothing can decompress to more than MPQ_MAX_RATIO times its size
+	// and a file that isn't compressed is exactly as big as it's stored
+
+	const bool Compressed = (Block->Flags & (MPQ_FILE_COMPRESS | MPQ_FILE_IMPLODE)) != 0;
+
+	if (Block->FileSize > (Compressed ? (uint64_t)Block->CompressedSize * MPQ_MAX_RATIO : Block->CompressedSize))
+		return false;
+
+	try
+	{
+		data.resize(Block->FileSize);
+	}
+	catch (const std::bad_alloc &)
+	{
+		return false;
+	}
+
+	uint8_t *Out = (uint8_t *)&data[0];
+
+	if (Block->FileSize == 0)
+		return true;
+
+	if (Block->Flags & MPQ_FILE_SINGLE_UNIT)
+		return ReadSector(*Block, Raw, Block->CompressedSize, Key, Out, Block->FileSize);
+
+	const uint32_t NumSectors = (Block->FileSize + m_SectorSize - 1) / m_SectorSize;
+
+	if (!Compressed)
+	{
+		// uncompressed sectors simply follow each other
+
+		for (uint32_t i = 0; i < NumSectors; ++i)
+		{
+			const uint32_t Length = std::min<uint32_t>(m_SectorSize, Block->FileSize - i * m_SectorSize);
+
+			if (!ReadSector(*Block, Raw + i * m_SectorSize, Length, Key + i, Out + i * m_SectorSize, Length))
+				return false;
+		}
+
+		return true;
+	}
+
+	// compressed sectors are found through the sector offset table in front of them
+
+	const uint32_t NumOffsets = NumSectors + 1 + ((Block->Flags & MPQ_FILE_SECTOR_CRC) ? 1 : 0);
+
+	if ((uint64_t)NumOffsets * 4 > Block->CompressedSize)
+		return false;
+
+	std::vector<uint32_t> Offsets(NumOffsets);
+	memcpy(Offsets.data(), Raw, NumOffsets * 4);
+
+	if (Block->Flags & MPQ_FILE_ENCRYPTED)
+		Decrypt(Offsets.data(), NumOffsets * 4, Key - 1);
+
+	// sectors don't depend on each other, a big file is split into runs of sectors decompressed on the shared work pool
+
+	const uint32_t NumTasks = (NumSectors + MPQ_SECTORS_PER_TASK - 1) / MPQ_SECTORS_PER_TASK;
+
+	if (NumTasks <= 1 || !m_SplitSectors)
+		return ReadSectors(*Block, Raw, Offsets, Key, Out, 0, NumSectors);
+
+	return CWorkPool::Get().Run(NumTasks, [&](uint32_t task)
+	{
+		return ReadSectors(*Block, Raw, Offsets, Key, Out, task * MPQ_SECTORS_PER_TASK, std::min<uint32_t>((task + 1) * MPQ_SECTORS_PER_TASK, NumSectors));
+	});
+}
+
+bool CMPQArchive::ReadSectors(const CBlockEntry &block, const uint8_t *raw, const std::vector<uint32_t> &offsets, uint32_t key, uint8_t *out, uint32_t first, uint32_t last) const
+{
+	for (uint32_t i = first; i < last; ++i)
+	{
+		const uint32_t Length = std::min<uint32_t>(m_SectorSize, block.FileSize - i * m_SectorSize);
+
+		if (offsets[i] > offsets[i + 1] || offsets[i + 1] > block.CompressedSize)
+			return false;
+
+		if (!ReadSector(block, raw + offsets[i], offsets[i + 1] - offsets[i], key + i, out + i * m_SectorSize, Length))
+			return false;
+	}
+
+	return true;
+}
+
+bool CMPQArchive::ReadSector(const CBlockEntry &block, const uint8_t *sector, uint32_t sectorLength, uint32_t key, uint8_t *out, uint32_t outLength) const
+{
+	// the mapping is read-only so encrypted sectors are decrypted in a copy
+
+	std::vector<uint32_t> Buffer;
+
+	if (block.Flags & MPQ_FILE_ENCRYPTED)
+	{
+		Buffer.resize((sectorLength + 3) / 4);
+		memcpy(Buffer.data(), sector, sectorLength);
+		Decrypt(Buffer.data(), sectorLength, key);
+		sector = (const uint8_t *)Buffer.data();
+	}
+
+	// a sector that wouldn't get any smaller is stored as it is
+
+	if (sectorLength >= outLength)
+	{
+		memcpy(out, sector, outLength);
+		return true;
+	}
+
+	// imploded files don't have a compression mask, compressed sectors start with one
+	// combinations of compressions and the audio only ones (huffman, adpcm) aren't used by maps and aren't supported
+
+	if (block.Flags & MPQ_FILE_IMPLODE)
+		return Explode(sector, sectorLength, out, outLength);
+
+	if (!(block.Flags & MPQ_FILE_COMPRESS) || sectorLength < 2)
+		return false;
+
+	switch (sector[0])
+	{
+	case MPQ_COMPRESSION_ZLIB:
+	{
+		uLongf Length = outLength;
+		return uncompress(out, &Length, sector + 1, sectorLength - 1) == Z_OK && Length == outLength;
+	}
+
+	case MPQ_COMPRESSION_PKWARE:
+		return Explode(sector + 1, sectorLength - 1, out, outLength);
+
+	case MPQ_COMPRESSION_BZIP2:
+	{
+		unsigned int Length = outLength;
+		return BZ2_bzBuffToBuffDecompress((char *)out, &Length, (char *)sector + 1, sectorLength - 1, 0, 0) == BZ_OK && Length == outLength;
+	}
+
+	default:
+		return false;
+	}
+}
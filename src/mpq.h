@@ -0,0 +1,131 @@
+/*
+
+Copyright [2010] [Josko Nikolic]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+CODE PORTED FROM THE ORIGINAL GHOST PROJECT: http://ghost.pwner.org/
+
+*/
+
+#ifndef AURA_MPQ_H_
+#define AURA_MPQ_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdint.h>
+
+class CMappedFile;
+
+//
+// CMPQArchive
+//
+
+// reads files out of an MPQ archive (a .w3x or .w3m map) straight from a mapping of the archive
+// the archive is always treated as a version 1 archive like StormLib's MPQ_OPEN_FORCE_MPQ_V1 does
+// because map protectors like to put garbage in the fields newer versions added
+
+#define MPQ_FILE_IMPLODE         0x00000100 // the file is compressed with PKWARE DCL, without a compression mask byte
+#define MPQ_FILE_COMPRESS        0x00000200 // every sector starts with a compression mask byte
+#define MPQ_FILE_ENCRYPTED       0x00010000
+#define MPQ_FILE_FIX_KEY         0x00020000 // the encryption key depends on the file's position and size
+#define MPQ_FILE_SINGLE_UNIT     0x01000000 // the file is one sector instead of a sequence of BlockSize sectors
+#define MPQ_FILE_SECTOR_CRC      0x04000000 // the sector offset table has an extra entry for the sector checksums
+#define MPQ_FILE_EXISTS          0x80000000
+
+#define MPQ_COMPRESSION_ZLIB           0x02
+#define MPQ_COMPRESSION_PKWARE         0x08
+#define MPQ_COMPRESSION_BZIP2          0x10
+
+// big files have their sectors decompressed on the work pool in runs of this many sectors
+
+#define MPQ_SECTORS_PER_TASK           16
+
+// a file claiming to decompress to more than this many times its stored size is refused before anything is allocated
+// zlib can't do better than 1032:1 and PKWARE DCL and bzip2 sectors of real maps don't get anywhere near it
+
+#define MPQ_MAX_RATIO                  1032
+
+// identifies the stored contents of a file without decompressing it, the crc is of the stored (compressed, encrypted) bytes
+
+struct CMPQFileKey
+{
+	uint32_t FileSize;
+	uint32_t CompressedSize;
+	uint32_t Flags;
+	uint32_t CRC;
+
+	bool operator==(const CMPQFileKey &other) const
+	{
+		return FileSize == other.FileSize && CompressedSize == other.CompressedSize && Flags == other.Flags && CRC == other.CRC;
+	}
+};
+
+class CMPQArchive
+{
+private:
+	struct CHashEntry
+	{
+		uint32_t Name1;
+		uint32_t Name2;
+		uint32_t Locale;                          // locale (low 16 bits) and platform (high 16 bits)
+		uint32_t BlockIndex;
+	};
+
+	struct CBlockEntry
+	{
+		uint32_t FilePos;
+		uint32_t CompressedSize;
+		uint32_t FileSize;
+		uint32_t Flags;
+	};
+
+	std::shared_ptr<CMappedFile> m_File;
+	const uint8_t *m_Archive;                     // the start of the archive inside m_File (maps have a 512 byte header in front of it)
+	uint32_t m_ArchiveSize;                       // the bytes from m_Archive to the end of m_File
+	uint32_t m_SectorSize;
+	std::vector<CHashEntry> m_HashTable;
+	std::vector<CBlockEntry> m_BlockTable;
+	bool m_Valid;
+	bool m_SplitSectors;                          // if big files are decompressed on the work pool (MPQ_SECTORS_PER_TASK sectors per task)
+
+public:
+	explicit CMPQArchive(const std::shared_ptr<CMappedFile> &nFile);
+	~CMPQArchive();
+	CMPQArchive(CMPQArchive &) = delete;
+
+	inline bool GetValid() const                          { return m_Valid; }
+
+	// big files are split over the work pool by default, ydhost-selftest turns it off to time the difference
+
+	inline void SetSplitSectors(bool nSplitSectors)       { m_SplitSectors = nSplitSectors; }
+
+	// reads the whole file into data, returns false if the archive doesn't have the file or it can't be read
+
+	bool ReadFile(const std::string &name, std::string &data) const;
+
+	// returns false if the archive doesn't have the file
+
+	bool GetFileKey(const std::string &name, CMPQFileKey &key) const;
+
+	static uint32_t HashString(const std::string &str, uint32_t type);
+	static void Decrypt(uint32_t *data, uint32_t length, uint32_t key);
+
+private:
+	const CBlockEntry *FindFile(const std::string &name) const;
+	bool ReadSectors(const CBlockEntry &block, const uint8_t *raw, const std::vector<uint32_t> &offsets, uint32_t key, uint8_t *out, uint32_t first, uint32_t last) const;
+	bool ReadSector(const CBlockEntry &block, const uint8_t *sector, uint32_t sectorLength, uint32_t key, uint8_t *out, uint32_t outLength) const;
+};
+
+#endif  // AURA_MPQ_H_
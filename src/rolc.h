@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace hash
+{
+	class rolc {
+	public:
+		rolc()
+			: init(false)
+			, h(0)
+		{ }
+
+		static uint32_t rol3(uint32_t x)
+		{
+			return (x << 3) | (x >> 29);
+		}
+
+		static uint32_t rol(uint32_t x, uint32_t bits)
+		{
+			return (x << bits) | (x >> ((32 - bits) & 31));
+		}
+
+		static uint32_t load(const unsigned char* p)
+		{
+			return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+		}
+
+		// the value of one buffer on its own, buffers are independent of each other so they can be hashed on different threads
+		// and chained with update(uint32_t) afterwards in the original order
+		//
+		// the words of a buffer are chained as h = rol3(h ^ w), but rol3 distributes over xor so that unrolls to
+		// the xor of every word rotated by 3 * (the number of words from it to the end)
+		// the rotation repeats every 32 words, words 32 apart are xored together first without any dependency between them
+		// (the loop vectorizes) and the 32 lanes are rotated into place once at the end
+
+		static uint32_t block(const unsigned char* buf, size_t len)
+		{
+			const size_t words = len / 4;
+			uint32_t lanes[32] = { 0 };
+			size_t i = 0;
+			for (; i + 32 <= words; i += 32) {
+				for (size_t j = 0; j < 32; ++j) {
+					lanes[j] ^= load(buf + (i + j) * 4);
+				}
+			}
+			for (; i < words; ++i) {
+				lanes[i & 31] ^= load(buf + i * 4);
+			}
+			uint32_t h = 0;
+			for (size_t j = 0; j < 32; ++j) {
+				h ^= rol(lanes[j], (uint32_t)(3 * ((words - j) & 31)) & 31);
+			}
+			for (i = words * 4; i < len; ++i) {
+				h = rol3(h ^ (uint32_t)buf[i]);
+			}
+			return h;
+		}
+
+		void update(const unsigned char* buf, size_t len)
+		{
+			update(block(buf, len));
+		}
+
+		void update(uint32_t v)
+		{
+			if (!init) {
+				init = true;
+				h = v;
+			}
+			else {
+				h = rol3(h ^ v);
+			}
+		}
+
+		uint32_t final()
+		{
+			return init ? h : 0;
+		}
+
+	private:
+		bool     init;
+		uint32_t h;
+	};
+}
@@ -0,0 +1,332 @@
+#include "sha1.h"
+#include <string.h>
+
+// the block function is picked once at runtime:
+//  - the SHA extensions (SHA-NI) on x86 CPUs that have them, several times faster than the portable rounds
+//  - the portable rounds everywhere else
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define SHA1_HAVE_SHANI
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SHA1_TARGET_SHANI
+#else
+#include <cpuid.h>
+#define SHA1_TARGET_SHANI __attribute__((target("sha,ssse3,sse4.1")))
+#endif
+#endif
+
+namespace hash
+{
+#define rol(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
+
+#if BYTE_ORDER == LITTLE_ENDIAN
+#define blk0(i) (block->l[i] = (rol(block->l[i],24)&0xFF00FF00)|(rol(block->l[i],8)&0x00FF00FF))
+#elif BYTE_ORDER == BIG_ENDIAN
+#define blk0(i) block->l[i]
+#else
+#error "Endianness not defined!"
+#endif
+#define blk(i) (block->l[i&15] = rol(block->l[(i+13)&15]^block->l[(i+8)&15]^block->l[(i+2)&15]^block->l[i&15],1))
+
+#define R0(v,w,x,y,z,i) z+=((w&(x^y))^y)+blk0(i)+0x5A827999+rol(v,5);w=rol(w,30);
+#define R1(v,w,x,y,z,i) z+=((w&(x^y))^y)+blk(i)+0x5A827999+rol(v,5);w=rol(w,30);
+#define R2(v,w,x,y,z,i) z+=(w^x^y)+blk(i)+0x6ED9EBA1+rol(v,5);w=rol(w,30);
+#define R3(v,w,x,y,z,i) z+=(((w|x)&y)|(w&x))+blk(i)+0x8F1BBCDC+rol(v,5);w=rol(w,30);
+#define R4(v,w,x,y,z,i) z+=(w^x^y)+blk(i)+0xCA62C1D6+rol(v,5);w=rol(w,30);
+
+	static void transform(uint32_t state[5], const unsigned char buffer[64])
+	{
+		uint32_t a, b, c, d, e;
+		typedef union
+		{
+			unsigned char c[64];
+			uint32_t l[16];
+		} CHAR64LONG16;
+		CHAR64LONG16 block[1];
+		memcpy(block, buffer, 64);
+
+		a = state[0];
+		b = state[1];
+		c = state[2];
+		d = state[3];
+		e = state[4];
+		R0(a, b, c, d, e, 0);
+		R0(e, a, b, c, d, 1);
+		R0(d, e, a, b, c, 2);
+		R0(c, d, e, a, b, 3);
+		R0(b, c, d, e, a, 4);
+		R0(a, b, c, d, e, 5);
+		R0(e, a, b, c, d, 6);
+		R0(d, e, a, b, c, 7);
+		R0(c, d, e, a, b, 8);
+		R0(b, c, d, e, a, 9);
+		R0(a, b, c, d, e, 10);
+		R0(e, a, b, c, d, 11);
+		R0(d, e, a, b, c, 12);
+		R0(c, d, e, a, b, 13);
+		R0(b, c, d, e, a, 14);
+		R0(a, b, c, d, e, 15);
+		R1(e, a, b, c, d, 16);
+		R1(d, e, a, b, c, 17);
+		R1(c, d, e, a, b, 18);
+		R1(b, c, d, e, a, 19);
+		R2(a, b, c, d, e, 20);
+		R2(e, a, b, c, d, 21);
+		R2(d, e, a, b, c, 22);
+		R2(c, d, e, a, b, 23);
+		R2(b, c, d, e, a, 24);
+		R2(a, b, c, d, e, 25);
+		R2(e, a, b, c, d, 26);
+		R2(d, e, a, b, c, 27);
+		R2(c, d, e, a, b, 28);
+		R2(b, c, d, e, a, 29);
+		R2(a, b, c, d, e, 30);
+		R2(e, a, b, c, d, 31);
+		R2(d, e, a, b, c, 32);
+		R2(c, d, e, a, b, 33);
+		R2(b, c, d, e, a, 34);
+		R2(a, b, c, d, e, 35);
+		R2(e, a, b, c, d, 36);
+		R2(d, e, a, b, c, 37);
+		R2(c, d, e, a, b, 38);
+		R2(b, c, d, e, a, 39);
+		R3(a, b, c, d, e, 40);
+		R3(e, a, b, c, d, 41);
+		R3(d, e, a, b, c, 42);
+		R3(c, d, e, a, b, 43);
+		R3(b, c, d, e, a, 44);
+		R3(a, b, c, d, e, 45);
+		R3(e, a, b, c, d, 46);
+		R3(d, e, a, b, c, 47);
+		R3(c, d, e, a, b, 48);
+		R3(b, c, d, e, a, 49);
+		R3(a, b, c, d, e, 50);
+		R3(e, a, b, c, d, 51);
+		R3(d, e, a, b, c, 52);
+		R3(c, d, e, a, b, 53);
+		R3(b, c, d, e, a, 54);
+		R3(a, b, c, d, e, 55);
+		R3(e, a, b, c, d, 56);
+		R3(d, e, a, b, c, 57);
+		R3(c, d, e, a, b, 58);
+		R3(b, c, d, e, a, 59);
+		R4(a, b, c, d, e, 60);
+		R4(e, a, b, c, d, 61);
+		R4(d, e, a, b, c, 62);
+		R4(c, d, e, a, b, 63);
+		R4(b, c, d, e, a, 64);
+		R4(a, b, c, d, e, 65);
+		R4(e, a, b, c, d, 66);
+		R4(d, e, a, b, c, 67);
+		R4(c, d, e, a, b, 68);
+		R4(b, c, d, e, a, 69);
+		R4(a, b, c, d, e, 70);
+		R4(e, a, b, c, d, 71);
+		R4(d, e, a, b, c, 72);
+		R4(c, d, e, a, b, 73);
+		R4(b, c, d, e, a, 74);
+		R4(a, b, c, d, e, 75);
+		R4(e, a, b, c, d, 76);
+		R4(d, e, a, b, c, 77);
+		R4(c, d, e, a, b, 78);
+		R4(b, c, d, e, a, 79);
+		state[0] += a;
+		state[1] += b;
+		state[2] += c;
+		state[3] += d;
+		state[4] += e;
+	}
+
+	static void transform_portable(uint32_t state[5], const unsigned char* data, size_t blocks)
+	{
+		for (; blocks > 0; --blocks, data += 64)
+			transform(state, data);
+	}
+
+#ifdef SHA1_HAVE_SHANI
+	// four rounds per sha1rnds4, the message schedule for four rounds ahead is computed with sha1msg1/sha1msg2
+	// w holds the last four groups of four message words, group g + 4 replaces group g once rounds g are done
+
+#define SHANI_ROUNDS(g, f) \
+	e = _mm_sha1nexte_epu32(e_prev, w[(g) & 3]); \
+	e_prev = abcd; \
+	abcd = _mm_sha1rnds4_epu32(abcd, e, f); \
+	if ((g) < 16) w[(g) & 3] = _mm_sha1msg2_epu32(_mm_xor_si128(_mm_sha1msg1_epu32(w[(g) & 3], w[((g) + 1) & 3]), w[((g) + 2) & 3]), w[((g) + 3) & 3]);
+
+	SHA1_TARGET_SHANI
+	static void transform_shani(uint32_t state[5], const unsigned char* data, size_t blocks)
+	{
+		const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+		__m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0x1B);
+		__m128i e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+
+		for (; blocks > 0; --blocks, data += 64)
+		{
+			const __m128i abcd_save = abcd;
+			const __m128i e0_save = e0;
+			__m128i w[4], e, e_prev;
+
+			for (int i = 0; i < 4; ++i)
+				w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + i * 16)), mask);
+
+			e = _mm_add_epi32(e0, w[0]);
+			e_prev = abcd;
+			abcd = _mm_sha1rnds4_epu32(abcd, e, 0);
+			w[0] = _mm_sha1msg2_epu32(_mm_xor_si128(_mm_sha1msg1_epu32(w[0], w[1]), w[2]), w[3]);
+
+			SHANI_ROUNDS(1, 0) SHANI_ROUNDS(2, 0) SHANI_ROUNDS(3, 0) SHANI_ROUNDS(4, 0)
+			SHANI_ROUNDS(5, 1) SHANI_ROUNDS(6, 1) SHANI_ROUNDS(7, 1) SHANI_ROUNDS(8, 1) SHANI_ROUNDS(9, 1)
+			SHANI_ROUNDS(10, 2) SHANI_ROUNDS(11, 2) SHANI_ROUNDS(12, 2) SHANI_ROUNDS(13, 2) SHANI_ROUNDS(14, 2)
+			SHANI_ROUNDS(15, 3) SHANI_ROUNDS(16, 3) SHANI_ROUNDS(17, 3) SHANI_ROUNDS(18, 3) SHANI_ROUNDS(19, 3)
+
+			e0 = _mm_sha1nexte_epu32(e_prev, e0_save);
+			abcd = _mm_add_epi32(abcd, abcd_save);
+		}
+
+		_mm_storeu_si128((__m128i*)state, _mm_shuffle_epi32(abcd, 0x1B));
+		state[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+	}
+
+	static bool cpu_has_shani()
+	{
+		// SSSE3 and SSE4.1 (cpuid 1, ecx bits 9 and 19) and SHA (cpuid 7, ebx bit 29)
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+		__cpuid(info, 1);
+		if ((info[2] & (1 << 9)) == 0 || (info[2] & (1 << 19)) == 0)
+			return false;
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 29)) != 0;
+#else
+		unsigned int eax, ebx, ecx, edx;
+		if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || (ecx & bit_SSSE3) == 0 || (ecx & bit_SSE4_1) == 0)
+			return false;
+		if (__get_cpuid_max(0, nullptr) < 7)
+			return false;
+		__cpuid_count(7, 0, eax, ebx, ecx, edx);
+		return (ebx & (1 << 29)) != 0;
+#endif
+	}
+#endif
+
+	typedef void (*transform_fn)(uint32_t state[5], const unsigned char* data, size_t blocks);
+
+	static transform_fn select_transform()
+	{
+#ifdef SHA1_HAVE_SHANI
+		if (cpu_has_shani())
+			return transform_shani;
+#endif
+		return transform_portable;
+	}
+
+	static void transform_blocks(uint32_t state[5], const unsigned char* data, size_t blocks)
+	{
+		static const transform_fn fn = select_transform();
+		fn(state, data, blocks);
+	}
+
+	sha1::sha1()
+	{
+		state[0] = 0x67452301;
+		state[1] = 0xEFCDAB89;
+		state[2] = 0x98BADCFE;
+		state[3] = 0x10325476;
+		state[4] = 0xC3D2E1F0;
+		count[0] = count[1] = 0;
+	}
+
+	void sha1::update(const unsigned char* buf, size_t len)
+	{
+		size_t i;
+		uint32_t j = count[0];
+		if ((count[0] += len << 3) < j) {
+			count[1]++;
+		}
+		count[1] += (len >> 29);
+		j = (j >> 3) & 63;
+		if ((j + len) > 63)
+		{
+			memcpy(&buffer[j], buf, (i = 64 - j));
+			transform_blocks(state, buffer, 1);
+			transform_blocks(state, &buf[i], (len - i) / 64);
+			i += (len - i) / 64 * 64;
+			j = 0;
+		}
+		else
+		{
+			i = 0;
+		}
+		memcpy(&buffer[j], &buf[i], len - i);
+	}
+
+	sha1::context sha1::save() const
+	{
+		context ctx;
+		memcpy(ctx.state, state, sizeof(state));
+		memcpy(ctx.count, count, sizeof(count));
+		memcpy(ctx.buffer, buffer, sizeof(buffer));
+		return ctx;
+	}
+
+	void sha1::restore(const context& ctx)
+	{
+		memcpy(state, ctx.state, sizeof(state));
+		memcpy(count, ctx.count, sizeof(count));
+		memcpy(buffer, ctx.buffer, sizeof(buffer));
+	}
+
+	void sha1::final(unsigned char* digest)
+	{
+		unsigned char finalcount[8];
+		for (unsigned i = 0; i < 8; i++)
+		{
+			finalcount[i] = (unsigned char)((count[(i >= 4 ? 0 : 1)] >> ((3 - (i & 3)) * 8)) & 255);
+		}
+		update((const unsigned char*)"\x80", 1);
+		while ((count[0] & 504) != 448)
+		{
+			update((const unsigned char*)"\x00", 1);
+		}
+		update(finalcount, 8);
+
+		for (unsigned i = 0; i < 20; i++)
+		{
+			digest[i] = (unsigned char)((state[i >> 2] >> ((3 - (i & 3)) * 8)) & 255);
+		}
+		memset(&state, '\0', sizeof(state));
+		memset(&count, '\0', sizeof(count));
+		memset(&buffer, '\0', sizeof(buffer));
+	}
+
+	namespace sha1_transform
+	{
+		void portable(uint32_t state[5], const unsigned char* data, size_t blocks)
+		{
+			transform_portable(state, data, blocks);
+		}
+
+		bool has_shani()
+		{
+#ifdef SHA1_HAVE_SHANI
+			return cpu_has_shani();
+#else
+			return false;
+#endif
+		}
+
+		void shani(uint32_t state[5], const unsigned char* data, size_t blocks)
+		{
+#ifdef SHA1_HAVE_SHANI
+			transform_shani(state, data, blocks);
+#else
+			transform_portable(state, data, blocks);
+#endif
+		}
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace hash
+{
+	class sha1
+	{
+	public:
+		sha1();
+		void update(const unsigned char* buf, size_t len);
+		void final(unsigned char* digest);
+
+		// everything the digest depends on so far, hashing can continue from a saved context later
+
+		struct context
+		{
+			uint32_t state[5];
+			uint32_t count[2];
+			unsigned char buffer[64];
+		};
+
+		context save() const;
+		void restore(const context& ctx);
+
+	private:
+		uint32_t state[5];
+		uint32_t count[2];
+		unsigned char buffer[64];
+	};
+
+	// the block functions sha1 picks from at runtime, each hashes whole 64 byte blocks into state
+	// only ydhost-selftest calls them directly, to check them and time them against each other
+
+	namespace sha1_transform
+	{
+		void portable(uint32_t state[5], const unsigned char* data, size_t blocks);
+
+		// false if the SHA extensions aren't compiled in or the CPU doesn't have them, shani must not be called then
+
+		bool has_shani();
+		void shani(uint32_t state[5], const unsigned char* data, size_t blocks);
+	}
+}
@@ -150,7 +150,9 @@ void CSocket::Reset()
 
 CTCPSocket::CTCPSocket()
 	: CSocket(),
+	m_SendOffset(0),
 	m_LastRecv(GetTicks()),
+	m_LastSendTicks(GetTicks()),
 	m_Connected(false)
 {
 	Allocate(SOCK_STREAM);
@@ -172,7 +174,9 @@ CTCPSocket::CTCPSocket()
 
 CTCPSocket::CTCPSocket(SOCKET nSocket, struct sockaddr_in nSIN)
 	: CSocket(nSocket, nSIN),
+	m_SendOffset(0),
 	m_LastRecv(GetTicks()),
+	m_LastSendTicks(GetTicks()),
 	m_Connected(true)
 {
 	// make socket non blocking
@@ -199,7 +203,9 @@ void CTCPSocket::Reset()
 	m_Connected = false;
 	m_RecvBuffer.clear();
 	m_SendBuffer.clear();
+	m_SendOffset = 0;
 	m_LastRecv = GetTicks();
+	m_LastSendTicks = GetTicks();
 
 	// make socket non blocking
 
@@ -249,6 +255,22 @@ void CTCPSocket::DoRecv(fd_set *fd)
 	}
 }
 
+void CTCPSocket::PutBytes(const std::string &bytes)
+{
+	if (m_SendBuffer.empty())
+		m_LastSendTicks = GetTicks();
+
+	m_SendBuffer += bytes;
+}
+
+void CTCPSocket::PutBytes(const BYTEARRAY &bytes)
+{
+	if (m_SendBuffer.empty())
+		m_LastSendTicks = GetTicks();
+
+	m_SendBuffer.append(begin(bytes), end(bytes));
+}
+
 void CTCPSocket::DoSend(fd_set *send_fd)
 {
 	if (m_Socket == INVALID_SOCKET || m_HasError || !m_Connected || m_SendBuffer.empty())
@@ -258,13 +280,26 @@ void CTCPSocket::DoSend(fd_set *send_fd)
 	{
 		// socket is ready, send it
 
-		int32_t s = send(m_Socket, m_SendBuffer.c_str(), (int32_t)m_SendBuffer.size(), MSG_NOSIGNAL);
+		int32_t s = send(m_Socket, m_SendBuffer.c_str() + m_SendOffset, (int32_t)(m_SendBuffer.size() - m_SendOffset), MSG_NOSIGNAL);
 
 		if (s > 0)
 		{
-			// success! only some of the data may have been sent, remove it from the buffer
-
-			m_SendBuffer = m_SendBuffer.substr(s);
+			// success! only some of the data may have been sent, skip over it
+			// the sent bytes are only erased once they make up most of a large buffer so a client that reads slowly doesn't cost us a copy of the whole queue on every send
+
+			m_SendOffset += s;
+			m_LastSendTicks = GetTicks();
+
+			if (m_SendOffset == m_SendBuffer.size())
+			{
+				m_SendBuffer.clear();
+				m_SendOffset = 0;
+			}
+			else if (m_SendOffset >= 65536 && m_SendOffset * 2 >= m_SendBuffer.size())
+			{
+				m_SendBuffer.erase(0, m_SendOffset);
+				m_SendOffset = 0;
+			}
 		}
 		else if (s == SOCKET_ERROR && GetLastError() != EWOULDBLOCK)
 		{
@@ -278,6 +313,29 @@ void CTCPSocket::DoSend(fd_set *send_fd)
 	}
 }
 
+uint32_t CTCPSocket::Write(const uint8_t *data, uint32_t length)
+{
+	// send straight from the caller's buffer, bypassing m_SendBuffer
+	// this is for data shared between many sockets which we don't want to copy into every one of them
+
+	if (m_Socket == INVALID_SOCKET || m_HasError || !m_Connected || length == 0)
+		return 0;
+
+	int32_t s = send(m_Socket, (const char *)data, (int32_t)length, MSG_NOSIGNAL);
+
+	if (s > 0)
+		return s;
+
+	if (s == SOCKET_ERROR && GetLastError() != EWOULDBLOCK)
+	{
+		m_HasError = true;
+		m_Error = GetLastError();
+		Print("[TCPSOCKET] error (send) - " + GetErrorString());
+	}
+
+	return 0;
+}
+
 void CTCPSocket::Disconnect()
 {
 	if (m_Socket != INVALID_SOCKET)
@@ -286,6 +344,79 @@ void CTCPSocket::Disconnect()
 	m_Connected = false;
 }
 
+bool CTCPSocket::GetTCPInfo(CTCPInfo &info) const
+{
+	memset(&info, 0, sizeof(info));
+
+	if (m_Socket == INVALID_SOCKET || m_HasError || !m_Connected)
+		return false;
+
+#ifdef __linux__
+	struct tcp_info TCPInfo;
+	socklen_t Length = sizeof(TCPInfo);
+
+	if (getsockopt(m_Socket, IPPROTO_TCP, TCP_INFO, &TCPInfo, &Length) != 0)
+		return false;
+
+	info.Valid = true;
+	info.RTT = TCPInfo.tcpi_rtt;
+	info.RTTVar = TCPInfo.tcpi_rttvar;
+	info.Retransmits = TCPInfo.tcpi_total_retrans;
+	info.CongestionWindow = TCPInfo.tcpi_snd_cwnd;
+	info.UnackedBytes = TCPInfo.tcpi_unacked * TCPInfo.tcpi_snd_mss;
+	info.LastAckRecv = TCPInfo.tcpi_last_ack_recv;
+	return true;
+#else
+	return false;
+#endif
+}
+
+void CTCPSocket::SetKeepAlive(bool enable, uint32_t idle, uint32_t interval, uint32_t count)
+{
+	// idle and interval are in seconds
+	// the kernel starts probing after the connection has been idle for idle seconds and gives up after count unanswered probes
+
+	if (m_Socket == INVALID_SOCKET)
+		return;
+
+	int32_t OptVal = enable ? 1 : 0;
+	setsockopt(m_Socket, SOL_SOCKET, SO_KEEPALIVE, (const char *)&OptVal, sizeof(int32_t));
+
+	if (!enable)
+		return;
+
+#ifdef TCP_KEEPIDLE
+	OptVal = idle;
+	setsockopt(m_Socket, IPPROTO_TCP, TCP_KEEPIDLE, (const char *)&OptVal, sizeof(int32_t));
+#endif
+#ifdef TCP_KEEPINTVL
+	OptVal = interval;
+	setsockopt(m_Socket, IPPROTO_TCP, TCP_KEEPINTVL, (const char *)&OptVal, sizeof(int32_t));
+#endif
+#ifdef TCP_KEEPCNT
+	OptVal = count;
+	setsockopt(m_Socket, IPPROTO_TCP, TCP_KEEPCNT, (const char *)&OptVal, sizeof(int32_t));
+#endif
+}
+
+void CTCPSocket::SetUserTimeout(uint32_t timeout)
+{
+	// timeout is in milliseconds
+	// the connection is aborted (and the next send or recv fails) when sent data stays unacknowledged for this long
+	// this catches a peer that vanished while we're still sending to it, which keepalives don't because the connection is never idle
+
+	if (m_Socket == INVALID_SOCKET)
+		return;
+
+#if defined(TCP_USER_TIMEOUT)
+	uint32_t OptVal = timeout;
+	setsockopt(m_Socket, IPPROTO_TCP, TCP_USER_TIMEOUT, (const char *)&OptVal, sizeof(uint32_t));
+#elif defined(TCP_MAXRT)
+	int32_t OptVal = (timeout + 999) / 1000;
+	setsockopt(m_Socket, IPPROTO_TCP, TCP_MAXRT, (const char *)&OptVal, sizeof(int32_t));
+#endif
+}
+
 //
 // CTCPClient
 //
@@ -609,6 +740,69 @@ bool CUDPSocket::Broadcast(uint16_t port, const BYTEARRAY &message)
 	return true;
 }
 
+bool CUDPSocket::Bind(const std::string &address, uint16_t port)
+{
+	if (m_Socket == INVALID_SOCKET || m_HasError)
+		return false;
+
+	// make socket non blocking so RecvFrom can drain it without stalling the main loop
+
+#ifdef WIN32
+	int32_t iMode = 1;
+	ioctlsocket(m_Socket, FIONBIO, (u_long FAR *) & iMode);
+#else
+	fcntl(m_Socket, F_SETFL, fcntl(m_Socket, F_GETFL) | O_NONBLOCK);
+#endif
+
+	// a Warcraft III client running on the same machine also wants this port
+
+	int32_t OptVal = 1;
+	setsockopt(m_Socket, SOL_SOCKET, SO_REUSEADDR, (const char *)&OptVal, sizeof(int32_t));
+
+	m_SIN.sin_family = AF_INET;
+
+	if (!address.empty())
+	{
+		if ((m_SIN.sin_addr.s_addr = inet_addr(address.c_str())) == INADDR_NONE)
+			m_SIN.sin_addr.s_addr = INADDR_ANY;
+	}
+	else
+		m_SIN.sin_addr.s_addr = INADDR_ANY;
+
+	m_SIN.sin_port = htons(port);
+
+	if (::bind(m_Socket, (struct sockaddr *) &m_SIN, sizeof(m_SIN)) == SOCKET_ERROR)
+	{
+		m_HasError = true;
+		m_Error = GetLastError();
+		Print("[UDPSOCKET] error (bind) - " + GetErrorString());
+		return false;
+	}
+
+	return true;
+}
+
+bool CUDPSocket::RecvFrom(fd_set *fd, struct sockaddr_in *sin, BYTEARRAY &message)
+{
+	if (m_Socket == INVALID_SOCKET || m_HasError || !FD_ISSET(m_Socket, fd))
+		return false;
+
+	char buffer[1024];
+	int32_t AddrLen = sizeof(*sin);
+
+#ifdef WIN32
+	int32_t c = recvfrom(m_Socket, buffer, sizeof(buffer), 0, (struct sockaddr *) sin, &AddrLen);
+#else
+	int32_t c = recvfrom(m_Socket, buffer, sizeof(buffer), 0, (struct sockaddr *) sin, (socklen_t *)& AddrLen);
+#endif
+
+	if (c <= 0)
+		return false;
+
+	message = BYTEARRAY(buffer, buffer + c);
+	return true;
+}
+
 void CUDPSocket::SetBroadcastTarget(const std::string &subnet)
 {
 	if (subnet.empty())
@@ -166,6 +166,23 @@ public:
 	void Allocate(int type);
 };
 
+//
+// CTCPInfo
+//
+
+// a snapshot of the kernel's view of a TCP connection (only available on Linux, Valid is false elsewhere)
+
+struct CTCPInfo
+{
+	bool Valid;
+	uint32_t RTT;                             // smoothed round trip time in microseconds
+	uint32_t RTTVar;                          // round trip time variance in microseconds
+	uint32_t Retransmits;                     // total number of retransmitted segments over the connection's lifetime
+	uint32_t CongestionWindow;                // congestion window in segments
+	uint32_t UnackedBytes;                    // bytes sent but not acknowledged yet
+	uint32_t LastAckRecv;                     // milliseconds since the peer last acknowledged anything
+};
+
 //
 // CTCPSocket
 //
@@ -175,7 +192,9 @@ class CTCPSocket : public CSocket
 protected:
 	std::string m_RecvBuffer;
 	std::string m_SendBuffer;
+	uint32_t m_SendOffset;                    // bytes at the front of m_SendBuffer that were already sent, they're only erased once in a while
 	uint32_t m_LastRecv;
+	uint32_t m_LastSendTicks;                 // GetTicks when the send queue last made progress or went from empty to non empty
 	bool m_Connected;
 
 public:
@@ -187,17 +206,23 @@ public:
 	inline std::string *GetBytes()                               { return &m_RecvBuffer; }
 	inline uint32_t GetLastRecv() const                     { return m_LastRecv; }
 	inline bool GetConnected() const                        { return m_Connected; }
+	inline uint32_t GetSendBufferSize() const               { return m_SendBuffer.size() - m_SendOffset; }
+	inline uint32_t GetLastSendTicks() const                { return m_LastSendTicks; }
 
-	inline void PutBytes(const std::string &bytes)              { m_SendBuffer += bytes; }
-	inline void PutBytes(const BYTEARRAY &bytes)           { m_SendBuffer += std::string(begin(bytes), end(bytes)); }
+	void PutBytes(const std::string &bytes);
+	void PutBytes(const BYTEARRAY &bytes);
 
 	inline void ClearRecvBuffer()                           { m_RecvBuffer.clear(); }
 	inline void SubstrRecvBuffer(uint32_t i)           { m_RecvBuffer = m_RecvBuffer.substr(i); }
-	inline void ClearSendBuffer()                           { m_SendBuffer.clear(); }
+	inline void ClearSendBuffer()                           { m_SendBuffer.clear(); m_SendOffset = 0; }
 
 	void DoRecv(fd_set *fd);
 	void DoSend(fd_set *send_fd);
+	uint32_t Write(const uint8_t *data, uint32_t length);
 	void Disconnect();
+	bool GetTCPInfo(CTCPInfo &info) const;
+	void SetKeepAlive(bool enable, uint32_t idle, uint32_t interval, uint32_t count);
+	void SetUserTimeout(uint32_t timeout);
 
 	void Reset();
 };
@@ -220,13 +245,10 @@ public:
 	inline bool GetConnecting() const                       { return m_Connecting; }
 
 	void Reset();
-	inline void PutBytes(const std::string &bytes)              { m_SendBuffer += bytes; }
-	inline void PutBytes(const BYTEARRAY &bytes)           { m_SendBuffer += std::string(begin(bytes), end(bytes)); }
 
 	bool CheckConnect();
 	inline void ClearRecvBuffer()                           { m_RecvBuffer.clear(); }
 	inline void SubstrRecvBuffer(uint32_t i)           { m_RecvBuffer = m_RecvBuffer.substr(i); }
-	inline void ClearSendBuffer()                           { m_SendBuffer.clear(); }
 	void DoRecv(fd_set *fd);
 	void DoSend(fd_set *send_fd);
 	void Disconnect();
@@ -263,6 +285,8 @@ public:
 	bool SendTo(struct sockaddr_in sin, const BYTEARRAY &message);
 	bool SendTo(const std::string &address, uint16_t port, const BYTEARRAY &message);
 	bool Broadcast(uint16_t port, const BYTEARRAY &message);
+	bool Bind(const std::string &address, uint16_t port);
+	bool RecvFrom(fd_set *fd, struct sockaddr_in *sin, BYTEARRAY &message);
 
 	void Reset();
 	void SetBroadcastTarget(const std::string &subnet);
@@ -0,0 +1,232 @@
+/*
+
+Copyright [2010] [Josko Nikolic]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+CODE PORTED FROM THE ORIGINAL GHOST PROJECT: http://ghost.pwner.org/
+
+*/
+
+#include "spectator.h"
+#include "socket.h"
+#include "util.h"
+
+#include <algorithm>
+
+uint32_t GetTicks();
+
+//
+// CSpectatorFeed
+//
+
+CSpectatorFeed::CSpectatorFeed(uint32_t nDelay, uint32_t nMaxBytes, uint32_t nMaxViewers)
+	: m_FrameBase(0),
+	m_DelayedBytes(0),
+	m_Bytes(0),
+	m_Delay(nDelay),
+	m_MaxBytes(nMaxBytes),
+	m_MaxViewers(nMaxViewers),
+	m_PeakViewers(0),
+	m_DroppedViewers(0),
+	m_Finished(false)
+{
+
+}
+
+CSpectatorFeed::~CSpectatorFeed()
+{
+	for (auto & viewer : m_Viewers)
+		delete viewer.Socket;
+}
+
+void CSpectatorFeed::SetHeader(const BYTEARRAY &header)
+{
+	m_Header = std::make_shared<const BYTEARRAY>(header);
+}
+
+void CSpectatorFeed::AddFrame(uint32_t Ticks, const BYTEARRAY &frame)
+{
+	m_Delayed.push_back(std::make_pair(Ticks, std::make_shared<const BYTEARRAY>(frame)));
+	m_DelayedBytes += frame.size();
+}
+
+bool CSpectatorFeed::AddViewer(CTCPSocket *socket)
+{
+	// a viewer has to start at the beginning of the game to make sense of the actions so we can't take new ones once the front is trimmed
+
+	if (m_Viewers.size() >= m_MaxViewers || m_FrameBase > 0)
+		return false;
+
+	CViewer Viewer;
+	Viewer.Socket = socket;
+	Viewer.Frame = 0;
+	Viewer.Offset = 0;
+	Viewer.LastProgressTicks = GetTicks();
+	m_Viewers.push_back(Viewer);
+	m_PeakViewers = std::max<uint32_t>(m_PeakViewers, m_Viewers.size());
+	return true;
+}
+
+uint32_t CSpectatorFeed::SetFD(void *fd, void *send_fd, int32_t *nfds)
+{
+	for (auto & viewer : m_Viewers)
+		viewer.Socket->SetFD((fd_set *)fd, (fd_set *)send_fd, nfds);
+
+	return m_Viewers.size();
+}
+
+void CSpectatorFeed::Update(uint32_t Ticks, void *fd)
+{
+	// release the frames that have waited out the delay
+
+	while (!m_Delayed.empty() && Ticks - m_Delayed.front().first >= m_Delay)
+	{
+		const uint32_t Size = m_Delayed.front().second->size();
+		m_Frames.push_back(m_Delayed.front().second);
+		m_Delayed.pop_front();
+		m_DelayedBytes -= Size;
+		m_Bytes += Size;
+	}
+
+	// keep the released frames below bot_spectatorhistory bytes, the viewers still reading the trimmed frames are dropped below
+	// the frames waiting out the delay don't count, they're limited by the delay and trimming them would only drop every viewer
+
+	while (m_Bytes > m_MaxBytes && !m_Frames.empty())
+	{
+		m_Bytes -= m_Frames.front()->size();
+		m_Frames.pop_front();
+		++m_FrameBase;
+	}
+
+	const uint32_t End = 1 + m_FrameBase + m_Frames.size();
+
+	for (auto i = begin(m_Viewers); i != end(m_Viewers);)
+	{
+		CViewer &Viewer = *i;
+
+		// viewers don't have anything to say but we have to read to notice when they go away
+
+		Viewer.Socket->DoRecv((fd_set *)fd);
+		Viewer.Socket->ClearRecvBuffer();
+
+		bool Drop = Viewer.Socket->HasError() || !Viewer.Socket->GetConnected();
+
+		if (!Drop && m_Header)
+		{
+			// a viewer needs every frame after the header so one that's still on a trimmed frame (or on the header once frame 1 is gone) can't continue
+
+			if (m_FrameBase > 0 && Viewer.Frame <= m_FrameBase)
+			{
+				++m_DroppedViewers;
+				Drop = true;
+			}
+			else if (Viewer.Frame == End)
+				Viewer.LastProgressTicks = Ticks;
+			else
+			{
+				// write straight from the shared frames, at most 64 KB per viewer per update so that a viewer catching up can't hold up the loop
+
+				uint32_t Budget = 65536;
+
+				while (Viewer.Frame < End && Budget > 0)
+				{
+					const BYTEARRAY *Frame = GetFrame(Viewer.Frame);
+					const uint32_t Written = Viewer.Socket->Write(Frame->data() + Viewer.Offset, std::min<uint32_t>(Frame->size() - Viewer.Offset, Budget));
+
+					if (Written == 0)
+						break;
+
+					Viewer.LastProgressTicks = Ticks;
+					Viewer.Offset += Written;
+					Budget -= Written;
+
+					if (Viewer.Offset == Frame->size())
+					{
+						++Viewer.Frame;
+						Viewer.Offset = 0;
+
+						// the header is never trimmed but the frames after it may have been while the viewer was reading it
+
+						if (Viewer.Frame <= m_FrameBase)
+							break;
+					}
+				}
+
+				// a viewer that stopped reading altogether only costs us a socket but that's still one too many
+
+				if (Viewer.Socket->HasError() || (m_FrameBase > 0 && Viewer.Frame <= m_FrameBase) || Ticks - Viewer.LastProgressTicks >= 60000)
+				{
+					++m_DroppedViewers;
+					Drop = true;
+				}
+			}
+		}
+
+		if (Drop)
+		{
+			delete Viewer.Socket;
+			i = m_Viewers.erase(i);
+		}
+		else
+			++i;
+	}
+}
+
+bool CSpectatorFeed::GetAllCaughtUp() const
+{
+	const uint32_t End = 1 + m_FrameBase + m_Frames.size();
+
+	for (auto & viewer : m_Viewers)
+	{
+		if (viewer.Frame != End)
+			return false;
+	}
+
+	return true;
+}
+
+const BYTEARRAY *CSpectatorFeed::GetFrame(uint32_t frame) const
+{
+	if (frame == 0)
+		return m_Header.get();
+
+	return m_Frames[frame - 1 - m_FrameBase].get();
+}
+
+bool CSpectatorFeed::RECEIVE_SPECTATOR_REQUEST(const BYTEARRAY &data, uint32_t &hostCounter)
+{
+	// 1 byte                     -> SPECTATOR_HEADER_CONSTANT
+	// 1 byte                     -> SPECTATOR_REQUEST
+	// 2 bytes                    -> Length
+	// 4 bytes                    -> HostCounter
+
+	if (data.size() == 8 && data[0] == SPECTATOR_HEADER_CONSTANT && data[1] == SPECTATOR_REQUEST && ByteArrayToUInt16(data, 2) == 8)
+	{
+		hostCounter = ByteArrayToUInt32(data, 4);
+		return true;
+	}
+
+	return false;
+}
+
+BYTEARRAY CSpectatorFeed::SEND_SPECTATOR_INFO(uint32_t hostCounter, uint32_t delay, const std::string &gameName, const std::string &mapPath)
+{
+	BYTEARRAY packet = { SPECTATOR_HEADER_CONSTANT, SPECTATOR_INFO, 0, 0 };
+	AppendByteArray(packet, hostCounter);
+	AppendByteArray(packet, delay);
+	AppendByteArray(packet, gameName);
+	AppendByteArray(packet, mapPath);
+	AssignLength(packet);
+	return packet;
+}
@@ -0,0 +1,112 @@
+/*
+
+Copyright [2010] [Josko Nikolic]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+CODE PORTED FROM THE ORIGINAL GHOST PROJECT: http://ghost.pwner.org/
+
+*/
+
+#ifndef AURA_SPECTATOR_H_
+#define AURA_SPECTATOR_H_
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <string>
+#include <stdint.h>
+typedef std::vector<uint8_t> BYTEARRAY;
+
+//
+// CSpectatorFeed
+//
+
+// streams a game's data to read-only viewers connected to bot_spectatorport
+// a viewer sends SPECTATOR_REQUEST with the LAN host counter of the game it wants to watch (0 for any running game) and gets back:
+//  - SPECTATOR_INFO (host counter, delay in ms, game name, map path)
+//  - W3GS_SLOTINFO and a W3GS_PLAYERINFO for every player, as sent when the game started loading
+//  - every W3GS_INCOMING_ACTION, W3GS_INCOMING_ACTION2 and W3GS_PLAYERLEAVE_OTHERS sent to the players from then on, bot_spectatordelay ms late
+// every frame is encoded once and shared by all viewers, each viewer only keeps a position in the stream
+// a viewer that joins late catches up from the start of the game as long as the feed still holds it
+
+#define SPECTATOR_HEADER_CONSTANT 249
+
+class CTCPSocket;
+
+class CSpectatorFeed
+{
+public:
+	enum Protocol
+	{
+		SPECTATOR_REQUEST = 1,
+		SPECTATOR_INFO = 2
+	};
+
+private:
+	struct CViewer
+	{
+		CTCPSocket *Socket;
+		uint32_t Frame;                           // the next frame to send, 0 is m_Header and n is m_Frames[n - 1 - m_FrameBase]
+		uint32_t Offset;                          // how much of that frame was already sent
+		uint32_t LastProgressTicks;               // GetTicks when the viewer last accepted any data
+	};
+
+	std::shared_ptr<const BYTEARRAY> m_Header;    // everything a viewer needs before the first frame, empty until the game starts loading
+	std::deque<std::pair<uint32_t, std::shared_ptr<const BYTEARRAY>>> m_Delayed; // frames waiting out the delay with the GetTicks they were sent to the players
+	std::deque<std::shared_ptr<const BYTEARRAY>> m_Frames; // frames released to the viewers
+	std::vector<CViewer> m_Viewers;
+	uint32_t m_FrameBase;                         // the number of frames trimmed from the front of m_Frames
+	uint32_t m_DelayedBytes;                      // the size of everything in m_Delayed
+	uint32_t m_Bytes;                             // the size of everything in m_Frames, this is what bot_spectatorhistory limits
+	uint32_t m_Delay;
+	uint32_t m_MaxBytes;
+	uint32_t m_MaxViewers;
+	uint32_t m_PeakViewers;
+	uint32_t m_DroppedViewers;                    // viewers dropped because they stopped reading or fell behind what the feed still holds
+	bool m_Finished;                              // the game is over, no more frames are coming
+
+public:
+	CSpectatorFeed(uint32_t nDelay, uint32_t nMaxBytes, uint32_t nMaxViewers);
+	~CSpectatorFeed();
+	CSpectatorFeed(CSpectatorFeed &) = delete;
+
+	inline uint32_t GetNumViewers() const                 { return m_Viewers.size(); }
+	inline uint32_t GetPeakViewers() const                { return m_PeakViewers; }
+	inline uint32_t GetDroppedViewers() const             { return m_DroppedViewers; }
+	inline uint32_t GetBytes() const                      { return m_DelayedBytes + m_Bytes; }
+	inline bool GetStarted() const                        { return m_Header != nullptr; }
+	inline bool GetDone() const                           { return m_Finished && (m_Viewers.empty() || (m_Delayed.empty() && GetAllCaughtUp())); }
+
+	inline void SetFinished()                             { m_Finished = true; }
+
+	void SetHeader(const BYTEARRAY &header);
+	void AddFrame(uint32_t Ticks, const BYTEARRAY &frame);
+	bool AddViewer(CTCPSocket *socket);
+
+	// processing functions
+
+	uint32_t SetFD(void *fd, void *send_fd, int32_t *nfds);
+	void Update(uint32_t Ticks, void *fd);
+
+	// protocol functions
+
+	static bool RECEIVE_SPECTATOR_REQUEST(const BYTEARRAY &data, uint32_t &hostCounter);
+	static BYTEARRAY SEND_SPECTATOR_INFO(uint32_t hostCounter, uint32_t delay, const std::string &gameName, const std::string &mapPath);
+
+private:
+	bool GetAllCaughtUp() const;
+	const BYTEARRAY *GetFrame(uint32_t frame) const;
+};
+
+#endif  // AURA_SPECTATOR_H_
@@ -23,8 +23,24 @@ CODE PORTED FROM THE ORIGINAL GHOST PROJECT: http://ghost.pwner.org/
 
 #include <vector>
 #include <stdint.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 typedef std::vector<uint8_t> BYTEARRAY;
 
+// the index of the lowest set bit, mask must not be zero
+
+inline uint8_t LowestBit(uint32_t mask)
+{
+#ifdef _MSC_VER
+	unsigned long Index;
+	_BitScanForward(&Index, mask);
+	return (uint8_t)Index;
+#else
+	return (uint8_t)__builtin_ctz(mask);
+#endif
+}
+
 inline BYTEARRAY CreateByteArray(const uint8_t *a, int32_t size)
 {
 	if (size < 1)
@@ -0,0 +1,125 @@
+/*
+
+Copyright [2010] [Josko Nikolic]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#include "workpool.h"
+
+#include <algorithm>
+#include <thread>
+
+//
+// CWorkPool
+//
+
+CWorkPool::CWorkPool(uint32_t numThreads)
+{
+	for (uint32_t i = 0; i < numThreads; ++i)
+		std::thread(&CWorkPool::Work, this).detach();
+}
+
+CWorkPool::~CWorkPool()
+{
+
+}
+
+CWorkPool &CWorkPool::Get()
+{
+	// the pool is never destroyed, the workers are detached and would still be waiting on it when statics are destroyed at exit
+
+	static CWorkPool *Pool = new CWorkPool(std::max<uint32_t>(std::thread::hardware_concurrency(), 2) - 1);
+	return *Pool;
+}
+
+bool CWorkPool::Run(uint32_t numTasks, const std::function<bool(uint32_t)> &task)
+{
+	if (numTasks == 0)
+		return true;
+
+	auto Job = std::make_shared<CJob>();
+	Job->Task = task;
+	Job->NumTasks = numTasks;
+	Job->Next = 0;
+	Job->Finished = 0;
+	Job->Success = true;
+
+	if (numTasks > 1)
+	{
+		{
+			std::lock_guard<std::mutex> Lock(m_Mutex);
+			m_Jobs.push_back(Job);
+		}
+
+		m_Queued.notify_all();
+	}
+
+	RunTasks(*Job);
+
+	// the tasks still unfinished were handed out to workers that are running them right now
+
+	std::unique_lock<std::mutex> Lock(m_Mutex);
+	m_Finished.wait(Lock, [&Job]() { return Job->Finished == Job->NumTasks; });
+	return Job->Success;
+}
+
+void CWorkPool::Work()
+{
+	while (true)
+	{
+		std::shared_ptr<CJob> Job;
+
+		{
+			std::unique_lock<std::mutex> Lock(m_Mutex);
+			m_Queued.wait(Lock, [this]() { return !m_Jobs.empty(); });
+			Job = m_Jobs.front();
+
+			// every task of the job has been handed out, the threads running them finish it
+
+			if (Job->Next >= Job->NumTasks)
+			{
+				m_Jobs.pop_front();
+				continue;
+			}
+		}
+
+		RunTasks(*Job);
+	}
+}
+
+void CWorkPool::RunTasks(CJob &job)
+{
+	uint32_t Index;
+
+	while ((Index = job.Next++) < job.NumTasks)
+	{
+		bool Success;
+
+		try
+		{
+			Success = job.Task(Index);
+		}
+		catch (...)
+		{
+			Success = false;
+		}
+
+		std::lock_guard<std::mutex> Lock(m_Mutex);
+		job.Success = job.Success && Success;
+
+		if (++job.Finished == job.NumTasks)
+			m_Finished.notify_all();
+	}
+}
@@ -0,0 +1,75 @@
+/*
+
+Copyright [2010] [Josko Nikolic]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+#ifndef AURA_WORKPOOL_H_
+#define AURA_WORKPOOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+
+//
+// CWorkPool
+//
+
+// one set of worker threads for the whole process, started the first time it's needed with one thread per core (minus the caller's)
+// map scans use it for the inputs of a map and archives for the sectors of a big file, so nested and concurrent scans
+// (ydhost-index scans a map per core) share the same threads instead of each starting their own
+// the thread that asks for work to be done works on it too and only ever waits for tasks that are already running,
+// a task may use the pool itself without a full pool deadlocking
+
+class CWorkPool
+{
+private:
+	struct CJob
+	{
+		std::function<bool(uint32_t)> Task;
+		uint32_t NumTasks;
+		std::atomic<uint32_t> Next;               // the next task to hand out
+		uint32_t Finished;                        // the tasks that are done, guarded by m_Mutex
+		bool Success;                             // if every finished task returned true, guarded by m_Mutex
+	};
+
+	std::mutex m_Mutex;
+	std::condition_variable m_Queued;             // signalled when a job is added to m_Jobs
+	std::condition_variable m_Finished;           // signalled when the last task of a job is done
+	std::deque<std::shared_ptr<CJob>> m_Jobs;     // the jobs that still have tasks to hand out, oldest first
+
+	explicit CWorkPool(uint32_t numThreads);
+
+public:
+	~CWorkPool();
+	CWorkPool(CWorkPool &) = delete;
+
+	static CWorkPool &Get();
+
+	// runs task(0) to task(numTasks - 1) on the pool and the calling thread and returns once all of them are done
+	// returns false if any of them returned false or threw
+
+	bool Run(uint32_t numTasks, const std::function<bool(uint32_t)> &task);
+
+private:
+	void Work();
+	void RunTasks(CJob &job);
+};
+
+#endif  // AURA_WORKPOOL_H_
@@ -0,0 +1,169 @@
+/*
+
+Copyright [2010] [Josko Nikolic]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+CODE PORTED FROM THE ORIGINAL GHOST PROJECT: http://ghost.pwner.org/
+
+*/
+
+// ydhost-index: scans every map in a directory and writes the map catalog ydhost reads with bot_mapcatalog
+//
+// usage: ydhost-index <maps directory> <catalog file> [jass directory]
+//
+// ydhost loads a map from the catalog by its file name, so bot_mapdir should be the directory that was indexed
+
+#include "gameslot.h"
+#include "map.h"
+#include "mapcache.h"
+#include "mapcatalog.h"
+#include "mappedfile.h"
+#include "crc32.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+static std::mutex PrintMutex;
+
+uint32_t GetTicks()
+{
+	return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Print(const std::string &message)
+{
+	std::lock_guard<std::mutex> Lock(PrintMutex);
+	std::cout << message << std::endl;
+}
+
+static bool IsMapFile(const std::string &name)
+{
+	if (name.size() < 4)
+		return false;
+
+	std::string Extension = name.substr(name.size() - 4);
+	std::transform(begin(Extension), end(Extension), begin(Extension), ::tolower);
+	return Extension == ".w3x" || Extension == ".w3m";
+}
+
+static std::vector<std::string> ListMaps(const std::string &directory)
+{
+	std::vector<std::string> Maps;
+
+#ifdef WIN32
+	WIN32_FIND_DATAA Data;
+	HANDLE Find = FindFirstFileA((directory + "\\*").c_str(), &Data);
+
+	if (Find != INVALID_HANDLE_VALUE)
+	{
+		do
+		{
+			if (!(Data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && IsMapFile(Data.cFileName))
+				Maps.push_back(Data.cFileName);
+		} while (FindNextFileA(Find, &Data));
+
+		FindClose(Find);
+	}
+#else
+	DIR *Dir = opendir(directory.c_str());
+
+	if (Dir)
+	{
+		while (struct dirent *Entry = readdir(Dir))
+		{
+			if (IsMapFile(Entry->d_name))
+				Maps.push_back(Entry->d_name);
+		}
+
+		closedir(Dir);
+	}
+#endif
+
+	return Maps;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 3)
+	{
+		std::cout << "usage: ydhost-index <maps directory> <catalog file> [jass directory]" << std::endl;
+		return 1;
+	}
+
+	const std::string MapDir = argv[1];
+	const std::string CatalogPath = argv[2];
+	const CMapCache Scanner(std::string(), argc > 3 ? argv[3] : "jass");
+	const std::vector<std::string> Names = ListMaps(MapDir);
+	const uint32_t Start = GetTicks();
+
+	Print("[INDEX] indexing " + std::to_string(Names.size()) + " maps in [" + MapDir + "]");
+
+	// every worker takes the next map that hasn't been taken yet, a map that can't be read is left out of the catalog
+
+	std::vector<std::pair<std::string, CMapMetadata>> Maps(Names.size());
+	std::vector<char> Indexed(Names.size(), 0);
+	std::atomic<uint32_t> Next(0);
+	std::vector<std::thread> Workers;
+
+	for (uint32_t i = 0; i < std::max<uint32_t>(std::thread::hardware_concurrency(), 1); ++i)
+	{
+		Workers.push_back(std::thread([&]()
+		{
+			for (uint32_t j = Next++; j < Names.size(); j = Next++)
+			{
+				std::shared_ptr<CMappedFile> File = CMappedFile::Open(MapDir + "/" + Names[j], false);
+
+				if (!File)
+					continue;
+
+				Maps[j].first = Names[j];
+
+				if (Scanner.Scan(File, CRC32(File->GetData(), File->GetSize()), Maps[j].second))
+					Indexed[j] = 1;
+				else
+					Print("[INDEX] skipping [" + Names[j] + "]");
+			}
+		}));
+	}
+
+	for (auto & worker : Workers)
+		worker.join();
+
+	std::vector<std::pair<std::string, CMapMetadata>> Catalog;
+
+	for (uint32_t i = 0; i < Maps.size(); ++i)
+	{
+		if (Indexed[i])
+			Catalog.push_back(Maps[i]);
+	}
+
+	if (!CMapCatalog::Write(CatalogPath, Catalog))
+	{
+		Print("[INDEX] unable to write [" + CatalogPath + "]");
+		return 1;
+	}
+
+	Print("[INDEX] wrote " + std::to_string(Catalog.size()) + " maps to [" + CatalogPath + "] in " + std::to_string(GetTicks() - Start) + " ms");
+	return 0;
+}
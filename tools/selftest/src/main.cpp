@@ -0,0 +1,880 @@
+/*
+
+Copyright [2010] [Josko Nikolic]
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+*/
+
+// ydhost-selftest: checks the hashing and map reading code ydhost shares with the map tools against known answers
+// and scans maps it writes itself, a scan that reuses the previous inputs has to match a full one
+// the download pacer is run against simulated links, it has to use most of the link without queueing much in front of it
+//
+// usage: ydhost-selftest [bench]
+//
+// prints every failed check and exits with 1 if there was one, "bench" also times the kernels
+
+#include "gameslot.h"
+#include "map.h"
+#include "mapcache.h"
+#include "mappedfile.h"
+#include "mpq.h"
+#include "crc32.h"
+#include "download.h"
+#include "explode.h"
+#include "rolc.h"
+#include "sha1.h"
+#include "workpool.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <fstream>
+#include <zlib.h>
+
+#ifdef WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static uint32_t Failures = 0;
+
+uint32_t GetTicks()
+{
+	return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// the map code logs what it's doing, only the failed checks are interesting here
+
+void Print(const std::string &)
+{
+
+}
+
+static void Check(bool ok, const std::string &what)
+{
+	if (!ok)
+	{
+		std::cout << "[SELFTEST] FAILED " << what << std::endl;
+		++Failures;
+	}
+}
+
+static std::string ToHex(uint32_t value)
+{
+	char Buffer[9];
+	snprintf(Buffer, sizeof(Buffer), "%08x", value);
+	return Buffer;
+}
+
+static std::vector<unsigned char> RandomBytes(size_t length, uint32_t seed)
+{
+	std::mt19937 Random(seed);
+	std::vector<unsigned char> Bytes(length);
+
+	for (auto & byte : Bytes)
+		byte = (unsigned char)Random();
+
+	return Bytes;
+}
+
+//
+// crc32
+//
+
+// the textbook bit at a time crc, everything else is compared against it
+
+static uint32_t ReferenceCRC32(const unsigned char *buf, size_t len)
+{
+	uint32_t crc = 0xFFFFFFFF;
+
+	while (len--)
+	{
+		crc ^= *buf++;
+
+		for (int k = 0; k < 8; ++k)
+			crc = (crc & 1) ? 0xEDB88320 ^ (crc >> 1) : (crc >> 1);
+	}
+
+	return ~crc;
+}
+
+static void TestCRC32()
+{
+	// the check value from the CRC catalogue and a few other well known ones
+
+	const struct
+	{
+		const char *Input;
+		uint32_t CRC;
+	} Known[] = {
+		{ "", 0x00000000 },
+		{ "a", 0xe8b7be43 },
+		{ "123456789", 0xcbf43926 },
+		{ "The quick brown fox jumps over the lazy dog", 0x414fa339 }
+	};
+
+	for (const auto & known : Known)
+		Check(CRC32((const unsigned char *)known.Input, strlen(known.Input)) == known.CRC, "crc32 of \"" + std::string(known.Input) + "\"");
+
+	// every kernel against the reference at every length around the folding block sizes and at every alignment
+
+	const std::vector<unsigned char> Data = RandomBytes(4096 + 16, 26);
+
+	for (size_t offset = 0; offset < 16; ++offset)
+	{
+		for (size_t len = 0; len <= 4096; len += (len < 300 ? 1 : 61))
+		{
+			const unsigned char *buf = Data.data() + offset;
+			const uint32_t Expected = ReferenceCRC32(buf, len);
+			const std::string What = " at offset " + std::to_string(offset) + " length " + std::to_string(len);
+
+			Check(CRC32(buf, len) == Expected, "crc32" + What);
+			Check(~aura_crc32::update_slice8(0xFFFFFFFF, buf, len) == Expected, "crc32 slicing-by-8" + What);
+#ifdef CRC32_HAVE_PCLMUL
+			if (aura_crc32::cpu_has_pclmul())
+				Check(~aura_crc32::update_pclmul(0xFFFFFFFF, buf, len) == Expected, "crc32 pclmul" + What);
+#endif
+		}
+	}
+
+	// the register can be carried from one update to the next, W3GS frames are hashed like that
+
+	const uint32_t Whole = ReferenceCRC32(Data.data(), 4096);
+	uint32_t crc = 0xFFFFFFFF;
+	crc = aura_crc32::update(crc, Data.data(), 1000);
+	crc = aura_crc32::update(crc, Data.data() + 1000, 3096);
+	Check(~crc == Whole, "crc32 split update, got " + ToHex(~crc) + " expected " + ToHex(Whole));
+
+	// and it's the same crc zlib computes (this file including both headers is also the check that the names don't clash)
+
+	Check(CRC32(Data.data(), Data.size()) == crc32(0, Data.data(), (uInt)Data.size()), "crc32 against zlib");
+}
+
+//
+// sha1 and rolc
+//
+
+static std::string DigestHex(hash::sha1 &SHA1)
+{
+	unsigned char Digest[20];
+	SHA1.final(Digest);
+	std::string Hex;
+
+	for (auto byte : Digest)
+	{
+		char Buffer[3];
+		snprintf(Buffer, sizeof(Buffer), "%02x", byte);
+		Hex += Buffer;
+	}
+
+	return Hex;
+}
+
+static std::string SHA1Hex(const std::vector<std::pair<const unsigned char *, size_t>> &parts)
+{
+	hash::sha1 SHA1;
+
+	for (auto & part : parts)
+		SHA1.update(part.first, part.second);
+
+	return DigestHex(SHA1);
+}
+
+static std::string SHA1Hex(const std::string &data)
+{
+	return SHA1Hex({ { (const unsigned char *)data.data(), data.size() } });
+}
+
+// rolc the way it's defined, one word at a time and the trailing bytes one at a time
+
+static uint32_t ReferenceRolc(const unsigned char *buf, size_t len)
+{
+	uint32_t h = 0;
+	size_t i = 0;
+
+	for (; i + 3 < len; i += 4)
+		h = hash::rolc::rol3(h ^ hash::rolc::load(buf + i));
+
+	for (; i < len; ++i)
+		h = hash::rolc::rol3(h ^ (uint32_t)buf[i]);
+
+	return h;
+}
+
+static void TestSHA1()
+{
+	// the FIPS 180 examples, whichever kernel this CPU uses (the SHA extensions or the portable one) is what gets checked
+
+	Check(SHA1Hex("") == "da39a3ee5e6b4b0d3255bfef95601890afd80709", "sha1 of \"\"");
+	Check(SHA1Hex("abc") == "a9993e364706816aba3e25717850c26c9cd0d89d", "sha1 of \"abc\"");
+	Check(SHA1Hex("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq") == "84983e441c3bd26ebaae4aa1f95129e5e54670f1", "sha1 of the two block example");
+	Check(SHA1Hex(std::string(1000000, 'a')) == "34aa973cd4c4daa4f61eeb2bdbad27316534016f", "sha1 of a million \"a\"");
+
+	// the digest doesn't depend on how the input is split up, map inputs are hashed one file at a time
+
+	const std::vector<unsigned char> Data = RandomBytes(4096, 46);
+	const std::string Whole = SHA1Hex({ { Data.data(), Data.size() } });
+
+	for (size_t split : { (size_t)1, (size_t)55, (size_t)56, (size_t)63, (size_t)64, (size_t)65, (size_t)1000, (size_t)4095 })
+		Check(SHA1Hex({ { Data.data(), split }, { Data.data() + split, Data.size() - split } }) == Whole, "sha1 split at " + std::to_string(split));
+
+	// the SHA extensions against the portable rounds they replace, the FIPS examples above only check the one this CPU picked
+
+	if (hash::sha1_transform::has_shani())
+	{
+		for (size_t blocks : { (size_t)1, (size_t)2, (size_t)64 })
+		{
+			uint32_t Portable[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+			uint32_t SHANI[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+			hash::sha1_transform::portable(Portable, Data.data(), blocks);
+			hash::sha1_transform::shani(SHANI, Data.data(), blocks);
+			Check(std::equal(Portable, Portable + 5, SHANI), "sha1 sha-ni rounds of " + std::to_string(blocks) + " blocks");
+		}
+	}
+
+	// the map cache saves the context after common.j and blizzard.j and carries on from it for every map
+
+	for (size_t split : { (size_t)0, (size_t)20, (size_t)64, (size_t)100 })
+	{
+		hash::sha1 First;
+		First.update(Data.data(), split);
+		const hash::sha1::context Saved = First.save();
+
+		hash::sha1 Resumed;
+		Resumed.restore(Saved);
+		Resumed.update(Data.data() + split, Data.size() - split);
+		Check(DigestHex(Resumed) == Whole, "sha1 resumed at " + std::to_string(split));
+	}
+}
+
+static void TestRolc()
+{
+	// values from the word at a time implementation the map config tools have always used
+
+	Check(hash::rolc::block((const unsigned char *)"123456789", 9) == 0x6ba9eeee, "rolc of \"123456789\"");
+	Check(hash::rolc::block((const unsigned char *)"The quick brown fox jumps over the lazy dog", 43) == 0x1166e78f, "rolc of the quick brown fox");
+
+	// map_crc chains the inputs, common.j and blizzard.j are followed by a constant
+
+	hash::rolc Rolc;
+	Rolc.update((const unsigned char *)"123456789", 9);
+	Rolc.update(0x03F1379E);
+	Rolc.update((const unsigned char *)"The quick brown fox jumps over the lazy dog", 43);
+	Check(Rolc.final() == 0x9d016062, "rolc chain, got " + ToHex(Rolc.final()));
+
+	// the 32 lane version against the definition around every multiple of the 32 word stride
+
+	const std::vector<unsigned char> Data = RandomBytes(4096 + 3, 461);
+
+	for (size_t len = 0; len <= Data.size(); len += (len < 600 ? 1 : 127))
+		Check(hash::rolc::block(Data.data(), len) == ReferenceRolc(Data.data(), len), "rolc at length " + std::to_string(len));
+}
+
+//
+// map scanning
+//
+
+// writes a map the way the World Editor does: the 512 byte map header and a version 1 MPQ archive
+// every file is zlib compressed in 4 KB sectors, a sector that doesn't get smaller is stored as it is
+
+static const uint32_t *GetCryptTable()
+{
+	static uint32_t Table[0x500];
+	static bool Built = false;
+
+	if (!Built)
+	{
+		uint32_t Seed = 0x00100001;
+
+		for (uint32_t Index1 = 0; Index1 < 0x100; ++Index1)
+		{
+			for (uint32_t Index2 = Index1, i = 0; i < 5; ++i, Index2 += 0x100)
+			{
+				Seed = (Seed * 125 + 3) % 0x2AAAAB;
+				const uint32_t Temp1 = (Seed & 0xFFFF) << 0x10;
+				Seed = (Seed * 125 + 3) % 0x2AAAAB;
+				Table[Index2] = Temp1 | (Seed & 0xFFFF);
+			}
+		}
+
+		Built = true;
+	}
+
+	return Table;
+}
+
+static void Encrypt(uint32_t *data, uint32_t length, uint32_t key)
+{
+	const uint32_t *CryptTable = GetCryptTable();
+	uint32_t Seed = 0xEEEEEEEE;
+
+	for (uint32_t i = 0; i < length / 4; ++i)
+	{
+		Seed += CryptTable[0x400 + (key & 0xFF)];
+		const uint32_t Ch = data[i] ^ (key + Seed);
+		key = ((~key << 0x15) + 0x11111111) | (key >> 0x0B);
+		Seed = data[i] + Seed + (Seed << 5) + 3;
+		data[i] = Ch;
+	}
+}
+
+static void AppendInt(std::string &out, uint32_t value)
+{
+	out.append((const char *)&value, 4);
+}
+
+static bool WriteMap(const std::string &path, const std::vector<std::pair<std::string, std::string>> &files)
+{
+	const uint32_t SectorSize = 4096;
+	const uint32_t HashTableSize = 32;
+	std::string Body;
+	std::vector<uint32_t> Blocks;
+
+	for (auto & file : files)
+	{
+		const std::string &Data = file.second;
+		const uint32_t NumSectors = (Data.size() + SectorSize - 1) / SectorSize;
+		std::vector<uint32_t> Offsets(1, (NumSectors + 1) * 4);
+		std::string Sectors;
+
+		for (uint32_t i = 0; i < NumSectors; ++i)
+		{
+			const std::string Sector = Data.substr(i * SectorSize, SectorSize);
+			std::vector<uint8_t> Compressed(compressBound(Sector.size()));
+			uLongf Length = Compressed.size();
+			compress2(Compressed.data(), &Length, (const Bytef *)Sector.data(), Sector.size(), 9);
+
+			if (Length + 1 < Sector.size())
+				Sectors += '\x02' + std::string((const char *)Compressed.data(), Length);
+			else
+				Sectors += Sector;
+
+			Offsets.push_back(Offsets[0] + Sectors.size());
+		}
+
+		Blocks.push_back(32 + Body.size());
+		Blocks.push_back(Offsets.size() * 4 + Sectors.size());
+		Blocks.push_back(Data.size());
+		Blocks.push_back(MPQ_FILE_EXISTS | MPQ_FILE_COMPRESS);
+		Body.append((const char *)Offsets.data(), Offsets.size() * 4);
+		Body += Sectors;
+	}
+
+	std::vector<uint32_t> HashTable(HashTableSize * 4, 0xFFFFFFFF);
+
+	for (uint32_t i = 0; i < files.size(); ++i)
+	{
+		uint32_t Index = CMPQArchive::HashString(files[i].first, 0) % HashTableSize;
+
+		while (HashTable[Index * 4 + 3] != 0xFFFFFFFF)
+			Index = (Index + 1) % HashTableSize;
+
+		HashTable[Index * 4] = CMPQArchive::HashString(files[i].first, 1);
+		HashTable[Index * 4 + 1] = CMPQArchive::HashString(files[i].first, 2);
+		HashTable[Index * 4 + 2] = 0;
+		HashTable[Index * 4 + 3] = i;
+	}
+
+	Encrypt(HashTable.data(), HashTable.size() * 4, CMPQArchive::HashString("(hash table)", 3));
+	Encrypt(Blocks.data(), Blocks.size() * 4, CMPQArchive::HashString("(block table)", 3));
+
+	const uint32_t HashTablePos = 32 + Body.size();
+	const uint32_t BlockTablePos = HashTablePos + HashTable.size() * 4;
+	std::string Archive = "MPQ\x1A";
+	AppendInt(Archive, 32);
+	AppendInt(Archive, BlockTablePos + Blocks.size() * 4);
+	AppendInt(Archive, 3 << 16);                  // format version 0, sectors of 512 << 3 bytes
+	AppendInt(Archive, HashTablePos);
+	AppendInt(Archive, BlockTablePos);
+	AppendInt(Archive, HashTableSize);
+	AppendInt(Archive, files.size());
+	Archive += Body;
+	Archive.append((const char *)HashTable.data(), HashTable.size() * 4);
+	Archive.append((const char *)Blocks.data(), Blocks.size() * 4);
+
+	std::ofstream Out(path.c_str(), std::ios::binary | std::ios::trunc);
+	Out << "HM3W" << std::string(508, '\0') << Archive;
+	Out.close();
+	return !Out.fail();
+}
+
+// a war3map.w3i (version 25) with four players in two forces, one of them a computer and one a neutral that doesn't get a slot
+
+static std::string MakeW3I()
+{
+	std::string W3I;
+	auto String = [&W3I](const std::string &value) { W3I += value; W3I += '\0'; };
+
+	AppendInt(W3I, 25);
+	AppendInt(W3I, 1);
+	AppendInt(W3I, 6052);
+	String("Test");
+	String("me");
+	String("desc");
+	String("any");
+	W3I += std::string(48, '\0');
+	AppendInt(W3I, 116);
+	AppendInt(W3I, 84);
+	AppendInt(W3I, 0x20 | 0x04 | 0x08);
+	W3I += 'A';
+	AppendInt(W3I, 0);
+	String("");
+	String("");
+	String("");
+	String("");
+	AppendInt(W3I, 0);
+	String("");
+	String("");
+	String("");
+	String("");
+	W3I += std::string(20, '\0');
+	AppendInt(W3I, 0);
+	String("");
+	W3I += std::string(5, '\0');
+
+	const uint32_t Players[4][3] = { { 0, 1, 1 }, { 1, 1, 3 }, { 2, 2, 4 }, { 3, 3, 1 } };
+	AppendInt(W3I, 4);
+
+	for (auto & player : Players)
+	{
+		AppendInt(W3I, player[0]);
+		AppendInt(W3I, player[1]);
+		AppendInt(W3I, player[2]);
+		AppendInt(W3I, 0);
+		String("P");
+		W3I += std::string(16, '\0');
+	}
+
+	AppendInt(W3I, 2);
+	AppendInt(W3I, 0);
+	AppendInt(W3I, 0x5);
+	String("F1");
+	AppendInt(W3I, 0);
+	AppendInt(W3I, 0x2);
+	String("F2");
+	return W3I;
+}
+
+static std::string MakeScript(uint32_t lines, uint32_t seed)
+{
+	std::string Script;
+
+	for (uint32_t i = 0; i < lines; ++i)
+		Script += "function f" + std::to_string(i * seed) + " takes nothing returns integer\n\treturn " + std::to_string(i ^ seed) + "\nendfunction\n";
+
+	return Script;
+}
+
+static void WriteFile(const std::string &path, const std::string &data)
+{
+	std::ofstream Out(path.c_str(), std::ios::binary | std::ios::trunc);
+	Out << data;
+}
+
+static void TestMapScan()
+{
+	const std::string Directory = "ydhost-selftest.tmp";
+
+#ifdef WIN32
+	_mkdir(Directory.c_str());
+#else
+	mkdir(Directory.c_str(), 0755);
+#endif
+
+	const std::string CommonJ = MakeScript(200, 1);
+	const std::string BlizzardJ = MakeScript(300, 2);
+	WriteFile(Directory + "/common.j", CommonJ);
+	WriteFile(Directory + "/blizzard.j", BlizzardJ);
+
+	// war3map.j is big enough to be decompressed on the work pool, war3map.w3e doesn't compress
+
+	const std::vector<unsigned char> Terrain = RandomBytes(20000, 47);
+	std::vector<std::pair<std::string, std::string>> Files = {
+		{ "war3map.j", MakeScript(2000, 3) },
+		{ "war3map.w3i", MakeW3I() },
+		{ "war3map.w3e", std::string(begin(Terrain), end(Terrain)) },
+		{ "war3map.doo", std::string(5000, 'd') }
+	};
+
+	CMapCache Cache(Directory, Directory);
+	std::vector<CMapInput> Inputs;
+
+	// every version of the map has its own file, a rewritten file with the same size and mtime would look unchanged to the mapping registry
+
+	for (uint32_t Version = 0; Version < 3; ++Version)
+	{
+		const std::string What = "map version " + std::to_string(Version);
+		const std::string Path = Directory + "/map" + std::to_string(Version) + ".w3x";
+
+		// version 1 changes the last input, version 2 the first one that's in the map
+
+		if (Version == 1)
+			Files[3].second = std::string(5000, 'e');
+		else if (Version == 2)
+			Files[0].second = MakeScript(2000, 4);
+
+		if (!WriteMap(Path, Files))
+		{
+			Check(false, "writing " + Path);
+			break;
+		}
+
+		std::shared_ptr<CMappedFile> File = CMappedFile::Open(Path, false);
+
+		if (!File)
+		{
+			Check(false, "mapping " + Path);
+			break;
+		}
+
+		CMPQArchive Archive(File);
+		Check(Archive.GetValid(), What + " opens");
+
+		for (auto & file : Files)
+		{
+			std::string Data;
+			Check(Archive.ReadFile(file.first, Data) && Data == file.second, What + " read " + file.first);
+		}
+
+		// map_crc and map_sha1 by their definition: common.j, blizzard.j, a constant and then the map's own files in order
+
+		hash::rolc Rolc;
+		hash::sha1 SHA1;
+
+		for (const std::string *input : std::initializer_list<const std::string *>{ &CommonJ, &BlizzardJ, nullptr, &Files[0].second, &Files[2].second, &Files[3].second })
+		{
+			if (!input)
+			{
+				Rolc.update(0x03F1379E);
+				SHA1.update((const unsigned char *)"\x9E\x37\xF1\x03", 4);
+				continue;
+			}
+
+			Rolc.update((const unsigned char *)input->data(), input->size());
+			SHA1.update((const unsigned char *)input->data(), input->size());
+		}
+
+		std::array<uint8_t, 20> SHA1Expected;
+		SHA1.final(SHA1Expected.data());
+		const uint32_t CRCExpected = Rolc.final();
+
+		// an incremental scan (reusing the inputs of the previous version) has to give the same answer as a full scan
+
+		const uint32_t Info = CRC32(File->GetData(), File->GetSize());
+		CMapMetadata Incremental, Full;
+		Check(Cache.Scan(File, Info, Incremental, &Inputs), What + " incremental scan");
+		Check(Cache.Scan(File, Info, Full), What + " full scan");
+		Check(Full.CRC == CRCExpected && Full.SHA1 == SHA1Expected, What + " full scan map_crc and map_sha1");
+		Check(Incremental.CRC == CRCExpected && Incremental.SHA1 == SHA1Expected, What + " incremental scan map_crc and map_sha1");
+		Check(Full.Info == Info && Full.Size == File->GetSize() && Full.Width == 116 && Full.Height == 84 && Full.Slots.size() == 3, What + " w3i metadata");
+
+		File.reset();
+		remove(Path.c_str());
+	}
+
+	remove((Directory + "/common.j").c_str());
+	remove((Directory + "/blizzard.j").c_str());
+
+#ifdef WIN32
+	_rmdir(Directory.c_str());
+#else
+	rmdir(Directory.c_str());
+#endif
+}
+
+//
+// explode
+//
+
+static void TestExplode()
+{
+	// the example from Mark Adler's blast.c, binary literals with a 1 KB dictionary and one long back reference
+
+	const uint8_t Compressed[] = { 0x00, 0x04, 0x82, 0x24, 0x25, 0x8f, 0x80, 0x7f };
+	uint8_t Out[16];
+
+	memset(Out, 0, sizeof(Out));
+	Check(Explode(Compressed, sizeof(Compressed), Out, 13) && memcmp(Out, "AIAIAIAIAIAIA", 13) == 0, "explode of the blast.c example");
+
+	// a sector has to decompress to exactly the size the archive says and nothing may be read past the input
+
+	Check(!Explode(Compressed, sizeof(Compressed), Out, 12), "explode into a smaller sector");
+	Check(!Explode(Compressed, sizeof(Compressed), Out, 14), "explode into a larger sector");
+	Check(!Explode(Compressed, 5, Out, 13), "explode of a truncated sector");
+
+	const uint8_t BadHeader[] = { 0x02, 0x04, 0x82, 0x24, 0x25, 0x8f, 0x80, 0x7f };
+	Check(!Explode(BadHeader, sizeof(BadHeader), Out, 13), "explode with an invalid literal mode");
+}
+
+//
+// work pool
+//
+
+static void TestWorkPool()
+{
+	CWorkPool &Pool = CWorkPool::Get();
+
+	// every task runs exactly once
+
+	std::vector<std::atomic<uint32_t>> Runs(1000);
+
+	for (auto & runs : Runs)
+		runs = 0;
+
+	Check(Pool.Run(Runs.size(), [&Runs](uint32_t task) { ++Runs[task]; return true; }), "work pool run");
+	Check(std::all_of(begin(Runs), end(Runs), [](const std::atomic<uint32_t> &runs) { return runs == 1; }), "work pool runs every task once");
+
+	// a failed or throwing task fails the run, the other tasks still finish
+
+	std::atomic<uint32_t> Finished(0);
+	Check(!Pool.Run(64, [&Finished](uint32_t task) { ++Finished; return task != 17; }), "work pool with a failed task");
+	Check(Finished == 64, "work pool finishes the other tasks");
+	Check(!Pool.Run(64, [](uint32_t task) -> bool { if (task == 40) throw std::bad_alloc(); return true; }), "work pool with a throwing task");
+
+	// tasks using the pool themselves (map inputs reading big files) complete
+
+	std::atomic<uint32_t> Inner(0);
+	Check(Pool.Run(16, [&Pool, &Inner](uint32_t) { return Pool.Run(16, [&Inner](uint32_t) { ++Inner; return true; }); }) && Inner == 256, "nested work pool runs");
+}
+
+//
+// map downloads
+//
+
+// sends a map of mapSize bytes through a simulated link with a bottleneck of rate bytes per second and the given round trip time
+// the loop runs every millisecond like ydhost's does while a download is active, every part is acknowledged once it's through the link
+
+static void SimulateDownload(uint32_t rate, uint32_t rtt, uint32_t mapSize)
+{
+	const std::string What = "download at " + std::to_string(rate) + " bytes/s and " + std::to_string(rtt) + " ms";
+	const uint32_t StartTicks = 1000;
+	CDownloadPacer Pacer(StartTicks, 0);
+	std::queue<std::pair<uint64_t, uint32_t>> Acks;   // (time in microseconds the ack arrives, bytes acknowledged)
+	uint64_t LinkFree = (uint64_t)StartTicks * 1000;  // the time in microseconds the link is done with the parts sent so far
+	uint64_t MaxQueue = 0;
+	uint32_t Sent = 0;
+
+	for (uint32_t Ticks = StartTicks; Ticks < StartTicks + 600000; ++Ticks)
+	{
+		const uint64_t Now = (uint64_t)Ticks * 1000;
+
+		while (!Acks.empty() && Acks.front().first <= Now)
+		{
+			Pacer.OnAck(Ticks, Acks.front().second);
+			Acks.pop();
+		}
+
+		if (Pacer.GetAcked() >= mapSize)
+		{
+			// a part sent while the link is busy waits in the queue of the bottleneck, the pacer should keep that short
+
+			Check((uint64_t)Pacer.GetThroughput(Ticks) * 10 >= (uint64_t)rate * 9, What + " reaches 90% of the link, got " + std::to_string(Pacer.GetThroughput(Ticks)));
+			Check((uint64_t)Pacer.GetBandwidth() * 10 >= (uint64_t)rate * 9 && (uint64_t)Pacer.GetBandwidth() * 10 <= (uint64_t)rate * 11, What + " measures the bandwidth, got " + std::to_string(Pacer.GetBandwidth()));
+			Check(MaxQueue <= (uint64_t)(3 * rtt + 50) * 1000, What + " keeps the queue short, got " + std::to_string(MaxQueue / 1000) + " ms");
+			return;
+		}
+
+		while (Sent < mapSize && Pacer.CanSend(Ticks))
+		{
+			const uint32_t Length = std::min<uint32_t>(1442, mapSize - Sent);
+			Pacer.OnSend(Ticks, Length);
+			Sent += Length;
+
+			const uint64_t Start = std::max(LinkFree, Now);
+			MaxQueue = std::max(MaxQueue, Start - Now);
+			LinkFree = Start + (uint64_t)Length * 1000000 / rate;
+			Acks.push(std::make_pair(LinkFree + (uint64_t)rtt * 1000, Sent));
+		}
+	}
+
+	Check(false, What + " finishes");
+}
+
+static void TestDownloadPacer()
+{
+	// before the first ack the pacer allows the initial window, a part is always allowed when nothing is in flight
+
+	CDownloadPacer Pacer(0, 100);
+	Check(Pacer.GetWindow() == DOWNLOAD_INITIAL_WINDOW && Pacer.GetBandwidth() == 0, "download pacer initial window");
+	Check(Pacer.CanSend(0), "download pacer sends the first part");
+
+	while (Pacer.GetInFlight() < DOWNLOAD_INITIAL_WINDOW)
+		Pacer.OnSend(0, 1442);
+
+	Check(!Pacer.CanSend(1000) && Pacer.GetWait(1000) == 0xFFFFFFFF, "download pacer waits for an ack when the window is full");
+	Pacer.OnAck(100, Pacer.GetSent());
+	Check(Pacer.GetInFlight() == 0 && Pacer.CanSend(100), "download pacer sends after everything was acknowledged");
+
+	// from a LAN to a slow link far away
+
+	SimulateDownload(10000000, 4, 8000000);
+	SimulateDownload(1000000, 20, 4000000);
+	SimulateDownload(250000, 300, 3000000);
+	SimulateDownload(100000, 100, 2000000);
+}
+
+template <typename Function>
+static void Bench(const std::string &name, size_t length, Function function)
+{
+	// enough passes over the buffer that the timer resolution doesn't matter
+
+	const std::vector<unsigned char> Data = RandomBytes(length, 1);
+	const size_t Passes = std::max<size_t>((size_t)256 * 1024 * 1024 / length, 1);
+	uint32_t Sink = 0;
+
+	const auto Start = std::chrono::steady_clock::now();
+
+	for (size_t i = 0; i < Passes; ++i)
+		Sink += function(Data.data(), Data.size());
+
+	const double Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+	char Line[128];
+	snprintf(Line, sizeof(Line), "[BENCH] %-24s %8u bytes %10.1f MB/s (%08x)", name.c_str(), (uint32_t)length, (double)length * Passes / Seconds / 1e6, Sink);
+	std::cout << Line << std::endl;
+}
+
+static void BenchCRC32()
+{
+	// 16 bytes is a typical action frame, 1460 a map part, 1 MB a map file read in one go
+
+	for (size_t length : { (size_t)16, (size_t)1460, (size_t)1024 * 1024 })
+	{
+		Bench("crc32 reference", length, ReferenceCRC32);
+		Bench("crc32 slicing-by-8", length, [](const unsigned char *buf, size_t len) { return ~aura_crc32::update_slice8(0xFFFFFFFF, buf, len); });
+#ifdef CRC32_HAVE_PCLMUL
+		if (aura_crc32::cpu_has_pclmul())
+			Bench("crc32 pclmul", length, [](const unsigned char *buf, size_t len) { return ~aura_crc32::update_pclmul(0xFFFFFFFF, buf, len); });
+#endif
+	}
+}
+
+// the rounds alone over the whole blocks of a buffer, without the padding of a full digest
+
+static uint32_t SHA1Blocks(void (*transform)(uint32_t *, const unsigned char *, size_t), const unsigned char *buf, size_t len)
+{
+	uint32_t State[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+	transform(State, buf, len / 64);
+	return State[0];
+}
+
+static void BenchHashes()
+{
+	// common.j and blizzard.j are a few hundred KB, a big war3map.j a few MB
+
+	for (size_t length : { (size_t)256 * 1024, (size_t)4 * 1024 * 1024 })
+	{
+		Bench("sha1", length, [](const unsigned char *buf, size_t len) { return (uint32_t)SHA1Hex({ { buf, len } })[0]; });
+		Bench("sha1 portable", length, [](const unsigned char *buf, size_t len) { return SHA1Blocks(hash::sha1_transform::portable, buf, len); });
+
+		if (hash::sha1_transform::has_shani())
+			Bench("sha1 sha-ni", length, [](const unsigned char *buf, size_t len) { return SHA1Blocks(hash::sha1_transform::shani, buf, len); });
+
+		Bench("rolc reference", length, ReferenceRolc);
+		Bench("rolc", length, hash::rolc::block);
+	}
+}
+
+static void BenchReadFile()
+{
+	// a big war3map.j and terrain, the two files of a map that are usually big enough to be split over the work pool
+	// the terrain is mostly small height and texture values that compress about as well as real war3map.w3e files
+
+	std::mt19937 Random(43);
+	std::string Terrain(6 * 1024 * 1024, '\0');
+
+	for (auto & byte : Terrain)
+		byte = (char)(Random() % 8);
+
+	const std::vector<std::pair<std::string, std::string>> Files = {
+		{ "war3map.j", MakeScript(60000, 5) },
+		{ "war3map.w3e", Terrain }
+	};
+
+	const std::string Path = "ydhost-selftest-bench.w3x";
+
+	if (!WriteMap(Path, Files))
+	{
+		Check(false, "writing " + Path);
+		return;
+	}
+
+	{
+		std::shared_ptr<CMappedFile> File = CMappedFile::Open(Path, false);
+		CMPQArchive Archive(File);
+
+		for (auto & file : Files)
+		{
+			for (bool split : { false, true })
+			{
+				Archive.SetSplitSectors(split);
+				const size_t Passes = std::max<size_t>((size_t)256 * 1024 * 1024 / file.second.size(), 1);
+				bool Success = true;
+				std::string Data;
+
+				const auto Start = std::chrono::steady_clock::now();
+
+				for (size_t i = 0; i < Passes; ++i)
+					Success = Archive.ReadFile(file.first, Data) && Success;
+
+				const double Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+				Check(Success && Data == file.second, "reading " + file.first + " for the benchmark");
+
+				char Line[128];
+				snprintf(Line, sizeof(Line), "[BENCH] %-24s %8u bytes %10.1f MB/s", (file.first + (split ? " work pool" : " one thread")).c_str(), (uint32_t)file.second.size(), (double)file.second.size() * Passes / Seconds / 1e6);
+				std::cout << Line << std::endl;
+			}
+		}
+	}
+
+	remove(Path.c_str());
+}
+
+int main(int argc, char **argv)
+{
+	TestCRC32();
+	TestSHA1();
+	TestRolc();
+	TestExplode();
+	TestMapScan();
+	TestWorkPool();
+	TestDownloadPacer();
+
+	if (argc > 1 && std::string(argv[1]) == "bench")
+	{
+		BenchCRC32();
+		BenchHashes();
+		BenchReadFile();
+	}
+
+	if (Failures > 0)
+	{
+		std::cout << "[SELFTEST] " << Failures << " checks failed" << std::endl;
+		return 1;
+	}
+
+	std::cout << "[SELFTEST] all checks passed" << std::endl;
+	return 0;
+}